@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bitmap.h"
+
+/*
+ * Per operation cost of the checked API against the inline unchecked fast path, on random
+ * values in a full size bitmap.
+ */
+
+#define BENCH_CAPACITY UINT16_MAX
+#define BENCH_VALUES (1 << 16)
+#define BENCH_ROUNDS 200
+
+static u16 values[BENCH_VALUES];
+static volatile u32 sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double ops(void)
+{
+    return (double)BENCH_VALUES * BENCH_ROUNDS;
+}
+
+int main(void)
+{
+    struct bitmap *bm = NULL;
+    double start = 0;
+    double checked = 0;
+    double unchecked = 0;
+    u32 hits = 0;
+    u32 round = 0;
+    u32 i = 0;
+
+    bm = bitmap_create(BENCH_CAPACITY);
+
+    if (bm == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+
+    for (i = 0; i < BENCH_VALUES; i++)
+    {
+        values[i] = (u16)(rand() % BENCH_CAPACITY);
+    }
+
+    printf("%-10s %14s %14s\n", "op", "checked ns", "unchecked ns");
+
+    /* add */
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            bitmap_add_value(bm, values[i]);
+        }
+    }
+
+    checked = (now_ns() - start) / ops();
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            bitmap_set_unchecked(bm, values[i]);
+        }
+    }
+
+    unchecked = (now_ns() - start) / ops();
+    printf("%-10s %14.3f %14.3f\n", "add", checked, unchecked);
+
+    /* test */
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            hits += bitmap_test_value(bm, values[i]);
+        }
+    }
+
+    checked = (now_ns() - start) / ops();
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            hits += bitmap_test(bm, values[i]);
+        }
+    }
+
+    unchecked = (now_ns() - start) / ops();
+    printf("%-10s %14.3f %14.3f\n", "test", checked, unchecked);
+
+    /* delete, refill between rounds so every round removes the same values */
+    checked = 0;
+    unchecked = 0;
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            bitmap_set_unchecked(bm, values[i]);
+        }
+
+        start = now_ns();
+
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            bitmap_del_value(bm, values[i]);
+        }
+
+        checked += now_ns() - start;
+
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            bitmap_set_unchecked(bm, values[i]);
+        }
+
+        start = now_ns();
+
+        for (i = 0; i < BENCH_VALUES; i++)
+        {
+            bitmap_clear_unchecked(bm, values[i]);
+        }
+
+        unchecked += now_ns() - start;
+    }
+
+    printf("%-10s %14.3f %14.3f\n", "del", checked / ops(), unchecked / ops());
+
+    sink = hits;
+    bitmap_destroy(bm);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bitmap-format.h"
+#include "bitmap.h"
+
+/*
+ * bitmap_format against one snprintf per range, the way bitmap_print used to work, on a full
+ * size bitmap of random single values and short ranges.
+ */
+
+#define BENCH_CAPACITY UINT16_MAX
+#define BENCH_ROUNDS 200
+#define BENCH_BUF_SIZE (512 * 1024)
+
+static char out[BENCH_BUF_SIZE];
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static size_t format_printf(const struct bitmap *bm, char *buf, size_t len)
+{
+    size_t pos = 0;
+    u32 start = 0;
+    u32 i = 0;
+
+    for (i = 0; i < bm->max_value; i++)
+    {
+        if (!bitmap_test(bm, i))
+        {
+            continue;
+        }
+
+        start = i;
+
+        while (i + 1 < bm->max_value && bitmap_test(bm, i + 1))
+        {
+            i++;
+        }
+
+        if (start == i)
+        {
+            pos += (size_t)snprintf(buf + pos, len - pos, pos ? ",%u" : "%u", start);
+        }
+        else
+        {
+            pos += (size_t)snprintf(buf + pos, len - pos, pos ? ",%u-%u" : "%u-%u", start, i);
+        }
+    }
+
+    return pos;
+}
+
+int main(void)
+{
+    struct bitmap *bm = NULL;
+    double start = 0;
+    double elapsed = 0;
+    size_t len = 0;
+    u32 round = 0;
+    u32 i = 0;
+
+    bm = bitmap_create(BENCH_CAPACITY);
+
+    if (bm == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+
+    for (i = 0; i < BENCH_CAPACITY; i++)
+    {
+        if (rand() % 3 == 0)
+        {
+            bitmap_add_value(bm, (u16)i);
+        }
+    }
+
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        len = format_printf(bm, out, sizeof(out));
+    }
+
+    elapsed = now_ns() - start;
+    printf("snprintf per range: %zu bytes, %.1f MB/s\n", len,
+           (double)len * BENCH_ROUNDS / (elapsed / 1e9) / (1024 * 1024));
+
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        len = bitmap_format(bm, out, sizeof(out));
+    }
+
+    elapsed = now_ns() - start;
+    printf("bitmap_format:      %zu bytes, %.1f MB/s\n", len,
+           (double)len * BENCH_ROUNDS / (elapsed / 1e9) / (1024 * 1024));
+
+    bitmap_destroy(bm);
+
+    return EXIT_SUCCESS;
+}
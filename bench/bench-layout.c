@@ -0,0 +1,164 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitmap-alloc.h"
+#include "bitmap.h"
+
+/*
+ * Compare full-buffer scans over the old layout, where buf[] followed the header inside one
+ * malloc block, with the cache line aligned words from a pool.
+ */
+
+#define BENCH_BITMAPS 8192
+#define BENCH_CAPACITY UINT16_MAX
+#define BENCH_SCAN_ROUNDS 20
+#define BENCH_OR_ROUNDS 1 /* bitmap_or rescans bit by bit, one round is plenty */
+#define LEGACY_HEADER_SIZE 20 /* offsetof(struct bitmap, buf) before buf became a pointer */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void fill(struct bitmap **bms, u32 count)
+{
+    u32 i = 0;
+    u32 j = 0;
+
+    srand(1);
+
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < bms[i]->buf_len; j++)
+        {
+            bms[i]->buf[j] = (u32)rand();
+        }
+
+        bms[i]->buf[bms[i]->buf_len - 1] &= UINT32_MAX >> 1; /* bit 65535 is out of range */
+    }
+
+    return;
+}
+
+static void run(const char *name, struct bitmap **bms, u32 count)
+{
+    uint64_t sum = 0;
+    u32 round = 0;
+    u32 i = 0;
+    u32 j = 0;
+    double start = 0;
+    double scan_ns = 0;
+    double or_ns = 0;
+    double words = 0;
+
+    fill(bms, count);
+    words = (double)count * bms[0]->buf_len;
+
+    start = now_ns();
+
+    for (round = 0; round < BENCH_SCAN_ROUNDS; round++)
+    {
+        for (i = 0; i < count; i++)
+        {
+            for (j = 0; j < bms[i]->buf_len; j++)
+            {
+                sum += (uint64_t)__builtin_popcount(bms[i]->buf[j]);
+            }
+        }
+    }
+
+    scan_ns = now_ns() - start;
+    start = now_ns();
+
+    for (round = 0; round < BENCH_OR_ROUNDS; round++)
+    {
+        for (i = 0; i < count; i++)
+        {
+            bitmap_or(bms[i], bms[(i + 1) % count]);
+        }
+    }
+
+    or_ns = now_ns() - start;
+
+    printf("%-24s popcount scan %7.3f ns/word   bitmap_or %7.3f ns/word   (%" PRIu64 ")\n",
+           name, scan_ns / (words * BENCH_SCAN_ROUNDS), or_ns / (words * BENCH_OR_ROUNDS), sum);
+
+    return;
+}
+
+int main(void)
+{
+    static struct bitmap legacy_headers[BENCH_BITMAPS];
+    struct bitmap **bms = NULL;
+    struct bitmap_pool *pool = NULL;
+    u8 *block = NULL;
+    u16 buf_len = 0;
+    u32 i = 0;
+
+    bms = (struct bitmap **)calloc(BENCH_BITMAPS, sizeof(struct bitmap *));
+
+    if (bms == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* Old layout: the words start right after a 20 byte header in the same malloc block */
+    buf_len = (BENCH_CAPACITY + 31) / 32;
+
+    for (i = 0; i < BENCH_BITMAPS; i++)
+    {
+        block = (u8 *)malloc(LEGACY_HEADER_SIZE + buf_len * sizeof(u32));
+
+        if (block == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+
+        bms[i] = &legacy_headers[i];
+        memset(bms[i], 0, sizeof(struct bitmap));
+        bms[i]->bm_self = bms[i];
+        bms[i]->buf = (u32 *)(block + LEGACY_HEADER_SIZE);
+        bms[i]->max_value = BENCH_CAPACITY;
+        bms[i]->buf_len = buf_len;
+    }
+
+    run("malloc, header + words", bms, BENCH_BITMAPS);
+
+    for (i = 0; i < BENCH_BITMAPS; i++)
+    {
+        free((u8 *)bms[i]->buf - LEGACY_HEADER_SIZE);
+    }
+
+    /* New layout: aligned words from pool slabs */
+    pool = bitmap_pool_create();
+    bitmap_set_allocator(bitmap_pool_allocator(pool));
+
+    for (i = 0; i < BENCH_BITMAPS; i++)
+    {
+        bms[i] = bitmap_create(BENCH_CAPACITY);
+
+        if (bms[i] == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    run("pool, aligned words", bms, BENCH_BITMAPS);
+
+    for (i = 0; i < BENCH_BITMAPS; i++)
+    {
+        bitmap_destroy(bms[i]);
+    }
+
+    bitmap_pool_destroy(pool);
+    free(bms);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitmap-parse.h"
+#include "bitmap.h"
+
+/*
+ * bitmap_parse_str and bitmap_parse_parallel throughput on a multi-MB range list of random
+ * single values and short ranges, like the ones in our configs.
+ */
+
+#define BENCH_INPUT_SIZE (8 * 1024 * 1024)
+#define BENCH_ROUNDS 10
+#define BENCH_MAX_RANGE 64
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *make_input(size_t size)
+{
+    char *str = NULL;
+    size_t len = 0;
+    u32 start = 0;
+    int written = 0;
+
+    str = (char *)malloc(size + 32);
+
+    if (str == NULL)
+    {
+        return NULL;
+    }
+
+    srand(1);
+
+    while (len < size)
+    {
+        start = (u32)(rand() % (UINT16_MAX - BENCH_MAX_RANGE));
+
+        if (rand() % 2)
+        {
+            written = sprintf(str + len, "%u,", start);
+        }
+        else
+        {
+            written = sprintf(str + len, "%u-%u,", start, start + rand() % BENCH_MAX_RANGE);
+        }
+
+        len += (size_t)written;
+    }
+
+    str[len - 1] = '\0'; /* drop the last separator */
+
+    return str;
+}
+
+int main(void)
+{
+    struct bitmap *bm = NULL;
+    char *str = NULL;
+    double start = 0;
+    double elapsed = 0;
+    size_t len = 0;
+    u32 round = 0;
+
+    str = make_input(BENCH_INPUT_SIZE);
+
+    if (str == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    len = strlen(str);
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        bm = bitmap_parse_str((u8 *)str);
+
+        if (bm == NULL)
+        {
+            printf("Parsing failed\n");
+            return EXIT_FAILURE;
+        }
+
+        bitmap_destroy(bm);
+    }
+
+    elapsed = now_ns() - start;
+
+    printf("bitmap_parse_str: %zu bytes x %u rounds, %.1f MB/s\n", len, BENCH_ROUNDS,
+           (double)len * BENCH_ROUNDS / (elapsed / 1e9) / (1024 * 1024));
+
+    start = now_ns();
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        bm = bitmap_parse_parallel((u8 *)str, len, 0, NULL);
+
+        if (bm == NULL)
+        {
+            printf("Parsing failed\n");
+            return EXIT_FAILURE;
+        }
+
+        bitmap_destroy(bm);
+    }
+
+    elapsed = now_ns() - start;
+
+    printf("bitmap_parse_parallel: %zu bytes x %u rounds, %.1f MB/s\n", len, BENCH_ROUNDS,
+           (double)len * BENCH_ROUNDS / (elapsed / 1e9) / (1024 * 1024));
+
+    free(str);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,392 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitmap-registry.h"
+#include "bitmap.h"
+#include "command.h"
+#include "protocol.h"
+#include "server.h"
+
+/*
+ * Load generator for the server: requests per second and latency of membership tests, with
+ * the text protocol, one value per command line, and with the binary protocol, a batch of
+ * values per frame. Requests are pipelined BENCH_DEPTH at a time, a request's latency runs
+ * from sending its window to receiving its response.
+ *
+ *     bench/bench-server              Start a server thread in this process
+ *     bench/bench-server <socket>     Load a running ./main --serve <socket>
+ */
+
+#define BENCH_CAPACITY UINT16_MAX
+#define BENCH_NAME "bench"
+#define BENCH_DEPTH 64       /* Requests in flight */
+#define BENCH_BATCH 256      /* Values per binary frame */
+#define BENCH_TEXT_REQUESTS (256 * 1024)
+#define BENCH_BINARY_REQUESTS (16 * 1024)
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int connect_to(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = -1;
+    int attempt = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    /* An in-process server may still be starting */
+    for (attempt = 0; attempt < 100; attempt++)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (fd < 0)
+        {
+            return -1;
+        }
+
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            return fd;
+        }
+
+        close(fd);
+        usleep(10000);
+    }
+
+    return -1;
+}
+
+static bool send_all(int fd, const char *buf, size_t len)
+{
+    ssize_t sent = 0;
+
+    while (len > 0)
+    {
+        sent = send(fd, buf, len, 0);
+
+        if (sent <= 0)
+        {
+            return false;
+        }
+
+        buf += sent;
+        len -= (size_t)sent;
+    }
+
+    return true;
+}
+
+/* Read until the buffer holds at least len bytes */
+static bool recv_until(int fd, struct command_output *in, size_t len)
+{
+    ssize_t got = 0;
+
+    while (in->len < len)
+    {
+        if (!command_output_append(in, NULL, 64 * 1024))
+        {
+            return false;
+        }
+
+        got = recv(fd, in->buf + in->len, in->size - in->len, 0);
+
+        if (got <= 0)
+        {
+            return false;
+        }
+
+        in->len += (size_t)got;
+    }
+
+    return true;
+}
+
+static void report(const char *name, double *latency, u32 requests, u32 values, double elapsed)
+{
+    qsort(latency, requests, sizeof(double), compare_double);
+
+    printf("%-8s %12.0f %14.0f %10.1f %10.1f %10.1f\n", name, requests / (elapsed / 1e9),
+           (double)values / (elapsed / 1e9), latency[requests / 2] / 1e3,
+           latency[(u32)(requests * 0.99)] / 1e3, latency[(u32)(requests * 0.999)] / 1e3);
+
+    return;
+}
+
+static bool run_text(int fd, double *latency)
+{
+    struct command_output out = {NULL, 0, 0};
+    struct command_output in = {NULL, 0, 0};
+    char line[64];
+    double start = 0;
+    double window = 0;
+    size_t pos = 0;
+    char *end = NULL;
+    u32 done = 0;
+    u32 i = 0;
+    int len = 0;
+
+    srand(2);
+    start = now_ns();
+
+    for (done = 0; done < BENCH_TEXT_REQUESTS; done += BENCH_DEPTH)
+    {
+        out.len = 0;
+
+        for (i = 0; i < BENCH_DEPTH; i++)
+        {
+            len = snprintf(line, sizeof(line), "test " BENCH_NAME " %d\n", rand() % UINT16_MAX);
+            command_output_append(&out, line, (size_t)len);
+        }
+
+        window = now_ns();
+
+        if (!send_all(fd, out.buf, out.len))
+        {
+            return false;
+        }
+
+        /* One response line per request */
+        for (i = 0; i < BENCH_DEPTH; i++)
+        {
+            while (pos == in.len || (end = memchr(in.buf + pos, '\n', in.len - pos)) == NULL)
+            {
+                if (!recv_until(fd, &in, in.len + 1))
+                {
+                    return false;
+                }
+            }
+
+            pos = (size_t)(end - in.buf) + 1;
+            latency[done + i] = now_ns() - window;
+        }
+
+        memmove(in.buf, in.buf + pos, in.len - pos);
+        in.len -= pos;
+        pos = 0;
+    }
+
+    report("text", latency, BENCH_TEXT_REQUESTS, BENCH_TEXT_REQUESTS, now_ns() - start);
+    command_output_free(&out);
+    command_output_free(&in);
+
+    return true;
+}
+
+static bool run_binary(int fd, double *latency)
+{
+    struct command_output out = {NULL, 0, 0};
+    struct command_output in = {NULL, 0, 0};
+    struct protocol_header header;
+    u16 values[BENCH_BATCH];
+    double start = 0;
+    double window = 0;
+    ssize_t len = 0;
+    u32 done = 0;
+    u32 i = 0;
+    u32 j = 0;
+
+    srand(2);
+    start = now_ns();
+
+    for (done = 0; done < BENCH_BINARY_REQUESTS; done += BENCH_DEPTH)
+    {
+        out.len = 0;
+
+        for (i = 0; i < BENCH_DEPTH; i++)
+        {
+            for (j = 0; j < BENCH_BATCH; j++)
+            {
+                values[j] = (u16)(rand() % UINT16_MAX);
+            }
+
+            protocol_append_frame(&out, PROTOCOL_OP_TEST, 0, BENCH_NAME, BENCH_BATCH, values,
+                                  sizeof(values));
+        }
+
+        window = now_ns();
+
+        if (!send_all(fd, out.buf, out.len))
+        {
+            return false;
+        }
+
+        for (i = 0; i < BENCH_DEPTH; i++)
+        {
+            while ((len = protocol_frame_len((u8 *)in.buf, in.len)) == 0)
+            {
+                if (!recv_until(fd, &in, in.len + 1))
+                {
+                    return false;
+                }
+            }
+
+            memcpy(&header, in.buf, sizeof(header));
+
+            if (len < 0 || header.status != PROTOCOL_OK)
+            {
+                return false;
+            }
+
+            latency[done + i] = now_ns() - window;
+            memmove(in.buf, in.buf + len, in.len - (size_t)len);
+            in.len -= (size_t)len;
+        }
+    }
+
+    report("binary", latency, BENCH_BINARY_REQUESTS, BENCH_BINARY_REQUESTS * BENCH_BATCH,
+           now_ns() - start);
+    command_output_free(&out);
+    command_output_free(&in);
+
+    return true;
+}
+
+static char path[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+static u16 prefill[BENCH_CAPACITY / 2 + 1];
+
+static void *serve(void *arg)
+{
+    server_run((struct command_context *)arg, path);
+
+    return NULL;
+}
+
+/* Create the bitmap with every even value, so tests hit and miss */
+static bool fill(int fd)
+{
+    struct command_output out = {NULL, 0, 0};
+    struct command_output in = {NULL, 0, 0};
+    struct protocol_header header;
+    ssize_t len = 0;
+    u32 i = 0;
+    bool ok = true;
+
+    for (i = 0; i < BENCH_CAPACITY / 2 + 1; i++)
+    {
+        prefill[i] = (u16)(i * 2);
+    }
+
+    protocol_append_frame(&out, PROTOCOL_OP_CREATE, 0, BENCH_NAME, BENCH_CAPACITY, NULL, 0);
+    protocol_append_frame(&out, PROTOCOL_OP_ADD, 0, BENCH_NAME, BENCH_CAPACITY / 2 + 1, prefill,
+                          sizeof(prefill));
+
+    ok = send_all(fd, out.buf, out.len);
+
+    for (i = 0; ok && i < 2; i++)
+    {
+        while ((len = protocol_frame_len((u8 *)in.buf, in.len)) == 0 &&
+               recv_until(fd, &in, in.len + 1))
+        {
+        }
+
+        ok = len > 0;
+
+        if (ok)
+        {
+            memcpy(&header, in.buf, sizeof(header));
+            ok = header.status == PROTOCOL_OK;
+        }
+
+        if (ok)
+        {
+            memmove(in.buf, in.buf + len, in.len - (size_t)len);
+            in.len -= (size_t)len;
+        }
+    }
+
+    command_output_free(&out);
+    command_output_free(&in);
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    struct command_context ctx = {NULL};
+    pthread_t thread;
+    double *latency = NULL;
+    bool local = argc < 2;
+    bool ok = false;
+    int fd = -1;
+
+    if (local)
+    {
+        snprintf(path, sizeof(path), "/tmp/bench-server-%d.sock", (int)getpid());
+        ctx.registry = bitmap_registry_create();
+
+        if (ctx.registry == NULL || pthread_create(&thread, NULL, serve, &ctx) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "%s", argv[1]);
+    }
+
+    fd = connect_to(path);
+    latency = (double *)malloc(BENCH_TEXT_REQUESTS * sizeof(double));
+
+    if (fd < 0 || latency == NULL || !fill(fd))
+    {
+        printf("Cannot set up the bitmap on %s\n", path);
+        goto cleanup;
+    }
+
+    /* Each protocol on its own connection, the first byte picks it */
+    close(fd);
+    fd = connect_to(path);
+
+    printf("%-8s %12s %14s %10s %10s %10s\n", "protocol", "requests/s", "values/s", "p50 us",
+           "p99 us", "p99.9 us");
+
+    ok = fd >= 0 && run_text(fd, latency);
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    fd = connect_to(path);
+    ok = ok && fd >= 0 && run_binary(fd, latency);
+
+cleanup:
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (local)
+    {
+        server_stop();
+        pthread_join(thread, NULL);
+        bitmap_registry_destroy(ctx.registry);
+    }
+
+    free(latency);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
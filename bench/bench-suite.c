@@ -0,0 +1,365 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "bitmap-format.h"
+#include "bitmap.h"
+
+/*
+ * Every bitmap operation over a grid of capacities and densities:
+ *
+ *     bench-suite [--json] [--perf] [op...]
+ *
+ * --perf adds the hardware counters, see bench_perf_open. Times are per call, add, del and
+ * test are per value over random values. "print" is
+ * bitmap_format, the work of bitmap_print without the terminal. Capacities stop at the
+ * largest a bitmap can have, UINT16_MAX bits.
+ */
+
+#define BENCH_VALUES (1 << 16) /* Random values of add, del and test, a power of 2 */
+
+struct suite
+{
+    u16 capacity;
+    struct bitmap *base;  /* The input, at the density of the case */
+    struct bitmap *other; /* Second operand of or and and, same density */
+    struct bitmap *work;  /* Copy of base the mutators change, fresh for every repetition */
+    char *str;            /* base as a range list */
+    size_t str_len;
+    u16 values[BENCH_VALUES];
+};
+
+struct suite_op
+{
+    const char *name;
+    void (*setup)(void *ctx);
+    void (*run)(void *ctx, u32 iters);
+    bool per_value; /* One word per iteration rather than the whole bitmap */
+};
+
+static const u16 capacities[] = {1024, 8192, UINT16_MAX};
+static const double densities[] = {0.0001, 0.01, 0.1, 0.5, 0.99};
+static volatile u32 sink;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void)
+{
+    /* xorshift64, rand() is too slow to fill the larger grids */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return rng_state;
+}
+
+static struct bitmap *make_bitmap(u16 capacity, double density)
+{
+    struct bitmap *bm = NULL;
+    uint64_t threshold = 0;
+    u32 i = 0;
+
+    bm = bitmap_create(capacity);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    threshold = (uint64_t)(density * (double)UINT32_MAX);
+
+    for (i = 0; i < capacity; i++)
+    {
+        if ((rng() & UINT32_MAX) < threshold)
+        {
+            bitmap_add_value(bm, (u16)i);
+        }
+    }
+
+    /* Parse and print need at least one value */
+    if (bm->numbers == 0)
+    {
+        bitmap_add_value(bm, (u16)(rng() % capacity));
+    }
+
+    return bm;
+}
+
+static void setup_work(void *ctx)
+{
+    struct suite *s = (struct suite *)ctx;
+
+    bitmap_destroy(s->work);
+    s->work = bitmap_clone(s->base);
+
+    return;
+}
+
+static void run_create(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_destroy(bitmap_create(s->capacity));
+    }
+
+    return;
+}
+
+static void run_add(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_add_value(s->work, s->values[i & (BENCH_VALUES - 1)]);
+    }
+
+    return;
+}
+
+static void run_del(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_del_value(s->work, s->values[i & (BENCH_VALUES - 1)]);
+    }
+
+    return;
+}
+
+static void run_test(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 hits = 0;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        hits += bitmap_test_value(s->base, s->values[i & (BENCH_VALUES - 1)]);
+    }
+
+    sink = hits;
+
+    return;
+}
+
+static void run_or(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_or(s->work, s->other);
+    }
+
+    return;
+}
+
+static void run_and(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_and(s->work, s->other);
+    }
+
+    return;
+}
+
+static void run_not(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_not(s->work);
+    }
+
+    return;
+}
+
+static void run_clone(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_destroy(bitmap_clone(s->base));
+    }
+
+    return;
+}
+
+static void run_parse(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    u32 i = 0;
+
+    for (i = 0; i < iters; i++)
+    {
+        bitmap_destroy(bitmap_parse_str((u8 *)s->str));
+    }
+
+    return;
+}
+
+static void run_print(void *ctx, u32 iters)
+{
+    struct suite *s = (struct suite *)ctx;
+    size_t len = 0;
+    u32 i = 0;
+
+    /* Writes the same range list over str */
+    for (i = 0; i < iters; i++)
+    {
+        len += bitmap_format(s->base, s->str, s->str_len + 1);
+    }
+
+    sink = (u32)len;
+
+    return;
+}
+
+static const struct suite_op ops[] = {
+    {"create", NULL, run_create, false},
+    {"add", setup_work, run_add, true},
+    {"del", setup_work, run_del, true},
+    {"test", NULL, run_test, true},
+    {"or", setup_work, run_or, false},
+    {"and", setup_work, run_and, false},
+    {"not", setup_work, run_not, false},
+    {"clone", NULL, run_clone, false},
+    {"parse", NULL, run_parse, false},
+    {"print", NULL, run_print, false},
+};
+
+static bool selected(const char *op, int argc, char **argv, int first)
+{
+    int i = 0;
+
+    if (first >= argc)
+    {
+        return true;
+    }
+
+    for (i = first; i < argc; i++)
+    {
+        if (strcmp(argv[i], op) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    struct suite *s = NULL;
+    struct bench_case c;
+    struct bench_result result;
+    bool json = false;
+    bool first = true;
+    int first_op = 1;
+    size_t cap = 0;
+    size_t den = 0;
+    size_t op = 0;
+    u32 i = 0;
+
+    for (; first_op < argc && strncmp(argv[first_op], "--", 2) == 0; first_op++)
+    {
+        if (strcmp(argv[first_op], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (strcmp(argv[first_op], "--perf") == 0 && !bench_perf_open())
+        {
+            fprintf(stderr, "Hardware counters are not available, timing only\n");
+        }
+    }
+
+    s = (struct suite *)calloc(1, sizeof(struct suite));
+
+    if (s == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    bench_report_begin(stdout, json);
+
+    for (cap = 0; cap < sizeof(capacities) / sizeof(capacities[0]); cap++)
+    {
+        for (den = 0; den < sizeof(densities) / sizeof(densities[0]); den++)
+        {
+            s->capacity = capacities[cap];
+            s->base = make_bitmap(s->capacity, densities[den]);
+            s->other = make_bitmap(s->capacity, densities[den]);
+
+            if (s->base == NULL || s->other == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+
+            s->str_len = bitmap_format(s->base, NULL, 0);
+            s->str = (char *)malloc(s->str_len + 1);
+
+            if (s->str == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+
+            bitmap_format(s->base, s->str, s->str_len + 1);
+
+            for (i = 0; i < BENCH_VALUES; i++)
+            {
+                s->values[i] = (u16)(rng() % s->capacity);
+            }
+
+            for (op = 0; op < sizeof(ops) / sizeof(ops[0]); op++)
+            {
+                if (!selected(ops[op].name, argc, argv, first_op))
+                {
+                    continue;
+                }
+
+                c.op = ops[op].name;
+                c.capacity = s->capacity;
+                c.density = densities[den];
+                c.words = ops[op].per_value ? 1 : s->base->buf_len;
+                c.setup = ops[op].setup;
+                c.run = ops[op].run;
+                c.ctx = s;
+
+                bench_run(&c, &result);
+                bench_report(stdout, &c, &result, json, first);
+                fflush(stdout);
+                first = false;
+            }
+
+            bitmap_destroy(s->base);
+            bitmap_destroy(s->other);
+            bitmap_destroy(s->work);
+            free(s->str);
+            s->work = NULL;
+        }
+    }
+
+    bench_report_end(stdout, json);
+    bench_perf_close();
+    free(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,423 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+
+/*
+ * Microbenchmark harness for the bench programs. A case is an untimed setup and a timed run
+ * of some iterations of one operation:
+ *
+ *     struct bench_case c = {"or", 65535, 0.5, 2048, setup_or, run_or, &ctx};
+ *     bench_run(&c, &result);
+ *     bench_report(stdout, &c, &result, json, true);
+ *
+ * The warmup repetitions also scale the iterations until a repetition takes BENCH_REP_NS, so
+ * the clock is read far less often than the operation runs. Times are per iteration, over
+ * BENCH_REPS repetitions, as the minimum, median, 90th and 99th percentile and maximum.
+ *
+ * After bench_perf_open, the measured repetitions also count cycles, instructions, cache
+ * misses and branch misses of the process in user space with perf_event_open, reported as
+ * IPC and misses per word. Without a PMU, as in most VMs, or with perf_event_paranoid
+ * above 2, bench_perf_open fails and the results have times only.
+ */
+
+#define BENCH_WARMUP 5
+#define BENCH_REPS 101
+#define BENCH_REP_NS 100000.0    /* Shortest repetition */
+#define BENCH_ITERS_MAX (1 << 24) /* Longest repetition, in iterations */
+
+enum bench_event
+{
+    BENCH_CYCLES, /* Leads the group, the others are read with it */
+    BENCH_INSTRUCTIONS,
+    BENCH_CACHE_MISSES,
+    BENCH_BRANCH_MISSES,
+    BENCH_EVENTS,
+};
+
+struct bench_case
+{
+    const char *op;
+    u32 capacity;
+    double density;                    /* Fraction of the bits set in the input */
+    double words;                      /* Words processed per iteration */
+    void (*setup)(void *ctx);          /* Untimed, before every repetition, may be NULL */
+    void (*run)(void *ctx, u32 iters); /* The measured operation, iters times */
+    void *ctx;
+};
+
+struct bench_result
+{
+    u32 iters; /* Iterations per repetition */
+    double min_ns;
+    double median_ns;
+    double p90_ns;
+    double p99_ns;
+    double max_ns;
+    bool counted;                /* events holds counts, bench_perf_open succeeded */
+    double events[BENCH_EVENTS]; /* Mean count per iteration, by enum bench_event */
+};
+
+/* The counter group, shared by every case of a program */
+static int bench_perf_fds[BENCH_EVENTS] = {-1, -1, -1, -1};
+
+/*****************************************************************************
+ *
+ *   Name:       bench_perf_close
+ *
+ *   Input:      None
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Stop counting, later cases are timed only
+ ******************************************************************************/
+static inline void bench_perf_close(void)
+{
+    u32 i = 0;
+
+    for (i = 0; i < BENCH_EVENTS; i++)
+    {
+        if (bench_perf_fds[i] >= 0)
+        {
+            close(bench_perf_fds[i]);
+            bench_perf_fds[i] = -1;
+        }
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_perf_open
+ *
+ *   Input:      None
+ *   Return:     Success     true, the measured repetitions are counted
+ *               Failed      false, the counters are not available
+ *   Description            Open the hardware counters as one group
+ ******************************************************************************/
+static inline bool bench_perf_open(void)
+{
+    static const uint64_t configs[BENCH_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    struct perf_event_attr attr;
+    u32 i = 0;
+
+    for (i = 0; i < BENCH_EVENTS; i++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = (i == BENCH_CYCLES); /* The leader starts and stops the group */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        bench_perf_fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                                         (i == BENCH_CYCLES) ? -1 : bench_perf_fds[BENCH_CYCLES],
+                                         0);
+
+        if (bench_perf_fds[i] < 0)
+        {
+            bench_perf_close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_perf_read
+ *
+ *   Input:      events      Gets the counts added, by enum bench_event
+ *   Return:     Success     true
+ *               Failed      false, the group was never scheduled
+ *   Description            Read the group, scaled up when it shared the PMU with others
+ ******************************************************************************/
+static inline bool bench_perf_read(double *events)
+{
+    uint64_t data[3 + BENCH_EVENTS]; /* nr, time enabled, time running, the values */
+    double scale = 1;
+    u32 i = 0;
+
+    if (read(bench_perf_fds[BENCH_CYCLES], data, sizeof(data)) != (ssize_t)sizeof(data) ||
+        data[0] != BENCH_EVENTS || data[2] == 0)
+    {
+        return false;
+    }
+
+    scale = (double)data[1] / (double)data[2];
+
+    for (i = 0; i < BENCH_EVENTS; i++)
+    {
+        events[i] += (double)data[3 + i] * scale;
+    }
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_now_ns
+ *
+ *   Input:      None
+ *   Return:     Success     A monotonic time in nanoseconds
+ *               Failed      None
+ *   Description            Clock of the measurements
+ ******************************************************************************/
+static inline double bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_cmp
+ *
+ *   Input:      a           A double
+ *               b           A double
+ *   Return:     Success     <0, 0 or >0 like strcmp
+ *               Failed      None
+ *   Description            qsort comparison of the repetition times
+ ******************************************************************************/
+static inline int bench_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_rep
+ *
+ *   Input:      c           A case
+ *               iters       Iterations to run
+ *               events      Gets the counts of the iterations added, NULL to not count
+ *   Return:     Success     Nanoseconds the iterations took
+ *               Failed      None
+ *   Description            Set up and time one repetition
+ ******************************************************************************/
+static inline double bench_rep(const struct bench_case *c, u32 iters, double *events)
+{
+    double start = 0;
+    double elapsed = 0;
+    bool counting = (events != NULL && bench_perf_fds[BENCH_CYCLES] >= 0);
+
+    if (c->setup != NULL)
+    {
+        c->setup(c->ctx);
+    }
+
+    if (counting)
+    {
+        ioctl(bench_perf_fds[BENCH_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(bench_perf_fds[BENCH_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    start = bench_now_ns();
+    c->run(c->ctx, iters);
+    elapsed = bench_now_ns() - start;
+
+    if (counting)
+    {
+        ioctl(bench_perf_fds[BENCH_CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        if (!bench_perf_read(events))
+        {
+            bench_perf_close();
+        }
+    }
+
+    return elapsed;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_run
+ *
+ *   Input:      c           A case
+ *               result      Gets the iterations and the times per iteration
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Warm up, scale the iterations, and measure the repetitions
+ ******************************************************************************/
+static inline void bench_run(const struct bench_case *c, struct bench_result *result)
+{
+    double samples[BENCH_REPS];
+    double elapsed = 0;
+    u32 iters = 1;
+    u32 i = 0;
+
+    for (i = 0; i < BENCH_WARMUP; i++)
+    {
+        elapsed = bench_rep(c, iters, NULL);
+
+        while (elapsed < BENCH_REP_NS && iters < BENCH_ITERS_MAX)
+        {
+            iters *= 2;
+            elapsed = bench_rep(c, iters, NULL);
+        }
+    }
+
+    memset(result->events, 0, sizeof(result->events));
+
+    for (i = 0; i < BENCH_REPS; i++)
+    {
+        samples[i] = bench_rep(c, iters, result->events) / iters;
+    }
+
+    /* A failed read closes the group, the counts are then incomplete */
+    result->counted = (bench_perf_fds[BENCH_CYCLES] >= 0);
+
+    for (i = 0; i < BENCH_EVENTS; i++)
+    {
+        result->events[i] /= (double)iters * BENCH_REPS;
+    }
+
+    qsort(samples, BENCH_REPS, sizeof(double), bench_cmp);
+
+    /* Nearest rank percentiles */
+    result->iters = iters;
+    result->min_ns = samples[0];
+    result->median_ns = samples[BENCH_REPS / 2];
+    result->p90_ns = samples[(BENCH_REPS * 90 + 99) / 100 - 1];
+    result->p99_ns = samples[(BENCH_REPS * 99 + 99) / 100 - 1];
+    result->max_ns = samples[BENCH_REPS - 1];
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_report_begin
+ *
+ *   Input:      out         Where the report goes
+ *               json        JSON instead of a table
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Start a report, before the first bench_report
+ ******************************************************************************/
+static inline void bench_report_begin(FILE *out, bool json)
+{
+    if (json)
+    {
+        fprintf(out, "{\"reps\": %d, \"results\": [\n", BENCH_REPS);
+    }
+    else
+    {
+        fprintf(out, "%-8s %8s %9s %10s %12s %12s %12s %10s", "op", "capacity", "density",
+                "iters", "median ns", "p90 ns", "p99 ns", "ns/word");
+
+        if (bench_perf_fds[BENCH_CYCLES] >= 0)
+        {
+            fprintf(out, " %6s %10s %10s", "IPC", "cmiss/word", "bmiss/word");
+        }
+
+        fprintf(out, "\n");
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_report
+ *
+ *   Input:      out         Where the report goes
+ *               c           The case
+ *               result      Its result
+ *               json        JSON instead of a table
+ *               first       The first case of the report, JSON needs no separator
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Report one case
+ ******************************************************************************/
+static inline void bench_report(FILE *out, const struct bench_case *c,
+                                const struct bench_result *result, bool json, bool first)
+{
+    const double *events = result->events;
+
+    if (json)
+    {
+        fprintf(out,
+                "%s  {\"op\": \"%s\", \"capacity\": %u, \"density\": %g, \"words\": %g, "
+                "\"iters\": %u, \"min_ns\": %.3f, \"median_ns\": %.3f, \"p90_ns\": %.3f, "
+                "\"p99_ns\": %.3f, \"max_ns\": %.3f",
+                first ? "" : ",\n", c->op, c->capacity, c->density, c->words, result->iters,
+                result->min_ns, result->median_ns, result->p90_ns, result->p99_ns,
+                result->max_ns);
+
+        if (result->counted)
+        {
+            fprintf(out,
+                    ", \"cycles\": %.1f, \"instructions\": %.1f, \"ipc\": %.3f, "
+                    "\"cache_misses_per_word\": %.4f, \"branch_misses_per_word\": %.4f",
+                    events[BENCH_CYCLES], events[BENCH_INSTRUCTIONS],
+                    events[BENCH_INSTRUCTIONS] / events[BENCH_CYCLES],
+                    events[BENCH_CACHE_MISSES] / c->words, events[BENCH_BRANCH_MISSES] / c->words);
+        }
+
+        fprintf(out, "}");
+    }
+    else
+    {
+        fprintf(out, "%-8s %8u %8.2f%% %10u %12.2f %12.2f %12.2f %10.3f", c->op, c->capacity,
+                c->density * 100, result->iters, result->median_ns, result->p90_ns,
+                result->p99_ns, result->median_ns / c->words);
+
+        if (result->counted)
+        {
+            fprintf(out, " %6.2f %10.4f %10.4f", events[BENCH_INSTRUCTIONS] / events[BENCH_CYCLES],
+                    events[BENCH_CACHE_MISSES] / c->words, events[BENCH_BRANCH_MISSES] / c->words);
+        }
+
+        fprintf(out, "\n");
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bench_report_end
+ *
+ *   Input:      out         Where the report goes
+ *               json        JSON instead of a table
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Finish a report
+ ******************************************************************************/
+static inline void bench_report_end(FILE *out, bool json)
+{
+    if (json)
+    {
+        fprintf(out, "\n]}\n");
+    }
+
+    return;
+}
+
+#endif /* __BENCH_H__ */
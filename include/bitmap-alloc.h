@@ -0,0 +1,138 @@
+#ifndef __BITMAP_ALLOC_H__
+#define __BITMAP_ALLOC_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+#ifndef BITMAP_BUF_ALIGN
+    #define BITMAP_BUF_ALIGN 64 /* Built-in allocators align every block to a cache line */
+#endif
+
+#ifndef BITMAP_HUGEPAGE_SIZE
+    #define BITMAP_HUGEPAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+#ifndef BITMAP_HUGEPAGE_THRESHOLD
+    #define BITMAP_HUGEPAGE_THRESHOLD BITMAP_HUGEPAGE_SIZE /* Blocks this big are mmap'ed */
+#endif
+
+struct bitmap_allocator
+{
+    void *(*alloc)(size_t size, void *ctx); /* Should align to BITMAP_BUF_ALIGN */
+    void (*free)(void *ptr, size_t size, void *ctx); /* size is the one passed to alloc */
+    void *ctx;
+    /* Optional, NULL makes bitmap_resize fall back to alloc, copy and free */
+    void *(*realloc)(void *ptr, size_t old_size, size_t new_size, void *ctx);
+};
+
+struct bitmap_pool;
+struct bitmap_arena;
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_set_allocator
+ *
+ *   Input:      allocator   The allocator used by every following bitmap_create,
+ *                           bitmap_clone and bitmap_parse_str, NULL restores malloc
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Change the allocator for new bitmaps. A bitmap remembers the
+ *                           allocator it was created with and is released through it
+ ******************************************************************************/
+void bitmap_set_allocator(const struct bitmap_allocator *allocator);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_get_allocator
+ *
+ *   Input:      None
+ *   Return:     Success     The allocator used for new bitmaps
+ *               Failed      None
+ *   Description            Get the allocator for new bitmaps
+ ******************************************************************************/
+const struct bitmap_allocator *bitmap_get_allocator(void);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_pool_create
+ *
+ *   Input:      None
+ *   Return:     Success     pool
+ *               Failed      NULL
+ *   Description            Create a pool that recycles freed bitmaps by size class,
+ *                           blocks are cut from small slabs
+ ******************************************************************************/
+struct bitmap_pool *bitmap_pool_create(void);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_pool_allocator
+ *
+ *   Input:      pool        A pool created by bitmap_pool_create
+ *   Return:     Success     An allocator that takes memory from the pool
+ *               Failed      NULL
+ *   Description            Get the allocator interface of a pool
+ ******************************************************************************/
+const struct bitmap_allocator *bitmap_pool_allocator(struct bitmap_pool *pool);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_pool_destroy
+ *
+ *   Input:      pool        A pool that will be destroyed
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Release all the memory of the pool, every bitmap created
+ *                           from it becomes invalid
+ ******************************************************************************/
+void bitmap_pool_destroy(struct bitmap_pool *pool);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_arena_create
+ *
+ *   Input:      chunk_size  Size of the memory chunks the arena allocates from,
+ *                           0 for the default
+ *   Return:     Success     arena
+ *               Failed      NULL
+ *   Description            Create an arena for temporary bitmaps
+ ******************************************************************************/
+struct bitmap_arena *bitmap_arena_create(size_t chunk_size);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_arena_allocator
+ *
+ *   Input:      arena       An arena created by bitmap_arena_create
+ *   Return:     Success     An allocator that takes memory from the arena
+ *               Failed      NULL
+ *   Description            Get the allocator interface of an arena, freeing through it
+ *                           does nothing until the arena is reset
+ ******************************************************************************/
+const struct bitmap_allocator *bitmap_arena_allocator(struct bitmap_arena *arena);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_arena_reset
+ *
+ *   Input:      arena       An arena that will be reset
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Free all bitmaps created from the arena at once, the first
+ *                           chunk is kept for reuse
+ ******************************************************************************/
+void bitmap_arena_reset(struct bitmap_arena *arena);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_arena_destroy
+ *
+ *   Input:      arena       An arena that will be destroyed
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Release all the memory of the arena
+ ******************************************************************************/
+void bitmap_arena_destroy(struct bitmap_arena *arena);
+
+#endif /* __BITMAP_ALLOC_H__ */
@@ -0,0 +1,52 @@
+#ifndef __BITMAP_DIFF_H__
+#define __BITMAP_DIFF_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+/*
+ * Patches that turn one bitmap into another:
+ *
+ *     size = bitmap_diff(yesterday, today, buf, sizeof(buf));
+ *     bitmap_patch(copy_of_yesterday, buf, size);
+ *
+ * A patch is the XOR of the two word arrays, stored as the runs of changed words or as the
+ * list of flipped bits, whichever is smaller: a few scattered changes cost 2 bytes each, a
+ * rewritten range 4 bytes per word. The capacities of both bitmaps are in the patch, so it
+ * also carries a resize and only applies to a bitmap of the capacity it was made from.
+ *
+ * Words that did not change are skipped 4 at a time with SSE2 compares where available.
+ * Patches are little endian and can be stored or sent as they are.
+ */
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_diff
+ *
+ *   Input:      from        The old bitmap
+ *               to          The new bitmap, its capacity may differ
+ *               buf         Gets the patch, may be NULL when len is 0
+ *               len         Size of buf
+ *   Return:     Success     Size of the patch. Nothing was written when the result is more
+ *                           than len
+ *               Failed      0
+ *   Description            Encode the changes from one bitmap to another
+ ******************************************************************************/
+size_t bitmap_diff(const struct bitmap *from, const struct bitmap *to, u8 *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_patch
+ *
+ *   Input:      bm          A bitmap with the content and capacity of from
+ *               patch       A patch from bitmap_diff
+ *               len         Size of the patch
+ *   Return:     Success     true, bm now equals to, unless it did not equal from
+ *               Failed      false, bm is unchanged: the patch is invalid, is for another
+ *                           capacity, or needs a resize bm can not do
+ *   Description            Apply a patch
+ ******************************************************************************/
+bool bitmap_patch(struct bitmap *bm, const u8 *patch, size_t len);
+
+#endif /* __BITMAP_DIFF_H__ */
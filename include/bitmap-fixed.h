@@ -0,0 +1,132 @@
+#ifndef __BITMAP_FIXED_H__
+#define __BITMAP_FIXED_H__
+
+#include "bitmap.h"
+
+/*
+ * Fixed size bitmaps, specialized at compile time:
+ *
+ *     BITMAP_DEFINE(cpuset, 256);
+ *
+ *     struct cpuset set = {0};
+ *     cpuset_add(&set, 17);
+ *
+ * defines struct cpuset, a plain word array that can live on the stack, and
+ *
+ *     void cpuset_clear(struct cpuset *bm);
+ *     void cpuset_add(struct cpuset *bm, u32 value);
+ *     void cpuset_del(struct cpuset *bm, u32 value);
+ *     bool cpuset_test(const struct cpuset *bm, u32 value);
+ *     void cpuset_or(struct cpuset *bm_store, const struct cpuset *bm);
+ *     void cpuset_and(struct cpuset *bm_store, const struct cpuset *bm);
+ *     void cpuset_not(struct cpuset *bm);
+ *     u32  cpuset_count(const struct cpuset *bm);
+ *     bool cpuset_to_bitmap(struct cpuset *fixed, struct bitmap *bm);
+ *
+ * The word count and the tail mask are constants, so the loops unroll completely and no
+ * function branches. There is no summary and no bitmap_check: values must be below NBITS,
+ * which is only asserted in DEBUG builds. cpuset_to_bitmap wraps the words with
+ * bitmap_init_external to reuse the rest of the API, like bitmap_print or the views.
+ */
+
+#define BITMAP_FIXED_WORD_BITS 32
+#define BITMAP_FIXED_WORDS(nbits) (((nbits) + BITMAP_FIXED_WORD_BITS - 1) / BITMAP_FIXED_WORD_BITS)
+#define BITMAP_FIXED_TAIL_MASK(nbits)                                                              \
+    (((nbits) % BITMAP_FIXED_WORD_BITS) ? ((1U << ((nbits) % BITMAP_FIXED_WORD_BITS)) - 1)         \
+                                        : UINT32_MAX)
+#define BITMAP_FIXED_UNROLL _Pragma("GCC unroll 2048")
+
+#define BITMAP_DEFINE(name, NBITS)                                                                 \
+    _Static_assert((NBITS) > 0 && (NBITS) <= UINT16_MAX, #name ": NBITS out of range");            \
+                                                                                                   \
+    struct name                                                                                    \
+    {                                                                                              \
+        u32 buf[BITMAP_FIXED_WORDS(NBITS)];                                                        \
+    };                                                                                             \
+                                                                                                   \
+    static inline void name##_clear(struct name *bm)                                               \
+    {                                                                                              \
+        u32 i = 0;                                                                                 \
+                                                                                                   \
+        BITMAP_FIXED_UNROLL                                                                        \
+        for (i = 0; i < BITMAP_FIXED_WORDS(NBITS); i++)                                            \
+        {                                                                                          \
+            bm->buf[i] = 0;                                                                        \
+        }                                                                                          \
+    }                                                                                              \
+                                                                                                   \
+    static inline void name##_add(struct name *bm, u32 value)                                      \
+    {                                                                                              \
+        BITMAP_ASSERT(value < (NBITS));                                                            \
+        bm->buf[value / BITMAP_FIXED_WORD_BITS] |= 1U << (value % BITMAP_FIXED_WORD_BITS);         \
+    }                                                                                              \
+                                                                                                   \
+    static inline void name##_del(struct name *bm, u32 value)                                      \
+    {                                                                                              \
+        BITMAP_ASSERT(value < (NBITS));                                                            \
+        bm->buf[value / BITMAP_FIXED_WORD_BITS] &= ~(1U << (value % BITMAP_FIXED_WORD_BITS));      \
+    }                                                                                              \
+                                                                                                   \
+    static inline bool name##_test(const struct name *bm, u32 value)                               \
+    {                                                                                              \
+        BITMAP_ASSERT(value < (NBITS));                                                            \
+        return (bm->buf[value / BITMAP_FIXED_WORD_BITS] >> (value % BITMAP_FIXED_WORD_BITS)) & 1U; \
+    }                                                                                              \
+                                                                                                   \
+    static inline void name##_or(struct name *bm_store, const struct name *bm)                     \
+    {                                                                                              \
+        u32 i = 0;                                                                                 \
+                                                                                                   \
+        BITMAP_FIXED_UNROLL                                                                        \
+        for (i = 0; i < BITMAP_FIXED_WORDS(NBITS); i++)                                            \
+        {                                                                                          \
+            bm_store->buf[i] |= bm->buf[i];                                                        \
+        }                                                                                          \
+    }                                                                                              \
+                                                                                                   \
+    static inline void name##_and(struct name *bm_store, const struct name *bm)                    \
+    {                                                                                              \
+        u32 i = 0;                                                                                 \
+                                                                                                   \
+        BITMAP_FIXED_UNROLL                                                                        \
+        for (i = 0; i < BITMAP_FIXED_WORDS(NBITS); i++)                                            \
+        {                                                                                          \
+            bm_store->buf[i] &= bm->buf[i];                                                        \
+        }                                                                                          \
+    }                                                                                              \
+                                                                                                   \
+    static inline void name##_not(struct name *bm)                                                 \
+    {                                                                                              \
+        u32 i = 0;                                                                                 \
+                                                                                                   \
+        BITMAP_FIXED_UNROLL                                                                        \
+        for (i = 0; i < BITMAP_FIXED_WORDS(NBITS); i++)                                            \
+        {                                                                                          \
+            bm->buf[i] = ~bm->buf[i];                                                              \
+        }                                                                                          \
+                                                                                                   \
+        bm->buf[BITMAP_FIXED_WORDS(NBITS) - 1] &= BITMAP_FIXED_TAIL_MASK(NBITS);                   \
+    }                                                                                              \
+                                                                                                   \
+    static inline u32 name##_count(const struct name *bm)                                          \
+    {                                                                                              \
+        u32 i = 0;                                                                                 \
+        u32 count = 0;                                                                             \
+                                                                                                   \
+        BITMAP_FIXED_UNROLL                                                                        \
+        for (i = 0; i < BITMAP_FIXED_WORDS(NBITS); i++)                                            \
+        {                                                                                          \
+            count += (u32)__builtin_popcount(bm->buf[i]);                                          \
+        }                                                                                          \
+                                                                                                   \
+        return count;                                                                              \
+    }                                                                                              \
+                                                                                                   \
+    static inline bool name##_to_bitmap(struct name *fixed, struct bitmap *bm)                     \
+    {                                                                                              \
+        return bitmap_init_external(bm, fixed->buf, (u16)(NBITS));                                 \
+    }                                                                                              \
+                                                                                                   \
+    struct name
+
+#endif /* __BITMAP_FIXED_H__ */
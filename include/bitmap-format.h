@@ -0,0 +1,77 @@
+#ifndef __BITMAP_FORMAT_H__
+#define __BITMAP_FORMAT_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+#define BITMAP_FORMAT_CHUNK_MIN 16 /* Fits the longest entry, ",65533-65534", and a '\0' */
+
+/* Position of an incremental bitmap_format_next */
+struct bitmap_format_state
+{
+    u32 next;     /* First value that has not been formatted */
+    bool started; /* An entry was written, the next one needs a separator */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_format
+ *
+ *   Input:      bm          A bitmap that will be formatted
+ *               buf         Gets the range list and a '\0', may be NULL when len is 0
+ *               len         Size of buf
+ *   Return:     Success     Length of the whole range list, without the '\0'. Like
+ *                           snprintf, the output was cut when the result is len or more
+ *               Failed      0, buf gets an empty string
+ *   Description            Format a bitmap as a range list like "1-3,5,7", the syntax read
+ *                           by bitmap_parse_str. An empty bitmap gives an empty string
+ ******************************************************************************/
+size_t bitmap_format(const struct bitmap *bm, char *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_format_init
+ *
+ *   Input:      state       The state that will be initialized
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Start an incremental format at the first value
+ ******************************************************************************/
+void bitmap_format_init(struct bitmap_format_state *state);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_format_next
+ *
+ *   Input:      bm          A bitmap that will be formatted
+ *               state       Position in bm, from bitmap_format_init
+ *               buf         Gets the next whole entries of the range list and a '\0'
+ *               len         Size of buf, at least BITMAP_FORMAT_CHUNK_MIN
+ *   Return:     Success     Number of bytes written, without the '\0'
+ *               Failed      0, the whole list was written or the input is invalid
+ *   Description            Format the next piece of a range list, so a huge bitmap can go
+ *                           out through a small buffer. Entries are never cut, pasting the
+ *                           pieces together gives the output of bitmap_format
+ ******************************************************************************/
+size_t bitmap_format_next(const struct bitmap *bm, struct bitmap_format_state *state, char *buf,
+                          size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_format_hex
+ *
+ *   Input:      bm          A bitmap that will be formatted
+ *               buf         Gets the hex mask and a '\0', may be NULL when len is 0
+ *               len         Size of buf
+ *   Return:     Success     Length of the whole hex mask, without the '\0'. Like snprintf,
+ *                           the output was cut when the result is len or more
+ *               Failed      0, buf gets an empty string
+ *   Description            Format a bitmap as a kernel cpumask style hex mask, the format
+ *                           read by bitmap_parse_hex: one group of 8 hex digits per word of
+ *                           buf, the most significant first. The first group only has the
+ *                           digits needed for the capacity
+ ******************************************************************************/
+size_t bitmap_format_hex(const struct bitmap *bm, char *buf, size_t len);
+
+#endif /* __BITMAP_FORMAT_H__ */
@@ -0,0 +1,109 @@
+#ifndef __BITMAP_IO_H__
+#define __BITMAP_IO_H__
+
+#include <stdint.h>
+
+#include "bitmap.h"
+
+/*
+ * Binary file format of a bitmap, little endian:
+ *
+ *     struct bitmap_file_header   64 bytes, see below
+ *     u32 words[buf_len]          buf of the bitmap, bits past max_value are 0
+ *
+ * The header carries the summary, so loading does not scan the words. Readers reject a
+ * newer version, a different word size, or a checksum that does not match. A file marked
+ * dirty by a mapped writer (see bitmap-mmap.h) has its summary rebuilt from the words instead.
+ */
+
+#define BITMAP_FILE_MAGIC 0x50414d42 /* "BMAP" */
+#define BITMAP_FILE_VERSION 1
+#define BITMAP_FILE_HEADER_SIZE 64
+#define BITMAP_FILE_FLAG_DIRTY 0x8000 /* A writer has the file mapped, summary and words_crc
+                                         are stale */
+
+struct bitmap_file_header
+{
+    u32 magic;       /* BITMAP_FILE_MAGIC */
+    u16 version;     /* BITMAP_FILE_VERSION */
+    u16 header_size; /* BITMAP_FILE_HEADER_SIZE, the words start here */
+    u16 word_size;   /* sizeof(u32) */
+    u16 max_value;   /* Capacity */
+    u16 numbers;     /* Cardinality */
+    u16 first_value; /* Summary, valid when numbers is not 0 */
+    u16 last_value;  /* Summary, valid when numbers is not 0 */
+    u16 buf_len;     /* Number of words after the header */
+    u16 flags;       /* BITMAP_FLAG_AUTOGROW, BITMAP_FILE_FLAG_DIRTY */
+    u16 reserved0;   /* 0 */
+    u32 words_crc;   /* CRC32C of the words */
+    u8 reserved[32]; /* 0 */
+    u32 header_crc;  /* CRC32C of the header up to this field */
+};
+
+_Static_assert(sizeof(struct bitmap_file_header) == BITMAP_FILE_HEADER_SIZE,
+               "bitmap_file_header must be 64 bytes");
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_save
+ *
+ *   Input:      bm          A bitmap that will be saved
+ *               fd          A file descriptor open for writing
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Write a bitmap in the binary format, the header and the words
+ *                           go out in a single writev
+ ******************************************************************************/
+bool bitmap_save(const struct bitmap *bm, int fd);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_load
+ *
+ *   Input:      fd          A file descriptor at the start of a saved bitmap
+ *   Return:     Success     A bitmap that stores the data from the file descriptor
+ *               Failed      NULL, the data is not a valid bitmap file
+ *   Description            Read a bitmap in the binary format, the words come in with a
+ *                           single read and the summary comes from the header
+ ******************************************************************************/
+struct bitmap *bitmap_load(int fd);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_save_file
+ *
+ *   Input:      bm          A bitmap that will be saved
+ *               path        The file, replaced if it exists
+ *   Return:     Success     true
+ *               Failed      false, the old file is left as it was, or the new one is in
+ *                           place but its directory could not be synced
+ *   Description            bitmap_save to a temporary file that is synced and renamed over
+ *                           path, then the directory is synced: a crash never leaves half
+ *                           a bitmap, and after true the new one survives a crash
+ ******************************************************************************/
+bool bitmap_save_file(const struct bitmap *bm, const char *path);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_load_file
+ *
+ *   Input:      path        A file written by bitmap_save_file
+ *   Return:     Success     A bitmap that stores the data from the file
+ *               Failed      NULL
+ *   Description            bitmap_load from a file
+ ******************************************************************************/
+struct bitmap *bitmap_load_file(const char *path);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_file_header_check
+ *
+ *   Input:      header      A header read from a file
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Check the magic, version, word size, sizes and header checksum,
+ *                           the words are not checked
+ ******************************************************************************/
+bool bitmap_file_header_check(const struct bitmap_file_header *header);
+
+#endif /* __BITMAP_IO_H__ */
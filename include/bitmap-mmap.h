@@ -0,0 +1,98 @@
+#ifndef __BITMAP_MMAP_H__
+#define __BITMAP_MMAP_H__
+
+#include <stddef.h>
+
+#include "bitmap-io.h"
+#include "bitmap.h"
+
+/*
+ * Bitmaps used in place in a file written by bitmap_save_file:
+ *
+ *     struct bitmap_mapped mapped;
+ *
+ *     bitmap_map_file(&mapped, "users.bm", BITMAP_MAP_WRITE);
+ *     bitmap_add_value(&mapped.bm, 42);
+ *     bitmap_map_sync(&mapped);
+ *     bitmap_unmap(&mapped);
+ *
+ * mapped.bm works with the rest of the API, its buf points into the mapping, so mapping
+ * costs the same for any size and pages come in as they are touched. A read-only mapping
+ * makes every function that changes the bitmap fail. A writable mapping is MAP_SHARED:
+ * changes reach the file as the kernel writes pages back, and bitmap_map_sync is a
+ * checkpoint that stores the summary and checksum and waits for the disk.
+ *
+ * While a writer has the file mapped, the header is marked dirty. Opening a dirty file,
+ * after a crash or next to a live writer, rebuilds the summary from the words. Only one
+ * writer may map a file at a time.
+ *
+ * A reader next to a live writer sees the writer's words as they change, but the count and
+ * bounds in mapped.bm stay as they were when it mapped the file. bitmap_map_refresh rebuilds
+ * them from the words before bitmap_print, bitmap_format or anything else that uses them.
+ */
+
+#define BITMAP_MAP_READONLY 0x0000 /* Map for reading, the bitmap is BITMAP_FLAG_READONLY */
+#define BITMAP_MAP_WRITE 0x0001    /* Map for reading and writing */
+#define BITMAP_MAP_VERIFY 0x0002   /* Check the words against the checksum, reads them all */
+
+struct bitmap_mapped
+{
+    struct bitmap bm;                  /* The bitmap, buf points into the mapping */
+    struct bitmap_file_header *header; /* Start of the mapping */
+    size_t map_len;
+    int fd;
+    int mode; /* BITMAP_MAP_* */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_map_file
+ *
+ *   Input:      mapped      Caller owned memory for the mapping
+ *               path        A file written by bitmap_save_file
+ *               mode        BITMAP_MAP_READONLY or BITMAP_MAP_WRITE, optionally with
+ *                           BITMAP_MAP_VERIFY
+ *   Return:     Success     true, use &mapped->bm as a bitmap
+ *               Failed      false
+ *   Description            Map a saved bitmap and use it in place. The summary comes from
+ *                           the header unless the file is dirty
+ ******************************************************************************/
+bool bitmap_map_file(struct bitmap_mapped *mapped, const char *path, int mode);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_map_sync
+ *
+ *   Input:      mapped      A writable mapping
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Checkpoint: flush the words, then store the summary and the
+ *                           checksum in the header and flush it. The file is clean until the
+ *                           next change
+ ******************************************************************************/
+bool bitmap_map_sync(struct bitmap_mapped *mapped);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_map_refresh
+ *
+ *   Input:      mapped      A mapping from bitmap_map_file
+ *   Return:     Success     &mapped->bm with a summary scanned from the words now
+ *               Failed      NULL
+ *   Description            Catch up with the changes of another process that writes the
+ *                           file. Changes made during the scan can be seen or not
+ ******************************************************************************/
+struct bitmap *bitmap_map_refresh(struct bitmap_mapped *mapped);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_unmap
+ *
+ *   Input:      mapped      A mapping from bitmap_map_file
+ *   Return:     Success     true
+ *               Failed      false, the last checkpoint failed, the file stays dirty
+ *   Description            Checkpoint a writable mapping, then unmap and close the file
+ ******************************************************************************/
+bool bitmap_unmap(struct bitmap_mapped *mapped);
+
+#endif /* __BITMAP_MMAP_H__ */
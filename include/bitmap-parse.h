@@ -0,0 +1,79 @@
+#ifndef __BITMAP_PARSE_H__
+#define __BITMAP_PARSE_H__
+
+#include <stdio.h>
+
+#include "bitmap.h"
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_parse_stream
+ *
+ *   Input:      fp          A file holding a range list like "1-3,5,7", read to the end
+ *   Return:     Success     A bitmap that stores the data from the file
+ *               Failed      NULL
+ *   Description            Parse a range list of any size piece by piece, the syntax of
+ *                           bitmap_parse_str plus line breaks as spaces. Memory is one
+ *                           read buffer plus the bitmap, which grows with the values
+ ******************************************************************************/
+struct bitmap *bitmap_parse_stream(FILE *fp);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_parse_fd
+ *
+ *   Input:      fd          A file descriptor holding a range list, read to the end
+ *   Return:     Success     A bitmap that stores the data from the file descriptor
+ *               Failed      NULL
+ *   Description            bitmap_parse_stream for a file descriptor, also works on pipes
+ *                           and sockets
+ ******************************************************************************/
+struct bitmap *bitmap_parse_fd(int fd);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_parse_parallel
+ *
+ *   Input:      str         A range list like "1-3,5,7", it does not need a '\0'
+ *               len         Number of bytes in str
+ *               threads     Number of threads, 0 for one per online CPU
+ *               error_offset Gets the offset of the first invalid byte, may be NULL
+ *   Return:     Success     A bitmap that stores the data from str
+ *               Failed      NULL
+ *   Description            bitmap_parse_str for huge inputs: the input is split at entry
+ *                           separators, each thread parses its piece into a partial
+ *                           bitmap and the parts are ORed together. Small inputs use
+ *                           fewer threads
+ ******************************************************************************/
+struct bitmap *bitmap_parse_parallel(const u8 *str, size_t len, u32 threads, size_t *error_offset);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_parse_file
+ *
+ *   Input:      path        A file holding a range list
+ *               threads     Number of threads, 0 for one per online CPU
+ *               error_offset Gets the offset of the first invalid byte, may be NULL
+ *   Return:     Success     A bitmap that stores the data from the file
+ *               Failed      NULL
+ *   Description            Map a file and parse it with bitmap_parse_parallel, line breaks
+ *                           count as spaces like in bitmap_parse_stream
+ ******************************************************************************/
+struct bitmap *bitmap_parse_file(const char *path, u32 threads, size_t *error_offset);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_parse_hex
+ *
+ *   Input:      str         A hex mask like "ff,ffffffff,00000001", it does not need a '\0'
+ *               len         Number of bytes in str
+ *   Return:     Success     A bitmap that stores the data from str
+ *               Failed      NULL
+ *   Description            Parse a kernel cpumask style hex mask: comma separated groups
+ *                           of up to 8 hex digits, the most significant group first. Every
+ *                           group is one word of buf. The capacity is the width of the mask,
+ *                           4 bits per digit of the first group plus 32 per other group
+ ******************************************************************************/
+struct bitmap *bitmap_parse_hex(const u8 *str, size_t len);
+
+#endif /* __BITMAP_PARSE_H__ */
@@ -0,0 +1,136 @@
+#ifndef __BITMAP_REGISTRY_H__
+#define __BITMAP_REGISTRY_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+/*
+ * Bitmaps by name, in an open addressing hash table with linear probing:
+ *
+ *     struct bitmap_registry *registry = bitmap_registry_create();
+ *     bitmap_add_value(bitmap_registry_get(registry, "online", 256), 17);
+ *
+ * Lookups hash the name once and compare stored hashes before names, removal shifts the
+ * following entries back instead of leaving tombstones, so a long lived registry does not
+ * slow down. The registry owns its bitmaps: replacing or removing one destroys it, and so
+ * does bitmap_registry_destroy.
+ */
+
+#define BITMAP_REGISTRY_NAME_MAX 255 /* Longest name in bytes */
+
+struct bitmap_registry;
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_create
+ *
+ *   Input:      None
+ *   Return:     Success     An empty registry
+ *               Failed      NULL
+ *   Description            Create a registry
+ ******************************************************************************/
+struct bitmap_registry *bitmap_registry_create(void);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_destroy
+ *
+ *   Input:      registry    A registry, NULL is ignored
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Destroy a registry and every bitmap in it
+ ******************************************************************************/
+void bitmap_registry_destroy(struct bitmap_registry *registry);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_find
+ *
+ *   Input:      registry    A registry
+ *               name        Name of a bitmap
+ *   Return:     Success     The bitmap
+ *               Failed      NULL, there is no bitmap with that name
+ *   Description            Look up a bitmap
+ ******************************************************************************/
+struct bitmap *bitmap_registry_find(const struct bitmap_registry *registry, const char *name);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_get
+ *
+ *   Input:      registry    A registry
+ *               name        Name of a bitmap
+ *               capacity    Capacity of the bitmap when it has to be created
+ *   Return:     Success     The bitmap, created when there was none with that name
+ *               Failed      NULL
+ *   Description            Look up a bitmap, creating it on demand
+ ******************************************************************************/
+struct bitmap *bitmap_registry_get(struct bitmap_registry *registry, const char *name,
+                                   u16 capacity);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_set
+ *
+ *   Input:      registry    A registry
+ *               name        Name of a bitmap
+ *               bm          A bitmap from bitmap_create, bitmap_clone or bitmap_parse_str
+ *   Return:     Success     true, the registry owns bm and destroyed the bitmap it replaced
+ *               Failed      false, the caller still owns bm
+ *   Description            Add a bitmap under a name, replacing the one with that name
+ ******************************************************************************/
+bool bitmap_registry_set(struct bitmap_registry *registry, const char *name, struct bitmap *bm);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_remove
+ *
+ *   Input:      registry    A registry
+ *               name        Name of a bitmap
+ *   Return:     Success     true, the bitmap is destroyed
+ *               Failed      false, there is no bitmap with that name
+ *   Description            Remove a bitmap
+ ******************************************************************************/
+bool bitmap_registry_remove(struct bitmap_registry *registry, const char *name);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_count
+ *
+ *   Input:      registry    A registry
+ *   Return:     Success     Number of bitmaps
+ *               Failed      0
+ *   Description            Count the bitmaps of a registry
+ ******************************************************************************/
+u32 bitmap_registry_count(const struct bitmap_registry *registry);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_memory
+ *
+ *   Input:      registry    A registry
+ *   Return:     Success     Bytes used by the table, the names and the bitmaps
+ *               Failed      0
+ *   Description            Account the memory of a registry. Bitmaps can be resized behind
+ *                           the registry's back, so they are summed on every call
+ ******************************************************************************/
+size_t bitmap_registry_memory(const struct bitmap_registry *registry);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_registry_next
+ *
+ *   Input:      registry    A registry
+ *               iter        Position, set to 0 before the first call
+ *               name        Gets the name of the next bitmap, can be NULL
+ *               bm          Gets the next bitmap, can be NULL
+ *   Return:     Success     true
+ *               Failed      false, there are no more bitmaps
+ *   Description            Iterate over the bitmaps in no particular order. Adding or
+ *                           removing bitmaps during an iteration can skip or repeat some
+ ******************************************************************************/
+bool bitmap_registry_next(const struct bitmap_registry *registry, u32 *iter, const char **name,
+                          struct bitmap **bm);
+
+#endif /* __BITMAP_REGISTRY_H__ */
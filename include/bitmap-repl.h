@@ -0,0 +1,140 @@
+#ifndef __BITMAP_REPL_H__
+#define __BITMAP_REPL_H__
+
+#include <stddef.h>
+
+#include "bitmap-registry.h"
+#include "bitmap.h"
+
+/*
+ * Replication of the bitmaps of a registry to followers over a connected stream socket:
+ *
+ *     primary                                   follower
+ *     bitmap_add_value(bm, 17);
+ *     bitmap_repl_send_registry(repl, reg, 0);  bitmap_repl_poll(repl, -1);
+ *     bitmap_repl_poll(repl, 0);
+ *
+ * Every mutator marks the 64 byte blocks of words it changed in bm->dirty. A send turns the
+ * dirty blocks of a bitmap into one record and clears them, so a record carries the changes
+ * since the previous send, whatever their number. The follower copies the blocks into the
+ * bitmap of the same name, creating or resizing it to the capacity of the primary, and
+ * marks them dirty in turn, so a follower can be the primary of the next one.
+ *
+ * A record holds whole blocks rather than changed bits: applying one twice is harmless and
+ * the primary keeps no copy of what it sent. Records are checksummed with CRC32C. The dirty
+ * bits have one reader, so a primary replicates to one follower; chain followers to fan out.
+ * A new follower starts with a send of BITMAP_REPL_FULL. Removing a bitmap is not
+ * replicated.
+ *
+ * Followers acknowledge what they applied, once per poll; a primary polls between sends so
+ * the acknowledgments do not fill the socket. The lag of a follower is the time from the send
+ * of a record to its apply, measured with CLOCK_REALTIME, so across hosts it is only as good
+ * as their clock sync; the primary sees the round trip and the number of records in flight.
+ */
+
+#define BITMAP_REPL_FULL 0x0001 /* Send every block, not only the dirty ones */
+
+struct bitmap_repl_stats
+{
+    uint64_t records; /* Records sent by a primary, applied by a follower */
+    uint64_t blocks;  /* Blocks in those records */
+    uint64_t bytes;   /* Bytes of those records */
+    uint64_t seq;     /* Last record sent or applied */
+    uint64_t seq_ack; /* Primary: last record the follower acknowledged */
+    uint64_t lag_ns;  /* Primary: round trip of the last acknowledgment,
+                         follower: send to apply time of the last record */
+};
+
+struct bitmap_repl;
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_primary
+ *
+ *   Input:      fd          A connected stream socket to the follower, still owned by the
+ *                           caller
+ *   Return:     Success     The sending end of a replication stream
+ *               Failed      NULL
+ *   Description            Start replicating to a follower
+ ******************************************************************************/
+struct bitmap_repl *bitmap_repl_primary(int fd);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_follower
+ *
+ *   Input:      fd          A connected stream socket to the primary, still owned by the
+ *                           caller
+ *               registry    The registry the records are applied to
+ *   Return:     Success     The receiving end of a replication stream
+ *               Failed      NULL
+ *   Description            Start following a primary
+ ******************************************************************************/
+struct bitmap_repl *bitmap_repl_follower(int fd, struct bitmap_registry *registry);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_close
+ *
+ *   Input:      repl        A replication stream, NULL is ignored
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Free a replication stream, the socket is left open
+ ******************************************************************************/
+void bitmap_repl_close(struct bitmap_repl *repl);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_send
+ *
+ *   Input:      repl        A primary
+ *               name        Name of the bitmap on the follower
+ *               bm          The bitmap
+ *               flags       BITMAP_REPL_FULL or 0
+ *   Return:     Success     true, the dirty blocks were sent, or there were none
+ *               Failed      false, the stream is broken and the follower needs a full send
+ *                           on a new one
+ *   Description            Send the changes of a bitmap and clear its dirty blocks
+ ******************************************************************************/
+bool bitmap_repl_send(struct bitmap_repl *repl, const char *name, struct bitmap *bm, u32 flags);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_send_registry
+ *
+ *   Input:      repl        A primary
+ *               registry    The bitmaps to send
+ *               flags       BITMAP_REPL_FULL or 0
+ *   Return:     Success     true
+ *               Failed      false, see bitmap_repl_send
+ *   Description            bitmap_repl_send for every bitmap of a registry
+ ******************************************************************************/
+bool bitmap_repl_send_registry(struct bitmap_repl *repl, const struct bitmap_registry *registry,
+                               u32 flags);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_poll
+ *
+ *   Input:      repl        A primary or a follower
+ *               timeout_ms  Longest wait for input, 0 to not wait, -1 to wait forever
+ *   Return:     Success     true
+ *               Failed      false, the peer closed the stream or sent a bad record
+ *   Description            Read what arrived: a follower applies records and acknowledges
+ *                           them, a primary takes acknowledgments
+ ******************************************************************************/
+bool bitmap_repl_poll(struct bitmap_repl *repl, int timeout_ms);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_repl_get_stats
+ *
+ *   Input:      repl        A primary or a follower
+ *               stats       Gets the counters and the lag
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Read the counters of a replication stream
+ ******************************************************************************/
+void bitmap_repl_get_stats(const struct bitmap_repl *repl, struct bitmap_repl_stats *stats);
+
+#endif /* __BITMAP_REPL_H__ */
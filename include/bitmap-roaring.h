@@ -0,0 +1,49 @@
+#ifndef __BITMAP_ROARING_H__
+#define __BITMAP_ROARING_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+/*
+ * The portable serialization format of Roaring bitmaps, as read and written by CRoaring,
+ * Java RoaringBitmap and the other implementations. Our values fit in one container, the
+ * one with key 0: an array of sorted u16 values, 1024 u64 words, or a list of runs. The
+ * words of a bitmap container are the words of buf, so those convert with a memcpy.
+ */
+
+#define BITMAP_ROARING_COOKIE 12347       /* Some containers are runs */
+#define BITMAP_ROARING_COOKIE_NO_RUN 12346 /* Only array and bitmap containers */
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_read_roaring
+ *
+ *   Input:      buf         A serialized Roaring bitmap
+ *               len         Number of bytes in buf
+ *               capacity    Capacity of the new bitmap, 0 for the largest value + 1
+ *               consumed    Gets the number of bytes used, may be NULL
+ *   Return:     Success     A bitmap that stores the data from buf
+ *               Failed      NULL, the data is invalid, too short, or holds a value that does
+ *                           not fit
+ *   Description            Read the Roaring portable format. A Roaring bitmap with no values
+ *                           needs a capacity
+ ******************************************************************************/
+struct bitmap *bitmap_read_roaring(const u8 *buf, size_t len, u16 capacity, size_t *consumed);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_write_roaring
+ *
+ *   Input:      bm          A bitmap that will be written
+ *               buf         Gets the serialized bitmap, may be NULL when len is 0
+ *               len         Size of buf
+ *   Return:     Success     Size of the serialized bitmap. Nothing was written when the
+ *                           result is more than len
+ *               Failed      0
+ *   Description            Write the Roaring portable format. The container is an array, a
+ *                           bitmap or runs, whichever is smallest, like after runOptimize
+ ******************************************************************************/
+size_t bitmap_write_roaring(const struct bitmap *bm, u8 *buf, size_t len);
+
+#endif /* __BITMAP_ROARING_H__ */
@@ -0,0 +1,162 @@
+#ifndef __BITMAP_SHM_H__
+#define __BITMAP_SHM_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+/*
+ * Bitmaps in POSIX shared memory, used by several processes at the same time:
+ *
+ *     struct bitmap_shm shm;
+ *
+ *     bitmap_shm_create(&shm, "/online", 4096);    one process
+ *     bitmap_shm_open(&shm, "/online");            every other process
+ *     bitmap_shm_add(&shm, 17);
+ *     bitmap_shm_test(&shm, 17);
+ *
+ * The segment holds struct bitmap_shm_header and the words at words_offset. It holds no
+ * pointers, so every process can map it at a different address; struct bitmap_shm is the
+ * process local part, with a struct bitmap whose buf points into the mapping.
+ *
+ * bitmap_shm_add and bitmap_shm_del change a word with one atomic read-modify-write and keep
+ * the cardinality in the header exact. first_value and last_value in the header are bounds:
+ * no value is below first_value or above last_value, but a delete does not move them.
+ * bitmap_shm_bitmap takes a snapshot of the summary for the rest of the API, which sees the
+ * bitmap as BITMAP_FLAG_READONLY: the regular mutators are not atomic.
+ */
+
+#define BITMAP_SHM_MAGIC 0x4d485342 /* "BSHM" */
+#define BITMAP_SHM_VERSION 1
+#define BITMAP_SHM_HEADER_SIZE 64
+
+/* Start of the segment. numbers, first_value and last_value are only accessed atomically */
+struct bitmap_shm_header
+{
+    u32 magic;        /* BITMAP_SHM_MAGIC, stored last by the creator */
+    u16 version;      /* BITMAP_SHM_VERSION */
+    u16 max_value;    /* Capacity */
+    u16 buf_len;      /* Number of words */
+    u16 reserved0;    /* 0 */
+    u32 words_offset; /* The words start this many bytes after the header */
+    u32 numbers;      /* Cardinality */
+    u16 first_value;  /* No value is below, UINT16_MAX while the bitmap was always empty */
+    u16 last_value;   /* No value is above */
+    u8 reserved[40];  /* 0 */
+};
+
+struct bitmap_shm
+{
+    struct bitmap bm;                 /* Read-only view, buf points into the mapping */
+    struct bitmap_shm_header *header; /* Start of the mapping */
+    size_t map_len;
+};
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_create
+ *
+ *   Input:      shm         Caller owned memory for the mapping
+ *               name        Name of the segment for shm_open, "/name"
+ *               capacity    Capacity of the bitmap
+ *   Return:     Success     true
+ *               Failed      false, also when the segment already exists
+ *   Description            Create a shared empty bitmap and map it
+ ******************************************************************************/
+bool bitmap_shm_create(struct bitmap_shm *shm, const char *name, u16 capacity);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_open
+ *
+ *   Input:      shm         Caller owned memory for the mapping
+ *               name        Name of a segment made by bitmap_shm_create
+ *   Return:     Success     true
+ *               Failed      false, missing, not initialized yet or not a shared bitmap
+ *   Description            Map an existing shared bitmap
+ ******************************************************************************/
+bool bitmap_shm_open(struct bitmap_shm *shm, const char *name);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_close
+ *
+ *   Input:      shm         A mapping from bitmap_shm_create or bitmap_shm_open
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Unmap a shared bitmap, the segment stays for the other processes
+ ******************************************************************************/
+void bitmap_shm_close(struct bitmap_shm *shm);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_unlink
+ *
+ *   Input:      name        Name of a segment
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Remove a segment, mappings stay valid until they are closed
+ ******************************************************************************/
+bool bitmap_shm_unlink(const char *name);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_add
+ *
+ *   Input:      shm         A mapping
+ *               value       The value to add
+ *   Return:     Success     true
+ *               Failed      false, value is not below the capacity
+ *   Description            Atomically add a value
+ ******************************************************************************/
+bool bitmap_shm_add(struct bitmap_shm *shm, u16 value);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_del
+ *
+ *   Input:      shm         A mapping
+ *               value       The value to remove
+ *   Return:     Success     true
+ *               Failed      false, value is not below the capacity
+ *   Description            Atomically remove a value
+ ******************************************************************************/
+bool bitmap_shm_del(struct bitmap_shm *shm, u16 value);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_test
+ *
+ *   Input:      shm         A mapping
+ *               value       The value to test
+ *   Return:     Success     true, the value is set
+ *               Failed      false, not set or not below the capacity
+ *   Description            Test a value, seeing every change that completed before
+ ******************************************************************************/
+bool bitmap_shm_test(struct bitmap_shm *shm, u16 value);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_count
+ *
+ *   Input:      shm         A mapping
+ *   Return:     Success     Number of values
+ *               Failed      0
+ *   Description            Read the cardinality from the shared header
+ ******************************************************************************/
+u32 bitmap_shm_count(struct bitmap_shm *shm);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_shm_bitmap
+ *
+ *   Input:      shm         A mapping
+ *   Return:     Success     &shm->bm with a summary scanned from the words now
+ *               Failed      NULL
+ *   Description            Refresh the read-only view for bitmap_print, bitmap_format,
+ *                           views, or as the source of bitmap_or and bitmap_and. Changes
+ *                           made by other processes during a read can be seen or not
+ ******************************************************************************/
+struct bitmap *bitmap_shm_bitmap(struct bitmap_shm *shm);
+
+#endif /* __BITMAP_SHM_H__ */
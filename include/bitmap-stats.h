@@ -0,0 +1,89 @@
+#ifndef __BITMAP_STATS_H__
+#define __BITMAP_STATS_H__
+
+#include "bitmap.h"
+
+/*
+ * Operation counters of src/bitmap.c, compiled in with -DBITMAP_STATS (make STATS=1):
+ *
+ *     struct bitmap_stats stats;
+ *
+ *     if (bitmap_stats_snapshot(&stats))
+ *         printf("%" PRIu64 " rescans\n", stats.ops[BITMAP_STATS_RESCAN].calls);
+ *
+ * Every instrumented call counts itself, the words it went through, and its latency in a
+ * histogram of power of 2 buckets. Each thread counts in its own block, without atomic
+ * read-modify-writes or locks; a snapshot adds up the blocks of every thread that counted,
+ * including the ones that exited. Timing reads the clock twice per call, which is about
+ * as much as an add costs, so the stats are for finding out, not for always on.
+ *
+ * Without BITMAP_STATS nothing is counted and bitmap_stats_snapshot fails.
+ */
+
+#define BITMAP_STATS_BUCKETS 32 /* Bucket n counts latencies in [2^n, 2^(n + 1)) ns */
+
+enum bitmap_stats_op
+{
+    BITMAP_STATS_CREATE,
+    BITMAP_STATS_RESIZE,
+    BITMAP_STATS_ADD,
+    BITMAP_STATS_DEL,
+    BITMAP_STATS_ADD_VALUES,
+    BITMAP_STATS_DEL_VALUES,
+    BITMAP_STATS_TEST,
+    BITMAP_STATS_CLONE,
+    BITMAP_STATS_NOT,
+    BITMAP_STATS_OR,
+    BITMAP_STATS_AND,
+    BITMAP_STATS_RESCAN, /* update_info, the full scan behind not, or, and and loading */
+    BITMAP_STATS_OPS,
+};
+
+struct bitmap_stats_counters
+{
+    uint64_t calls;
+    uint64_t words;                         /* Words read or written */
+    uint64_t latency[BITMAP_STATS_BUCKETS]; /* Calls by log2 of their nanoseconds */
+};
+
+struct bitmap_stats
+{
+    struct bitmap_stats_counters ops[BITMAP_STATS_OPS]; /* By enum bitmap_stats_op */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_stats_snapshot
+ *
+ *   Input:      stats       Gets the counters of all threads
+ *   Return:     Success     true
+ *               Failed      false, the library was built without BITMAP_STATS
+ *   Description            Add up the counters. Calls that run meanwhile may be in part
+ ******************************************************************************/
+bool bitmap_stats_snapshot(struct bitmap_stats *stats);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_stats_op_name
+ *
+ *   Input:      op          An enum bitmap_stats_op
+ *   Return:     Success     Its name, like "add"
+ *               Failed      NULL, not an operation
+ *   Description            Name an operation for output
+ ******************************************************************************/
+const char *bitmap_stats_op_name(u32 op);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_stats_percentile
+ *
+ *   Input:      counters    Counters of one operation
+ *               percent     0 to 100
+ *   Return:     Success     Upper bound in nanoseconds of the bucket that holds the
+ *                           percentile
+ *               Failed      0, no calls
+ *   Description            Estimate a latency percentile from a histogram
+ ******************************************************************************/
+uint64_t bitmap_stats_percentile(const struct bitmap_stats_counters *counters, u32 percent);
+
+#endif /* __BITMAP_STATS_H__ */
@@ -0,0 +1,69 @@
+#ifndef __BITMAP_VIEW_H__
+#define __BITMAP_VIEW_H__
+
+#include "bitmap.h"
+
+#define BITMAP_VIEW_END -1 /* Returned by bitmap_view_next when no value is left */
+
+/* A read-only slice [start, end) of a bitmap, values in a view are relative to start */
+struct bitmap_view
+{
+    const struct bitmap *bm;
+    u16 start; /* First value of the bitmap in the view */
+    u16 end;   /* One past the last value of the bitmap in the view */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_view_init
+ *
+ *   Input:      view        The view that will be initialized
+ *               bm          The bitmap to look at, it is not copied
+ *               start       First value of bm in the view
+ *               end         One past the last value of bm in the view, at most max_value
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Make a read-only view of part of a bitmap. A view of the whole
+ *                           bitmap is bitmap_view_init(view, bm, 0, bm->max_value)
+ ******************************************************************************/
+bool bitmap_view_init(struct bitmap_view *view, const struct bitmap *bm, u16 start, u16 end);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_view_count
+ *
+ *   Input:      view        The view to count
+ *   Return:     Success     Number of values in the view
+ *               Failed      0
+ *   Description            Count the values in a view
+ ******************************************************************************/
+u32 bitmap_view_count(const struct bitmap_view *view);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_view_next
+ *
+ *   Input:      view        The view to iterate
+ *               from        The position, relative to the view, to search from
+ *   Return:     Success     The first value at or after from, relative to the view
+ *               Failed      BITMAP_VIEW_END
+ *   Description            Iterate over the values of a view:
+ *                           for (v = bitmap_view_next(view, 0); v != BITMAP_VIEW_END;
+ *                                v = bitmap_view_next(view, v + 1))
+ ******************************************************************************/
+int32_t bitmap_view_next(const struct bitmap_view *view, u32 from);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_view_and_count
+ *
+ *   Input:      view1       A view that participates in binary and operations
+ *               view2       Another view that participates in binary and operations
+ *   Return:     Success     Number of positions set in both views
+ *               Failed      0
+ *   Description            Count view1 & view2 without storing the result, the views
+ *                           are lined up at their starts
+ ******************************************************************************/
+u32 bitmap_view_and_count(const struct bitmap_view *view1, const struct bitmap_view *view2);
+
+#endif /* __BITMAP_VIEW_H__ */
@@ -0,0 +1,126 @@
+#ifndef __BITMAP_WAL_H__
+#define __BITMAP_WAL_H__
+
+#include <stddef.h>
+
+#include "bitmap.h"
+
+/*
+ * A bitmap kept crash safe by a snapshot and a write-ahead log of its changes:
+ *
+ *     path        the snapshot, in the bitmap_save_file format
+ *     path.wal    adds and deletes made since the snapshot
+ *
+ * Changes go through bitmap_wal_add and bitmap_wal_del: they are applied to the bitmap and
+ * buffered as log records. bitmap_wal_commit writes every buffered record with one write and
+ * syncs it according to the sync policy, so many changes share one fsync (group commit).
+ * A change is durable once a commit that synced it returned. Compaction saves a new
+ * snapshot, syncs its directory, and only then empties the log.
+ *
+ * Opening loads the snapshot and replays the log with the batched add/delete path. A torn
+ * record at the end of the log, from a crash during a write, is cut off. Replay is
+ * idempotent, so a crash between saving a snapshot and emptying the log is harmless.
+ */
+
+#define BITMAP_WAL_SYNC_COMMIT 0   /* fdatasync on every commit */
+#define BITMAP_WAL_SYNC_INTERVAL 1 /* fdatasync on a commit when sync_interval_ms passed */
+#define BITMAP_WAL_SYNC_NONE 2     /* Leave it to the kernel, sync on compaction and close only */
+
+struct bitmap_wal_options
+{
+    u16 capacity;         /* Capacity of a new bitmap when there is no snapshot yet */
+    bool autogrow;        /* Make a new bitmap BITMAP_FLAG_AUTOGROW */
+    int sync;             /* BITMAP_WAL_SYNC_* */
+    u32 sync_interval_ms; /* For BITMAP_WAL_SYNC_INTERVAL */
+    size_t buffer_size;   /* Pending records that force a write, 0 for 64 KiB */
+    size_t compact_size;  /* Log size that triggers a compaction on commit, 0 for never */
+};
+
+struct bitmap_wal;
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_open
+ *
+ *   Input:      path        The snapshot, the log is path.wal
+ *               options     Settings, see struct bitmap_wal_options
+ *   Return:     Success     A logged bitmap, recovered from the snapshot and the log
+ *               Failed      NULL
+ *   Description            Open or create a logged bitmap
+ ******************************************************************************/
+struct bitmap_wal *bitmap_wal_open(const char *path, const struct bitmap_wal_options *options);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_bitmap
+ *
+ *   Input:      wal         A logged bitmap
+ *   Return:     Success     The bitmap, for reading only: changes made to it directly are
+ *                           not logged
+ *               Failed      NULL
+ *   Description            Get the bitmap behind a log
+ ******************************************************************************/
+struct bitmap *bitmap_wal_bitmap(struct bitmap_wal *wal);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_add
+ *
+ *   Input:      wal         A logged bitmap
+ *               values      Values that will be added
+ *               count       Number of values
+ *   Return:     Success     true
+ *               Failed      false, nothing was added or logged
+ *   Description            Add values and log the change, durable after the next commit
+ ******************************************************************************/
+bool bitmap_wal_add(struct bitmap_wal *wal, const u16 *values, size_t count);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_del
+ *
+ *   Input:      wal         A logged bitmap
+ *               values      Values that will be removed
+ *               count       Number of values
+ *   Return:     Success     true
+ *               Failed      false, nothing was removed or logged
+ *   Description            Remove values and log the change, durable after the next commit
+ ******************************************************************************/
+bool bitmap_wal_del(struct bitmap_wal *wal, const u16 *values, size_t count);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_commit
+ *
+ *   Input:      wal         A logged bitmap
+ *   Return:     Success     true
+ *               Failed      false, the log could not be written or synced
+ *   Description            Write the buffered records in one write, sync them according to
+ *                           the policy, and compact when the log grew past compact_size
+ ******************************************************************************/
+bool bitmap_wal_commit(struct bitmap_wal *wal);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_compact
+ *
+ *   Input:      wal         A logged bitmap
+ *   Return:     Success     true
+ *               Failed      false, the old snapshot and the log are still valid
+ *   Description            Save the bitmap as the new snapshot and empty the log
+ ******************************************************************************/
+bool bitmap_wal_compact(struct bitmap_wal *wal);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_wal_close
+ *
+ *   Input:      wal         A logged bitmap
+ *   Return:     Success     true
+ *               Failed      false, the last commit failed
+ *   Description            Commit and sync what is buffered, then free the log and the
+ *                           bitmap
+ ******************************************************************************/
+bool bitmap_wal_close(struct bitmap_wal *wal);
+
+#endif /* __BITMAP_WAL_H__ */
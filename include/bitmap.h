@@ -9,15 +9,36 @@ typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
 
+#ifdef DEBUG
+    #include <assert.h>
+    #define BITMAP_ASSERT(cond) assert(cond)
+#else
+    #define BITMAP_ASSERT(cond) ((void)0)
+#endif
+
+#define BITMAP_FLAG_AUTOGROW 0x0001 /* bitmap_add_value grows the bitmap instead of failing */
+#define BITMAP_FLAG_EXTERNAL 0x0002 /* The header and buf belong to the caller */
+#define BITMAP_FLAG_READONLY 0x0004 /* buf can not be written, mutators fail */
+
+#define BITMAP_BLOCK_WORDS 16 /* Words per block of dirty tracking, 64 bytes */
+#define BITMAP_DIRTY_LEN 2    /* Dirty bit words, enough for the blocks of a 65535 bit bitmap */
+
+struct bitmap_allocator;
+
 struct bitmap
 {
     struct bitmap *bm_self;
+    u32 *buf;
+    const struct bitmap_allocator *allocator; /* The allocator this bitmap was created with,
+                                                 NULL for bitmap_init_external */
     u16 max_value;   /* The value used when creating a bitmap, aka capacity */
     u16 first_value; /* The first bit has been set */
     u16 last_value;  /* The last bit has been set */
     u16 numbers;     /* numbers of '1' in buf[] */
     u16 buf_len;
-    u32 buf[0];
+    u16 flags;       /* BITMAP_FLAG_* */
+    uint64_t dirty[BITMAP_DIRTY_LEN]; /* Bit n is set when a word of block n changed since
+                                         the replication took them, see bitmap-repl.h */
 };
 
 /*****************************************************************************
@@ -31,6 +52,21 @@ struct bitmap
  ******************************************************************************/
 struct bitmap *bitmap_create(u16 capacity);
 
+/*****************************************************************************
+ *
+ *   Name:       bitmap_init_external
+ *
+ *   Input:      bm          Caller owned memory for the bitmap header
+ *               words       Caller owned word array of at least (nbits + 31) / 32 words
+ *               nbits       The capacity of the bitmap
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Make a bitmap over existing words without allocating or
+ *                           copying, the bitmap cannot be resized and bitmap_destroy only
+ *                           invalidates it
+ ******************************************************************************/
+bool bitmap_init_external(struct bitmap *bm, u32 *words, u16 nbits);
+
 /*****************************************************************************
  *
  *   Name:       bitmap_destroy
@@ -42,6 +78,32 @@ struct bitmap *bitmap_create(u16 capacity);
  ******************************************************************************/
 void bitmap_destroy(struct bitmap *bm);
 
+/*****************************************************************************
+ *
+ *   Name:       bitmap_resize
+ *
+ *   Input:      bm          The bitmap that will be resized
+ *               new_capacity The new capacity of the bitmap
+ *   Return:     Success     true
+ *               Failed      false, bm is left untouched
+ *   Description            Change the capacity of a bitmap in place, values at or above
+ *                           new_capacity are dropped
+ ******************************************************************************/
+bool bitmap_resize(struct bitmap *bm, u16 new_capacity);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_set_autogrow
+ *
+ *   Input:      bm          The bitmap to configure
+ *               enable      Whether adding a value beyond the capacity grows the bitmap
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Enable or disable growing the bitmap, by doubling, in
+ *                           bitmap_add_value
+ ******************************************************************************/
+bool bitmap_set_autogrow(struct bitmap *bm, bool enable);
+
 /*****************************************************************************
  *
  *   Name:       bitmap_add_value
@@ -66,6 +128,162 @@ bool bitmap_add_value(struct bitmap *bm, u16 value);
  ******************************************************************************/
 bool bitmap_del_value(struct bitmap *bm, u16 value);
 
+/*****************************************************************************
+ *
+ *   Name:       bitmap_add_values
+ *
+ *   Input:      bm          The bitmap to which values are added
+ *               values      Values that will be added into the bitmap, in any order
+ *               count       Number of values
+ *   Return:     Success     true
+ *               Failed      false, nothing was added
+ *   Description            bitmap_add_value for many values: one check, at most one grow
+ *                           and one summary update for the whole batch
+ ******************************************************************************/
+bool bitmap_add_values(struct bitmap *bm, const u16 *values, size_t count);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_del_values
+ *
+ *   Input:      bm          The bitmap from which values are removed
+ *               values      Values that will be removed from the bitmap, in any order
+ *               count       Number of values
+ *   Return:     Success     true
+ *               Failed      false, nothing was removed
+ *   Description            bitmap_del_value for many values, the bounds are searched once
+ *                           after the whole batch
+ ******************************************************************************/
+bool bitmap_del_values(struct bitmap *bm, const u16 *values, size_t count);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_test_value
+ *
+ *   Input:      bm          The bitmap to look in
+ *               value       A value that will be looked up
+ *   Return:     Success     true if value is in the bitmap
+ *               Failed      false, also for an invalid bitmap or value
+ *   Description            Check whether a value is in the bitmap
+ ******************************************************************************/
+bool bitmap_test_value(struct bitmap *bm, u16 value);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_update_bounds
+ *
+ *   Input:      bm          A bitmap that just had value removed, numbers already updated
+ *               value       The removed value, it was first_value and/or last_value
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Find the new first_value and last_value by searching from the
+ *                           removed value word by word, used by bitmap_clear_unchecked
+ ******************************************************************************/
+void bitmap_update_bounds(struct bitmap *bm, u16 value);
+
+/*
+ * Fast path for trusted hot loops. These skip bitmap_check and the range check, value must
+ * be below bm->max_value of a valid bitmap; DEBUG builds assert it. The summary is kept up
+ * to date like in bitmap_add_value and bitmap_del_value.
+ */
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_test
+ *
+ *   Input:      bm          A valid bitmap
+ *               value       A value below bm->max_value
+ *   Return:     Success     true if value is in the bitmap
+ *               Failed      false
+ *   Description            Unchecked bitmap_test_value
+ ******************************************************************************/
+static inline bool bitmap_test(const struct bitmap *bm, u16 value)
+{
+    BITMAP_ASSERT(bm != NULL && bm->bm_self == bm && value < bm->max_value);
+
+    return (bm->buf[value / 32] >> (value % 32)) & 1U;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_mark_dirty
+ *
+ *   Input:      bm          A valid bitmap
+ *               value       A value below bm->max_value that changed
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Mark the block of a changed value for replication
+ ******************************************************************************/
+static inline void bitmap_mark_dirty(struct bitmap *bm, u16 value)
+{
+    u32 block = value / (32 * BITMAP_BLOCK_WORDS);
+
+    bm->dirty[block / 64] |= 1ULL << (block % 64);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_set_unchecked
+ *
+ *   Input:      bm          A valid bitmap
+ *               value       A value below bm->max_value
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Unchecked bitmap_add_value, without auto-growing
+ ******************************************************************************/
+static inline void bitmap_set_unchecked(struct bitmap *bm, u16 value)
+{
+    u32 *word = NULL;
+    u32 mask = 0;
+
+    BITMAP_ASSERT(bm != NULL && bm->bm_self == bm && value < bm->max_value &&
+                  !(bm->flags & BITMAP_FLAG_READONLY));
+
+    word = &bm->buf[value / 32];
+    mask = 1U << (value % 32);
+
+    /* min/max are harmless when the value was already set, so no branch on it */
+    bm->numbers += (u16)((*word & mask) == 0);
+    *word |= mask;
+    bitmap_mark_dirty(bm, value);
+    bm->first_value = (value < bm->first_value) ? value : bm->first_value;
+    bm->last_value = (value > bm->last_value) ? value : bm->last_value;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_clear_unchecked
+ *
+ *   Input:      bm          A valid bitmap
+ *               value       A value below bm->max_value
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Unchecked bitmap_del_value
+ ******************************************************************************/
+static inline void bitmap_clear_unchecked(struct bitmap *bm, u16 value)
+{
+    u32 *word = NULL;
+    u32 was_set = 0;
+
+    BITMAP_ASSERT(bm != NULL && bm->bm_self == bm && value < bm->max_value &&
+                  !(bm->flags & BITMAP_FLAG_READONLY));
+
+    word = &bm->buf[value / 32];
+    was_set = (*word >> (value % 32)) & 1U;
+    *word &= ~(1U << (value % 32));
+    bm->numbers -= (u16)was_set;
+    bitmap_mark_dirty(bm, value);
+
+    if (was_set && (value == bm->first_value || value == bm->last_value))
+    {
+        bitmap_update_bounds(bm, value);
+    }
+
+    return;
+}
+
 /*****************************************************************************
  *
  *   Name:       bitmap_print
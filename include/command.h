@@ -0,0 +1,102 @@
+#ifndef __COMMAND_H__
+#define __COMMAND_H__
+
+#include <stdio.h>
+
+#include "bitmap-registry.h"
+#include "bitmap.h"
+
+/*
+ * Line oriented command language of the driver, for scripts and other non-interactive use.
+ * Bitmaps are named, see bitmap-registry.h. Every command answers with one line: "OK", the
+ * requested data, or "ERR <reason>". Empty lines and lines starting with '#' are skipped.
+ *
+ *     create <name> <capacity>       Replace or create an empty bitmap
+ *     add <name> <value>...          Add values, creates an autogrow bitmap on demand
+ *     del <name> <value>...          Remove values
+ *     test <name> <value>            "1" or "0"
+ *     count <name>                   Number of values
+ *     or <name> <name>               First |= second
+ *     and <name> <name>              First &= second
+ *     not <name>                     Invert
+ *     parse <name> <range list>      Replace or create, parsing the rest of the line
+ *     print <name>                   The values as a range list, empty for no values
+ *     clone <name> <name>            Replace or create the first as a copy of the second
+ *     drop <name>                    Remove a bitmap
+ *     list                           The names, separated by spaces
+ *     info                           "bitmaps <count> bytes <memory>" of the registry
+ *     stats                          "<op> <calls> <words> <p50 ns> <p99 ns>" for every
+ *                                    operation that ran, separated by ", ", needs a build
+ *                                    with BITMAP_STATS, see bitmap-stats.h
+ *     stats <op>                     "<calls> <words>" and the 32 latency buckets of one
+ *                                    operation, like "add"
+ */
+
+#define COMMAND_OUTPUT_FLUSH (64 * 1024) /* command_run_script writes out at this size */
+#define COMMAND_DEFAULT_CAPACITY 100     /* Of bitmaps created on demand by add */
+
+/* Growing buffer that collects the responses */
+struct command_output
+{
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+/* The bitmaps the commands work on */
+struct command_context
+{
+    struct bitmap_registry *registry;
+};
+
+/*****************************************************************************
+ *
+ *   Name:       command_execute
+ *
+ *   Input:      ctx         The bitmaps
+ *               line        One command, without the line break. Modified while parsing
+ *               out         Gets the response line
+ *   Return:     Success     true, also for a skipped line, which has no response
+ *               Failed      false, out got an ERR line
+ *   Description            Run one command
+ ******************************************************************************/
+bool command_execute(struct command_context *ctx, char *line, struct command_output *out);
+
+/*****************************************************************************
+ *
+ *   Name:       command_run_script
+ *
+ *   Input:      ctx         The bitmaps
+ *               in          Commands, one per line, read to the end
+ *               out         Gets the responses, written in large blocks
+ *   Return:     Success     0, every command succeeded
+ *               Failed      Number of failed commands
+ *   Description            Run commands back to back, with no terminal I/O
+ ******************************************************************************/
+u32 command_run_script(struct command_context *ctx, FILE *in, FILE *out);
+
+/*****************************************************************************
+ *
+ *   Name:       command_output_append
+ *
+ *   Input:      out         The output
+ *               data        Bytes to append
+ *               len         Number of bytes
+ *   Return:     Success     true
+ *               Failed      false, out of memory
+ *   Description            Append to an output buffer, growing it
+ ******************************************************************************/
+bool command_output_append(struct command_output *out, const char *data, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       command_output_free
+ *
+ *   Input:      out         The output
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Free the buffer of an output
+ ******************************************************************************/
+void command_output_free(struct command_output *out);
+
+#endif /* __COMMAND_H__ */
@@ -0,0 +1,112 @@
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "command.h"
+
+/*
+ * Binary protocol of the server, the alternative to the text commands of command.h for
+ * clients that send values in bulk. Frames are little endian:
+ *
+ *     struct protocol_header      16 bytes, len is the size of the whole frame
+ *     char name[name_len]         The bitmap, padded with 0 to a multiple of 4
+ *     payload                     Depends on op, padded with 0 to a multiple of 4
+ *
+ * Request payloads:
+ *
+ *     CREATE                      none, count is the capacity
+ *     ADD, DEL, TEST              u16 values[count], one frame is one batch
+ *     COUNT, NOT, DROP            none
+ *     OR, AND                     char name[count], the second bitmap
+ *
+ * Every request gets one response frame, with the op of the request, a status and no
+ * name. count is the number of values for ADD and DEL, the cardinality for
+ * COUNT, and the number of hits for TEST, whose payload is a packed bit vector: bit i of
+ * byte i / 8 tells if values[i] was set. ADD creates a missing bitmap like the text add.
+ *
+ * A connection is binary when its first byte is PROTOCOL_MAGIC, which no text command
+ * starts with. Responses come back in request order, so frames can be pipelined.
+ */
+
+#define PROTOCOL_MAGIC 0xb5
+#define PROTOCOL_VERSION 1
+#define PROTOCOL_ALIGN 4
+#define PROTOCOL_FRAME_MAX (1024 * 1024) /* Larger frames close the connection */
+
+#define PROTOCOL_OP_CREATE 1
+#define PROTOCOL_OP_ADD 2
+#define PROTOCOL_OP_DEL 3
+#define PROTOCOL_OP_TEST 4
+#define PROTOCOL_OP_COUNT 5
+#define PROTOCOL_OP_OR 6
+#define PROTOCOL_OP_AND 7
+#define PROTOCOL_OP_NOT 8
+#define PROTOCOL_OP_DROP 9
+
+#define PROTOCOL_OK 0
+#define PROTOCOL_ERR_MALFORMED 1 /* Payload does not match op and count */
+#define PROTOCOL_ERR_OP 2        /* Unknown op */
+#define PROTOCOL_ERR_NAME 3      /* Bad name, or no bitmap with that name */
+#define PROTOCOL_ERR_RANGE 4     /* A value or capacity out of range, nothing changed */
+#define PROTOCOL_ERR_FAILED 5    /* The operation failed, e.g. out of memory */
+
+struct protocol_header
+{
+    u8 magic;     /* PROTOCOL_MAGIC */
+    u8 version;   /* PROTOCOL_VERSION */
+    u8 op;        /* PROTOCOL_OP_* */
+    u8 status;    /* PROTOCOL_OK or PROTOCOL_ERR_* in responses, 0 in requests */
+    u16 name_len; /* Bytes of the name without padding */
+    u16 reserved; /* 0 */
+    u32 count;    /* Depends on op */
+    u32 len;      /* Bytes of the frame, header and padding included */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       protocol_frame_len
+ *
+ *   Input:      buf         Received bytes, starting at a frame
+ *               len         Number of bytes
+ *   Return:     Success     Size of the frame when all of it arrived, 0 when more bytes are
+ *                           needed
+ *               Failed      -1, not a valid frame, the stream cannot be resynchronized
+ *   Description            Find the end of the next frame
+ ******************************************************************************/
+ssize_t protocol_frame_len(const u8 *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       protocol_execute
+ *
+ *   Input:      ctx         The bitmaps
+ *               frame       A whole request, as sized by protocol_frame_len, aligned to
+ *                           PROTOCOL_ALIGN
+ *               out         Gets the response frame
+ *   Return:     Success     true, the status is PROTOCOL_OK
+ *               Failed      false, out got an error response
+ *   Description            Run one request
+ ******************************************************************************/
+bool protocol_execute(struct command_context *ctx, const u8 *frame, struct command_output *out);
+
+/*****************************************************************************
+ *
+ *   Name:       protocol_append_frame
+ *
+ *   Input:      out         The buffer
+ *               op          PROTOCOL_OP_*
+ *               status      PROTOCOL_OK or PROTOCOL_ERR_*, 0 for requests
+ *               name        Name of the bitmap, NULL for none
+ *               count       The count field
+ *               payload     Bytes after the name, can be NULL when payload_len is 0
+ *               payload_len Number of bytes
+ *   Return:     Success     true
+ *               Failed      false, out of memory or too large
+ *   Description            Append a padded frame, for clients and for responses
+ ******************************************************************************/
+bool protocol_append_frame(struct command_output *out, u8 op, u8 status, const char *name,
+                           u32 count, const void *payload, size_t payload_len);
+
+#endif /* __PROTOCOL_H__ */
@@ -0,0 +1,51 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "command.h"
+
+/*
+ * Serves the command language of command.h on a Unix domain socket, so several processes
+ * share one set of bitmaps instead of each holding a copy:
+ *
+ *     ./main --serve /run/bitmaps.sock
+ *     printf 'add online 17\ntest online 17\n' | socat - UNIX-CONNECT:/run/bitmaps.sock
+ *
+ * One thread runs a level triggered epoll loop over non-blocking sockets. Every connection
+ * has an input and an output buffer: all complete lines that arrived are executed in order and
+ * their responses are sent together, so a client can pipeline thousands of commands without
+ * waiting for each answer. A connection whose client does not read its responses stops being
+ * read once SERVER_OUTPUT_MAX bytes are pending, instead of growing the buffer without bound.
+ * Connections that start with PROTOCOL_MAGIC speak the binary protocol of protocol.h instead
+ * of text, with the same pipelining.
+ */
+
+#define SERVER_READ_SIZE (64 * 1024)       /* Bytes read per call */
+#define SERVER_LINE_MAX (16 * 1024 * 1024) /* Longer commands close the connection */
+#define SERVER_OUTPUT_MAX (1024 * 1024)    /* Pending response bytes that pause reading */
+#define SERVER_EVENTS 64                   /* Events per epoll_wait */
+#define SERVER_POLL_MS 500                 /* Longest wait before server_stop is noticed */
+
+/*****************************************************************************
+ *
+ *   Name:       server_run
+ *
+ *   Input:      ctx         The bitmaps
+ *               path        Path of the socket, an old socket there is replaced
+ *   Return:     Success     true, stopped by server_stop
+ *               Failed      false, the socket could not be set up
+ *   Description            Serve commands until server_stop is called
+ ******************************************************************************/
+bool server_run(struct command_context *ctx, const char *path);
+
+/*****************************************************************************
+ *
+ *   Name:       server_stop
+ *
+ *   Input:      None
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Make server_run return, safe to call from a signal handler
+ ******************************************************************************/
+void server_stop(void);
+
+#endif /* __SERVER_H__ */
@@ -5,17 +5,26 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "bitmap-alloc.h"
+#include "bitmap-parse.h"
+#include "bitmap-registry.h"
 #include "bitmap.h"
+#include "command.h"
+#include "server.h"
 #include "terminal-control.h"
 
 #define HEADER_SIZE 1
-#define BITMAP_COUNT 5
+#define BITMAP_COUNT 5 /* Bitmaps "1" to "5" exist from the start */
 #define MAX_INPUT_SIZE 1024
 #define INITIAL_CAPACITY 100
-#define MENU_SIZE 10
+#define MENU_SIZE 12
 #define BETWEEN(val, min, max) ((val) > (min) && (val) < (max))
 
-static char **bitmap_options();
+static char **bitmap_options(uint32_t *count);
+static struct bitmap *selected_bitmap(int32_t index, uint32_t count, const char **name);
+static void free_options(void);
+static bool create_bitmaps(void);
+void handle_create_bitmap(void);
 void handle_change_capacity(void);
 void handle_add_value(void);
 void handle_del_value(void);
@@ -24,9 +33,13 @@ void handle_invert_bitmap(void);
 void handle_or_bitmap(void);
 void handle_and_bitmap(void);
 void handle_parse_bitmap(void);
+void handle_parse_file(void);
 void handle_clone_bitmap(void);
 void cleanup_bitmaps(void);
 void exit_command(int n);
+int run_script(const char *path);
+int run_server(const char *path);
+void stop_server(int n);
 char *get_allocated(const char *format, ...);
 
 typedef struct MenuOption
@@ -35,42 +48,156 @@ typedef struct MenuOption
     void (*action)(void);
 } MenuOption_t;
 
-struct bitmap *bitmaps[BITMAP_COUNT] = {NULL};
+struct bitmap_registry *registry = NULL;
+struct bitmap_pool *bitmap_pool = NULL;
+
+/* Menu entries of the last bitmap_options call, sorted by name */
+static char **option_labels = NULL;
+static const char **option_names = NULL;
+static uint32_t option_count = 0;
 
 void exit_command(int n)
 {
-    uint32_t i = 0;
-    char **options = NULL;
-
     printf(ENABLE_CURSOR);
     fflush(stdout);
     reset_terminal();
 
-    for (i = 0; i < BITMAP_COUNT; i++)
+    free_options();
+
+    /* Bitmaps go back to the pool, destroy it last */
+    bitmap_registry_destroy(registry);
+    registry = NULL;
+
+    bitmap_pool_destroy(bitmap_pool);
+    bitmap_pool = NULL;
+
+    if (n == EXIT_SUCCESS || n == SIGINT)
     {
-        bitmap_destroy(bitmaps[i]);
-        bitmaps[i] = NULL;
+        exit(EXIT_SUCCESS);
     }
 
-    options = bitmap_options();
+    exit(EXIT_FAILURE);
+
+    return;
+}
+
+/* Set up the pool and the registry with the initial bitmaps */
+static bool create_bitmaps(void)
+{
+    char name[16] = {0};
+    int32_t i = 0;
+
+    /* Bitmaps are replaced on every capacity change, parse and clone, recycle their memory */
+    bitmap_pool = bitmap_pool_create();
+    bitmap_set_allocator(bitmap_pool_allocator(bitmap_pool));
+
+    registry = bitmap_registry_create();
+
+    if (registry == NULL)
+    {
+        return false;
+    }
 
     for (i = 0; i < BITMAP_COUNT; i++)
     {
-        free(options[i]);
-        options[i] = NULL;
+        snprintf(name, sizeof(name), "%" PRId32, i + 1);
+
+        if (bitmap_registry_get(registry, name, INITIAL_CAPACITY) == NULL)
+        {
+            printf("Failed to create bitmap %" PRId32 "\n", i + 1);
+            return false;
+        }
     }
 
-    if (n == EXIT_SUCCESS || n == SIGINT)
+    return true;
+}
+
+/* Run the commands of a file, "-" for stdin, without touching the terminal */
+int run_script(const char *path)
+{
+    struct command_context ctx = {NULL};
+    FILE *in = stdin;
+    u32 failed = 0;
+
+    if (strcmp(path, "-") != 0)
     {
-        exit(EXIT_SUCCESS);
+        in = fopen(path, "r");
+
+        if (in == NULL)
+        {
+            fprintf(stderr, "Failed to open %s\n", path);
+            return EXIT_FAILURE;
+        }
     }
 
-    exit(EXIT_FAILURE);
+    if (create_bitmaps())
+    {
+        ctx.registry = registry;
+        failed = command_run_script(&ctx, in, stdout);
+    }
+    else
+    {
+        failed = 1;
+    }
+
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+
+    bitmap_registry_destroy(registry);
+    registry = NULL;
+
+    bitmap_pool_destroy(bitmap_pool);
+    bitmap_pool = NULL;
+
+    if (failed > 0)
+    {
+        fprintf(stderr, "%" PRIu32 " commands failed\n", failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void stop_server(int n)
+{
+    (void)n;
+    server_stop();
 
     return;
 }
 
-int main(void)
+/* Serve the bitmaps on a Unix domain socket until SIGINT or SIGTERM */
+int run_server(const char *path)
+{
+    struct command_context ctx = {NULL};
+    bool ok = false;
+
+    signal(SIGINT, &stop_server);
+    signal(SIGTERM, &stop_server);
+
+    if (create_bitmaps())
+    {
+        ctx.registry = registry;
+        ok = server_run(&ctx, path);
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to serve on %s\n", path);
+    }
+
+    bitmap_registry_destroy(registry);
+    registry = NULL;
+
+    bitmap_pool_destroy(bitmap_pool);
+    bitmap_pool = NULL;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
 {
     bool running = false;
     int32_t i = 0;
@@ -79,16 +206,30 @@ int main(void)
     const char *menu_headers[1] = {NULL};
     const char *menu_descriptions[MENU_SIZE] = {NULL};
 
-    menu[0] = &(MenuOption_t){"Change capacity", handle_change_capacity};
-    menu[1] = &(MenuOption_t){"Add value to a bitmap", handle_add_value};
-    menu[2] = &(MenuOption_t){"Delete value from a bitmap", handle_del_value};
-    menu[3] = &(MenuOption_t){"Invert a bitmap", handle_invert_bitmap};
-    menu[4] = &(MenuOption_t){"OR two bitmaps", handle_or_bitmap};
-    menu[5] = &(MenuOption_t){"AND two bitmaps", handle_and_bitmap};
-    menu[6] = &(MenuOption_t){"Parse bitmap from string", handle_parse_bitmap};
-    menu[7] = &(MenuOption_t){"Print all bitmaps", handle_print_bitmap};
-    menu[8] = &(MenuOption_t){"Clone bitmap", handle_clone_bitmap};
-    menu[9] = &(MenuOption_t){"Exit", cleanup_bitmaps};
+    menu[0] = &(MenuOption_t){"Create a named bitmap", handle_create_bitmap};
+    menu[1] = &(MenuOption_t){"Change capacity", handle_change_capacity};
+    menu[2] = &(MenuOption_t){"Add value to a bitmap", handle_add_value};
+    menu[3] = &(MenuOption_t){"Delete value from a bitmap", handle_del_value};
+    menu[4] = &(MenuOption_t){"Invert a bitmap", handle_invert_bitmap};
+    menu[5] = &(MenuOption_t){"OR two bitmaps", handle_or_bitmap};
+    menu[6] = &(MenuOption_t){"AND two bitmaps", handle_and_bitmap};
+    menu[7] = &(MenuOption_t){"Parse bitmap from string", handle_parse_bitmap};
+    menu[8] = &(MenuOption_t){"Parse bitmap from file", handle_parse_file};
+    menu[9] = &(MenuOption_t){"Print all bitmaps", handle_print_bitmap};
+    menu[10] = &(MenuOption_t){"Clone bitmap", handle_clone_bitmap};
+    menu[11] = &(MenuOption_t){"Exit", cleanup_bitmaps};
+
+    /* ./main --script [file], commands from a file or stdin instead of the menu */
+    if (argc > 1 && strcmp(argv[1], "--script") == 0)
+    {
+        return run_script((argc > 2) ? argv[2] : "-");
+    }
+
+    /* ./main --serve <socket>, commands from other processes */
+    if (argc > 2 && strcmp(argv[1], "--serve") == 0)
+    {
+        return run_server(argv[2]);
+    }
 
     menu_headers[0] = "Test Bitmap";
 
@@ -100,16 +241,9 @@ int main(void)
     signal(SIGINT, &exit_command); /* Catch Ctrl+C */
     init_terminal();
 
-    /*  Initialize the bitmaps */
-    for (i = 0; i < BITMAP_COUNT; i++)
+    if (!create_bitmaps())
     {
-        bitmaps[i] = bitmap_create(INITIAL_CAPACITY);
-
-        if (bitmaps[i] == NULL)
-        {
-            printf("Failed to create bitmap %" PRId32 "\n", i + 1);
-            exit_command(EXIT_FAILURE);
-        }
+        exit_command(EXIT_FAILURE);
     }
 
     running = true;
@@ -134,50 +268,145 @@ int main(void)
     return 0;
 }
 
-static char **bitmap_options()
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void free_options(void)
 {
-    static char *options[BITMAP_COUNT] = {NULL};
     uint32_t i = 0;
 
-    if (options[0] != NULL)
+    for (i = 0; i < option_count; i++)
     {
-        return options;
+        free(option_labels[i]);
     }
 
-    for (i = 0; i < BITMAP_COUNT; i++)
+    free(option_labels);
+    free(option_names);
+    option_labels = NULL;
+    option_names = NULL;
+    option_count = 0;
+
+    return;
+}
+
+/* Build the menu of the registry's bitmaps, valid until the next call */
+static char **bitmap_options(uint32_t *count)
+{
+    uint32_t iter = 0;
+    uint32_t i = 0;
+    uint32_t total = 0;
+    const char *name = NULL;
+
+    free_options();
+    *count = 0;
+
+    total = bitmap_registry_count(registry);
+    option_labels = (char **)calloc(total + 1, sizeof(char *));
+    option_names = (const char **)calloc(total + 1, sizeof(char *));
+
+    if (option_labels == NULL || option_names == NULL)
     {
-        options[i] = get_allocated("Bitmap %" PRIu32, i + 1);
+        goto cleanup;
+    }
+
+    while (i < total && bitmap_registry_next(registry, &iter, &name, NULL))
+    {
+        option_names[i++] = name;
+    }
+
+    qsort(option_names, i, sizeof(char *), compare_names);
+
+    for (option_count = 0; option_count < i; option_count++)
+    {
+        option_labels[option_count] = get_allocated("Bitmap %s", option_names[option_count]);
 
-        if (options[i] == NULL)
+        if (option_labels[option_count] == NULL)
         {
             goto cleanup;
         }
     }
 
-    return options;
+    *count = option_count;
+
+    return option_labels;
 
 cleanup:
+    free_options();
 
-    for (i = 0; i < BITMAP_COUNT; i++)
+    return NULL;
+}
+
+/* The bitmap of a menu entry from bitmap_options, NULL for no selection */
+static struct bitmap *selected_bitmap(int32_t index, uint32_t count, const char **name)
+{
+    if (!BETWEEN(index, -1, (int32_t)count))
     {
-        free(options[i]);
-        options[i] = NULL;
+        return NULL;
     }
 
-    return options;
+    *name = option_names[index];
+
+    return bitmap_registry_find(registry, *name);
+}
+
+void handle_create_bitmap(void)
+{
+    char *name = NULL;
+    uint32_t capacity = 0;
+    struct bitmap *bm = NULL;
+
+    name = get_raw_str("Enter bitmap name", BITMAP_REGISTRY_NAME_MAX);
+    capacity = get_int("Enter capacity", 8, NULL);
+    printf(CLEAR_SCREEN);
+    fflush(stdout);
+
+    if (name == NULL || name[0] == '\0' || capacity == UINT32_MAX || capacity == 0)
+    {
+        printf("Invalid input.\n");
+        goto cleanup;
+    }
+
+    if (capacity > UINT16_MAX)
+    {
+        capacity = UINT16_MAX;
+        printf("Capacity exceeded, creating at max capacity (%" PRIu16 ").\n", UINT16_MAX);
+    }
+
+    bm = bitmap_create((u16)capacity);
+
+    if (bm == NULL || !bitmap_registry_set(registry, name, bm))
+    {
+        bitmap_destroy(bm);
+        printf("Failed to create Bitmap %s.\n", name);
+        goto cleanup;
+    }
+
+    printf("Created Bitmap %s, %" PRIu32 " bitmaps, %zu bytes.\n", name,
+           bitmap_registry_count(registry), bitmap_registry_memory(registry));
+
+cleanup:
+    free(name);
+    press_any_key();
+
+    return;
 }
 
 void handle_change_capacity(void)
 {
-    int32_t selected_index = 0;
+    uint32_t count = 0;
     uint32_t new_capacity = 0;
-    struct bitmap *bm_new = NULL;
+    char **options = NULL;
+    const char *name = NULL;
+    struct bitmap *bm = NULL;
     char *headers[HEADER_SIZE] = {NULL};
 
     headers[0] = "Choose Bitmap";
-    selected_index = select_option(headers, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm = selected_bitmap(select_option(headers, HEADER_SIZE, options, count), count, &name);
 
-    if (BETWEEN(selected_index, -1, BITMAP_COUNT))
+    if (bm != NULL)
     {
         new_capacity = get_int("Enter new capacity", 8, NULL);
         printf(CLEAR_SCREEN);
@@ -201,18 +430,12 @@ void handle_change_capacity(void)
         goto cleanup;
     }
 
-    bm_new = bitmap_create((u16)new_capacity);
-
-    if (bm_new == NULL || !bitmap_or(bm_new, bitmaps[selected_index]))
+    if (!bitmap_resize(bm, (u16)new_capacity))
     {
         printf("Failed to change capacity.\n");
         goto cleanup;
     }
 
-    bitmap_destroy(bitmaps[selected_index]);
-    bitmaps[selected_index] = NULL;
-    bitmaps[selected_index] = bm_new;
-
     printf("Capacity Updated.\n");
 
 cleanup:
@@ -223,14 +446,18 @@ cleanup:
 
 void handle_add_value(void)
 {
-    int32_t selected_index = 0;
+    uint32_t count = 0;
     uint32_t value = 0;
+    char **options = NULL;
+    const char *name = NULL;
+    struct bitmap *bm = NULL;
     char *headers[HEADER_SIZE] = {NULL};
 
     headers[0] = "Choose Bitmap";
-    selected_index = select_option(headers, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm = selected_bitmap(select_option(headers, HEADER_SIZE, options, count), count, &name);
 
-    if (BETWEEN(selected_index, -1, BITMAP_COUNT))
+    if (bm != NULL)
     {
         value = get_int("Enter value to add", 8, NULL);
         printf(CLEAR_SCREEN);
@@ -242,9 +469,9 @@ void handle_add_value(void)
             goto cleanup;
         }
 
-        if (value >= UINT16_MAX || !bitmap_add_value(bitmaps[selected_index], value))
+        if (value >= UINT16_MAX || !bitmap_add_value(bm, value))
         {
-            printf("Failed to add %" PRIu32 " to Bitmap %" PRIu32 ".\n", value, selected_index + 1);
+            printf("Failed to add %" PRIu32 " to Bitmap %s.\n", value, name);
             goto cleanup;
         }
     }
@@ -254,7 +481,7 @@ void handle_add_value(void)
         goto cleanup;
     }
 
-    printf("Added %" PRIu32 " to Bitmap %" PRIu32, value, selected_index + 1);
+    printf("Added %" PRIu32 " to Bitmap %s", value, name);
 
 cleanup:
     press_any_key();
@@ -264,15 +491,19 @@ cleanup:
 
 void handle_del_value(void)
 {
-    int32_t selected_index = 0;
+    uint32_t count = 0;
     uint32_t value = 0;
+    char **options = NULL;
+    const char *name = NULL;
+    struct bitmap *bm = NULL;
     char *headers[HEADER_SIZE] = {NULL};
 
     headers[0] = "Choose Bitmap";
 
-    selected_index = select_option(headers, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm = selected_bitmap(select_option(headers, HEADER_SIZE, options, count), count, &name);
 
-    if (BETWEEN(selected_index, -1, BITMAP_COUNT))
+    if (bm != NULL)
     {
         value = get_int("Enter value to delete", 8, NULL);
         printf(CLEAR_SCREEN);
@@ -284,10 +515,9 @@ void handle_del_value(void)
             goto cleanup;
         }
 
-        if (value < UINT16_MAX && !bitmap_del_value(bitmaps[selected_index], value))
+        if (value < UINT16_MAX && !bitmap_del_value(bm, value))
         {
-            printf("Failed to delete %" PRIu32 " from Bitmap %" PRIu32 ".\n", value,
-                   selected_index + 1);
+            printf("Failed to delete %" PRIu32 " from Bitmap %s.\n", value, name);
             goto cleanup;
         }
     }
@@ -297,7 +527,7 @@ void handle_del_value(void)
         goto cleanup;
     }
 
-    printf("Deleted %" PRIu32 " from Bitmap %" PRIu32, value, selected_index + 1);
+    printf("Deleted %" PRIu32 " from Bitmap %s", value, name);
 
 cleanup:
     press_any_key();
@@ -307,17 +537,21 @@ cleanup:
 
 void handle_invert_bitmap(void)
 {
-    int32_t selected_index = 0;
+    uint32_t count = 0;
+    char **options = NULL;
+    const char *name = NULL;
+    struct bitmap *bm = NULL;
     char *headers[HEADER_SIZE] = {NULL};
 
     headers[0] = "Choose Bitmap";
-    selected_index = select_option(headers, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm = selected_bitmap(select_option(headers, HEADER_SIZE, options, count), count, &name);
 
-    if (BETWEEN(selected_index, -1, BITMAP_COUNT))
+    if (bm != NULL)
     {
-        if (!bitmap_not(bitmaps[selected_index]))
+        if (!bitmap_not(bm))
         {
-            printf("Failed to add invert Bitmap %" PRIu32 ".\n", selected_index + 1);
+            printf("Failed to add invert Bitmap %s.\n", name);
             goto cleanup;
         }
     }
@@ -327,7 +561,7 @@ void handle_invert_bitmap(void)
         goto cleanup;
     }
 
-    printf("Inverted Bitmap %" PRIu32, selected_index + 1);
+    printf("Inverted Bitmap %s", name);
 
 cleanup:
     press_any_key();
@@ -337,23 +571,29 @@ cleanup:
 
 void handle_or_bitmap(void)
 {
-    int32_t index_store = 0;
-    int32_t index_2nd = 0;
+    uint32_t count = 0;
+    char **options = NULL;
+    const char *name_store = NULL;
+    const char *name_2nd = NULL;
+    struct bitmap *bm_store = NULL;
+    struct bitmap *bm_2nd = NULL;
     char *headers1[HEADER_SIZE] = {NULL};
     char *headers2[HEADER_SIZE] = {NULL};
 
     headers1[0] = "Choose destination Bitmap";
     headers2[0] = "Choose second Bitmap";
 
-    index_store = select_option(headers1, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
-    index_2nd = select_option(headers2, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm_store =
+        selected_bitmap(select_option(headers1, HEADER_SIZE, options, count), count, &name_store);
+    bm_2nd =
+        selected_bitmap(select_option(headers2, HEADER_SIZE, options, count), count, &name_2nd);
 
-    if (BETWEEN(index_store, -1, BITMAP_COUNT) && BETWEEN(index_2nd, -1, BITMAP_COUNT))
+    if (bm_store != NULL && bm_2nd != NULL)
     {
-        if (!bitmap_or(bitmaps[index_store], bitmaps[index_2nd]))
+        if (!bitmap_or(bm_store, bm_2nd))
         {
-            printf("Failed to OR Bitmap %" PRIu32 " and Bitmap %" PRIu32 ".\n", index_store + 1,
-                   index_2nd + 1);
+            printf("Failed to OR Bitmap %s and Bitmap %s.\n", name_store, name_2nd);
             goto cleanup;
         }
     }
@@ -373,23 +613,29 @@ cleanup:
 
 void handle_and_bitmap(void)
 {
-    int32_t index_store = 0;
-    int32_t index_2nd = 0;
+    uint32_t count = 0;
+    char **options = NULL;
+    const char *name_store = NULL;
+    const char *name_2nd = NULL;
+    struct bitmap *bm_store = NULL;
+    struct bitmap *bm_2nd = NULL;
     char *headers1[HEADER_SIZE] = {NULL};
     char *headers2[HEADER_SIZE] = {NULL};
 
-    headers1[0] = strdup("Choose destination Bitmap");
-    headers2[0] = strdup("Choose second Bitmap");
+    headers1[0] = "Choose destination Bitmap";
+    headers2[0] = "Choose second Bitmap";
 
-    index_store = select_option(headers1, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
-    index_2nd = select_option(headers2, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm_store =
+        selected_bitmap(select_option(headers1, HEADER_SIZE, options, count), count, &name_store);
+    bm_2nd =
+        selected_bitmap(select_option(headers2, HEADER_SIZE, options, count), count, &name_2nd);
 
-    if (BETWEEN(index_store, -1, BITMAP_COUNT) && BETWEEN(index_2nd, -1, BITMAP_COUNT))
+    if (bm_store != NULL && bm_2nd != NULL)
     {
-        if (!bitmap_and(bitmaps[index_store], bitmaps[index_2nd]))
+        if (!bitmap_and(bm_store, bm_2nd))
         {
-            printf("Failed to AND Bitmap %" PRIu32 " and Bitmap %" PRIu32 ".\n", index_store + 1,
-                   index_2nd + 1);
+            printf("Failed to AND Bitmap %s and Bitmap %s.\n", name_store, name_2nd);
             goto cleanup;
         }
     }
@@ -409,30 +655,84 @@ cleanup:
 
 void handle_parse_bitmap(void)
 {
-    int32_t selected_index = 0;
+    uint32_t count = 0;
+    char **options = NULL;
+    const char *name = NULL;
     char *input_str = NULL;
     struct bitmap *parsed_bm = NULL;
     char *headers[HEADER_SIZE] = {NULL};
 
     headers[0] = "Choose Bitmap";
-    selected_index = select_option(headers, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
 
-    if (BETWEEN(selected_index, -1, BITMAP_COUNT))
+    if (selected_bitmap(select_option(headers, HEADER_SIZE, options, count), count, &name) != NULL)
     {
         input_str = get_raw_str("Enter bitmap string (e.g., 1-3,5,7)", MAX_INPUT_SIZE);
         parsed_bm = bitmap_parse_str((u8 *)input_str);
         free(input_str);
         input_str = NULL;
 
-        if (parsed_bm == NULL)
+        if (parsed_bm == NULL || !bitmap_registry_set(registry, name, parsed_bm))
         {
+            bitmap_destroy(parsed_bm);
             printf("Failed to parse bitmap string.\n");
             goto cleanup;
         }
-        else
+    }
+    else
+    {
+        printf("Invalid bitmap selected.\n");
+        goto cleanup;
+    }
+
+    printf("Parsing successful.\n");
+    printf("Parsed bitmap: ");
+    bitmap_print(parsed_bm);
+
+cleanup:
+    press_any_key();
+
+    return;
+}
+
+void handle_parse_file(void)
+{
+    uint32_t count = 0;
+    char **options = NULL;
+    const char *name = NULL;
+    char *path = NULL;
+    FILE *fp = NULL;
+    struct bitmap *parsed_bm = NULL;
+    char *headers[HEADER_SIZE] = {NULL};
+
+    headers[0] = "Choose Bitmap";
+    options = bitmap_options(&count);
+
+    if (selected_bitmap(select_option(headers, HEADER_SIZE, options, count), count, &name) != NULL)
+    {
+        path = get_raw_str("Enter path of a file with a bitmap string", MAX_INPUT_SIZE);
+        printf(CLEAR_SCREEN);
+        fflush(stdout);
+
+        fp = (path != NULL) ? fopen(path, "r") : NULL;
+        free(path);
+        path = NULL;
+
+        if (fp == NULL)
+        {
+            printf("Failed to open file.\n");
+            goto cleanup;
+        }
+
+        /* Read in pieces, so the file is not limited to MAX_INPUT_SIZE */
+        parsed_bm = bitmap_parse_stream(fp);
+        fclose(fp);
+
+        if (parsed_bm == NULL || !bitmap_registry_set(registry, name, parsed_bm))
         {
-            bitmap_destroy(bitmaps[selected_index]);
-            bitmaps[selected_index] = parsed_bm;
+            bitmap_destroy(parsed_bm);
+            printf("Failed to parse bitmap file.\n");
+            goto cleanup;
         }
     }
     else
@@ -443,7 +743,7 @@ void handle_parse_bitmap(void)
 
     printf("Parsing successful.\n");
     printf("Parsed bitmap: ");
-    bitmap_print(bitmaps[selected_index]);
+    bitmap_print(parsed_bm);
 
 cleanup:
     press_any_key();
@@ -453,14 +753,18 @@ cleanup:
 
 void handle_print_bitmap(void)
 {
-    int32_t i = 0;
+    uint32_t i = 0;
+    uint32_t count = 0;
 
     printf(CLEAR_SCREEN);
 
-    for (i = 0; i < BITMAP_COUNT; i++)
+    /* Sorted by name */
+    bitmap_options(&count);
+
+    for (i = 0; i < count; i++)
     {
-        printf("Bitmap %d: ", i + 1);
-        bitmap_print(bitmaps[i]);
+        printf("Bitmap %s: ", option_names[i]);
+        bitmap_print(bitmap_registry_find(registry, option_names[i]));
     }
 
     press_any_key();
@@ -470,8 +774,12 @@ void handle_print_bitmap(void)
 
 void handle_clone_bitmap(void)
 {
-    int32_t index_store = 0;
-    int32_t index_2nd = 0;
+    uint32_t count = 0;
+    char **options = NULL;
+    const char *name_store = NULL;
+    const char *name_2nd = NULL;
+    struct bitmap *bm_store = NULL;
+    struct bitmap *bm_2nd = NULL;
     char *headers1[HEADER_SIZE] = {NULL};
     char *headers2[HEADER_SIZE] = {NULL};
     struct bitmap *bm_temp = NULL;
@@ -479,23 +787,22 @@ void handle_clone_bitmap(void)
     headers1[0] = "Choose destination Bitmap";
     headers2[0] = "Choose source Bitmap";
 
-    index_store = select_option(headers1, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
-    index_2nd = select_option(headers2, HEADER_SIZE, bitmap_options(), BITMAP_COUNT);
+    options = bitmap_options(&count);
+    bm_store =
+        selected_bitmap(select_option(headers1, HEADER_SIZE, options, count), count, &name_store);
+    bm_2nd =
+        selected_bitmap(select_option(headers2, HEADER_SIZE, options, count), count, &name_2nd);
 
-    if (index_store < BITMAP_COUNT && index_2nd < BITMAP_COUNT)
+    if (bm_store != NULL && bm_2nd != NULL)
     {
-        bm_temp = bitmap_clone(bitmaps[index_2nd]);
+        bm_temp = bitmap_clone(bm_2nd);
 
-        if (bm_temp == NULL)
+        if (bm_temp == NULL || !bitmap_registry_set(registry, name_store, bm_temp))
         {
-            printf("Failed to clone Bitmap %" PRIu32 " into Bitmap %" PRIu32 ".\n", index_2nd + 1,
-                   index_store + 1);
+            bitmap_destroy(bm_temp);
+            printf("Failed to clone Bitmap %s into Bitmap %s.\n", name_2nd, name_store);
             goto cleanup;
         }
-
-        bitmap_destroy(bitmaps[index_store]);
-        bitmaps[index_store] = NULL;
-        bitmaps[index_store] = bm_temp;
     }
     else
     {
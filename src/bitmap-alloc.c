@@ -0,0 +1,559 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "bitmap-alloc.h"
+
+#define POOL_MIN_CLASS_SHIFT 6 /* 64 bytes, one cache line */
+#define POOL_CLASS_COUNT 9     /* 64 bytes .. 16 KiB, enough for a full u16 bitmap */
+#define POOL_SLAB_SIZE (64 * 1024) /* Small, an idle pool should not pin a huge page */
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+#define ALIGN_UP(val, align) (((val) + (align)-1) & ~((size_t)(align)-1))
+
+struct pool_block
+{
+    struct pool_block *next;
+};
+
+struct pool_slab
+{
+    struct pool_slab *next;
+};
+
+struct bitmap_pool
+{
+    struct bitmap_allocator allocator;
+    struct pool_block *free_list[POOL_CLASS_COUNT];
+    struct pool_slab *slabs;
+    u8 *slab_cursor; /* Blocks never handed out yet are cut from here */
+    u8 *slab_limit;
+};
+
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+};
+
+struct bitmap_arena
+{
+    struct bitmap_allocator allocator;
+    struct arena_chunk *chunks;
+    size_t chunk_size;
+};
+
+static void *malloc_alloc(size_t size, void *ctx);
+static void malloc_free(void *ptr, size_t size, void *ctx);
+static void *malloc_realloc(void *ptr, size_t old_size, size_t new_size, void *ctx);
+static void *pool_alloc(size_t size, void *ctx);
+static void pool_free(void *ptr, size_t size, void *ctx);
+static void *pool_realloc(void *ptr, size_t old_size, size_t new_size, void *ctx);
+static void *arena_alloc(size_t size, void *ctx);
+static void arena_free(void *ptr, size_t size, void *ctx);
+static void *arena_realloc(void *ptr, size_t old_size, size_t new_size, void *ctx);
+
+/*****************************************************************************
+ *
+ *   Name:       pool_class
+ *
+ *   Input:      size        Size of a requested block
+ *   Return:     Success     Index of the smallest class holding size
+ *               Failed      POOL_CLASS_COUNT if size is bigger than every class
+ *   Description            Map an allocation size to a pool size class
+ ******************************************************************************/
+static inline u32 pool_class(size_t size);
+
+/*****************************************************************************
+ *
+ *   Name:       huge_alloc
+ *
+ *   Input:      size        Size of the mapping, a multiple of BITMAP_HUGEPAGE_SIZE
+ *   Return:     Success     A mapping aligned to BITMAP_HUGEPAGE_SIZE
+ *               Failed      NULL
+ *   Description            Map anonymous memory the kernel can back with huge pages
+ ******************************************************************************/
+static void *huge_alloc(size_t size);
+
+/*****************************************************************************
+ *
+ *   Name:       block_alloc
+ *
+ *   Input:      size        Size of a requested block
+ *   Return:     Success     A block aligned to BITMAP_BUF_ALIGN, huge page backed from
+ *                           BITMAP_HUGEPAGE_THRESHOLD on
+ *               Failed      NULL
+ *   Description            Get memory from the system for allocators and slabs
+ ******************************************************************************/
+static void *block_alloc(size_t size);
+
+/*****************************************************************************
+ *
+ *   Name:       block_free
+ *
+ *   Input:      ptr         A block from block_alloc
+ *               size        The size passed to block_alloc
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Give a block from block_alloc back to the system
+ ******************************************************************************/
+static void block_free(void *ptr, size_t size);
+
+static const struct bitmap_allocator malloc_allocator = {malloc_alloc, malloc_free, NULL,
+                                                         malloc_realloc};
+static const struct bitmap_allocator *current_allocator = &malloc_allocator;
+
+static void *huge_alloc(size_t size)
+{
+    u8 *map = NULL;
+    u8 *aligned = NULL;
+    size_t head = 0;
+    size_t tail = 0;
+
+    /* Over-map by one huge page so the start can be aligned for the THP code */
+    map = (u8 *)mmap(NULL, size + BITMAP_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    aligned = (u8 *)ALIGN_UP((uintptr_t)map, BITMAP_HUGEPAGE_SIZE);
+    head = aligned - map;
+    tail = BITMAP_HUGEPAGE_SIZE - head;
+
+    if (head != 0)
+    {
+        munmap(map, head);
+    }
+
+    if (tail != 0)
+    {
+        munmap(aligned + size, tail);
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE); /* Only a hint, fine if THP is disabled */
+#endif
+
+    return aligned;
+}
+
+static void *block_alloc(size_t size)
+{
+    if (size >= BITMAP_HUGEPAGE_THRESHOLD)
+    {
+        return huge_alloc(ALIGN_UP(size, BITMAP_HUGEPAGE_SIZE));
+    }
+
+    return aligned_alloc(BITMAP_BUF_ALIGN, ALIGN_UP(size, BITMAP_BUF_ALIGN));
+}
+
+static void block_free(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    if (size >= BITMAP_HUGEPAGE_THRESHOLD)
+    {
+        munmap(ptr, ALIGN_UP(size, BITMAP_HUGEPAGE_SIZE));
+        return;
+    }
+
+    free(ptr);
+
+    return;
+}
+
+static void *malloc_alloc(size_t size, void *ctx)
+{
+    (void)ctx;
+
+    return block_alloc(size);
+}
+
+static void malloc_free(void *ptr, size_t size, void *ctx)
+{
+    (void)ctx;
+
+    block_free(ptr, size);
+
+    return;
+}
+
+static void *malloc_realloc(void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+    void *new_ptr = NULL;
+
+    (void)ctx;
+
+    /* realloc() does not keep the alignment, move only when the rounded size changes */
+    if (ALIGN_UP(old_size, BITMAP_BUF_ALIGN) == ALIGN_UP(new_size, BITMAP_BUF_ALIGN) &&
+        (old_size >= BITMAP_HUGEPAGE_THRESHOLD) == (new_size >= BITMAP_HUGEPAGE_THRESHOLD))
+    {
+        return ptr;
+    }
+
+    new_ptr = block_alloc(new_size);
+
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_ptr, ptr, (old_size < new_size) ? old_size : new_size);
+    block_free(ptr, old_size);
+
+    return new_ptr;
+}
+
+void bitmap_set_allocator(const struct bitmap_allocator *allocator)
+{
+    if (allocator == NULL || allocator->alloc == NULL || allocator->free == NULL)
+    {
+        current_allocator = &malloc_allocator;
+        return;
+    }
+
+    current_allocator = allocator;
+
+    return;
+}
+
+const struct bitmap_allocator *bitmap_get_allocator(void)
+{
+    return current_allocator;
+}
+
+static inline u32 pool_class(size_t size)
+{
+    u32 class_index = 0;
+
+    while (class_index < POOL_CLASS_COUNT &&
+           ((size_t)1 << (class_index + POOL_MIN_CLASS_SHIFT)) < size)
+    {
+        class_index++;
+    }
+
+    return class_index;
+}
+
+struct bitmap_pool *bitmap_pool_create(void)
+{
+    struct bitmap_pool *pool = NULL;
+
+    pool = (struct bitmap_pool *)calloc(1, sizeof(struct bitmap_pool));
+
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    pool->allocator.alloc = pool_alloc;
+    pool->allocator.free = pool_free;
+    pool->allocator.ctx = pool;
+    pool->allocator.realloc = pool_realloc;
+
+    return pool;
+}
+
+const struct bitmap_allocator *bitmap_pool_allocator(struct bitmap_pool *pool)
+{
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    return &pool->allocator;
+}
+
+static void *pool_alloc(size_t size, void *ctx)
+{
+    struct bitmap_pool *pool = (struct bitmap_pool *)ctx;
+    struct pool_slab *slab = NULL;
+    struct pool_block *block = NULL;
+    size_t block_size = 0;
+    u32 class_index = 0;
+
+    class_index = pool_class(size);
+
+    if (class_index == POOL_CLASS_COUNT)
+    {
+        return block_alloc(size);
+    }
+
+    if (pool->free_list[class_index] != NULL)
+    {
+        block = pool->free_list[class_index];
+        pool->free_list[class_index] = block->next;
+
+        return block;
+    }
+
+    /* Every class is a power of two of at least BITMAP_BUF_ALIGN, so bumping keeps alignment */
+    block_size = (size_t)1 << (class_index + POOL_MIN_CLASS_SHIFT);
+
+    if (pool->slab_cursor == NULL || pool->slab_cursor + block_size > pool->slab_limit)
+    {
+        slab = (struct pool_slab *)block_alloc(POOL_SLAB_SIZE);
+
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->slab_cursor = (u8 *)slab + ALIGN_UP(sizeof(struct pool_slab), BITMAP_BUF_ALIGN);
+        pool->slab_limit = (u8 *)slab + POOL_SLAB_SIZE;
+    }
+
+    block = (struct pool_block *)pool->slab_cursor;
+    pool->slab_cursor += block_size;
+
+    return block;
+}
+
+static void pool_free(void *ptr, size_t size, void *ctx)
+{
+    struct bitmap_pool *pool = (struct bitmap_pool *)ctx;
+    struct pool_block *block = (struct pool_block *)ptr;
+    u32 class_index = 0;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    class_index = pool_class(size);
+
+    if (class_index == POOL_CLASS_COUNT)
+    {
+        block_free(ptr, size);
+        return;
+    }
+
+    block->next = pool->free_list[class_index];
+    pool->free_list[class_index] = block;
+
+    return;
+}
+
+static void *pool_realloc(void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+    void *new_ptr = NULL;
+    u32 class_index = 0;
+
+    class_index = pool_class(old_size);
+
+    if (class_index < POOL_CLASS_COUNT && class_index == pool_class(new_size))
+    {
+        /* The block already has room for the new size */
+        return ptr;
+    }
+
+    new_ptr = pool_alloc(new_size, ctx);
+
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_ptr, ptr, (old_size < new_size) ? old_size : new_size);
+    pool_free(ptr, old_size, ctx);
+
+    return new_ptr;
+}
+
+void bitmap_pool_destroy(struct bitmap_pool *pool)
+{
+    struct pool_slab *slab = NULL;
+
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    if (current_allocator == &pool->allocator)
+    {
+        current_allocator = &malloc_allocator;
+    }
+
+    while (pool->slabs != NULL)
+    {
+        slab = pool->slabs;
+        pool->slabs = slab->next;
+        block_free(slab, POOL_SLAB_SIZE);
+    }
+
+    free(pool);
+
+    return;
+}
+
+struct bitmap_arena *bitmap_arena_create(size_t chunk_size)
+{
+    struct bitmap_arena *arena = NULL;
+
+    arena = (struct bitmap_arena *)calloc(1, sizeof(struct bitmap_arena));
+
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    arena->allocator.alloc = arena_alloc;
+    arena->allocator.free = arena_free;
+    arena->allocator.ctx = arena;
+    arena->allocator.realloc = arena_realloc;
+    arena->chunk_size = (chunk_size == 0) ? ARENA_DEFAULT_CHUNK_SIZE : chunk_size;
+
+    return arena;
+}
+
+const struct bitmap_allocator *bitmap_arena_allocator(struct bitmap_arena *arena)
+{
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    return &arena->allocator;
+}
+
+static void *arena_alloc(size_t size, void *ctx)
+{
+    struct bitmap_arena *arena = (struct bitmap_arena *)ctx;
+    struct arena_chunk *chunk = NULL;
+    size_t header_size = 0;
+    size_t chunk_size = 0;
+    void *ptr = NULL;
+
+    header_size = ALIGN_UP(sizeof(struct arena_chunk), BITMAP_BUF_ALIGN);
+    size = ALIGN_UP(size, BITMAP_BUF_ALIGN);
+    chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->used + size > chunk->size)
+    {
+        chunk_size = header_size + size;
+
+        if (chunk_size < arena->chunk_size)
+        {
+            chunk_size = arena->chunk_size;
+        }
+
+        chunk = (struct arena_chunk *)block_alloc(chunk_size);
+
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        chunk->used = header_size;
+        arena->chunks = chunk;
+    }
+
+    ptr = (u8 *)chunk + chunk->used;
+    chunk->used += size;
+
+    return ptr;
+}
+
+static void arena_free(void *ptr, size_t size, void *ctx)
+{
+    /* Memory goes back all at once in bitmap_arena_reset */
+    (void)ptr;
+    (void)size;
+    (void)ctx;
+
+    return;
+}
+
+static void *arena_realloc(void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+    struct bitmap_arena *arena = (struct bitmap_arena *)ctx;
+    struct arena_chunk *chunk = arena->chunks;
+    void *new_ptr = NULL;
+
+    old_size = ALIGN_UP(old_size, BITMAP_BUF_ALIGN);
+    new_size = ALIGN_UP(new_size, BITMAP_BUF_ALIGN);
+
+    /* The most recent allocation can grow or shrink where it is */
+    if (chunk != NULL && (u8 *)ptr + old_size == (u8 *)chunk + chunk->used &&
+        chunk->used - old_size + new_size <= chunk->size)
+    {
+        chunk->used = chunk->used - old_size + new_size;
+        return ptr;
+    }
+
+    if (new_size <= old_size)
+    {
+        return ptr;
+    }
+
+    new_ptr = arena_alloc(new_size, ctx);
+
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_ptr, ptr, old_size);
+
+    return new_ptr;
+}
+
+void bitmap_arena_reset(struct bitmap_arena *arena)
+{
+    struct arena_chunk *chunk = NULL;
+
+    if (arena == NULL || arena->chunks == NULL)
+    {
+        return;
+    }
+
+    /* Keep the oldest chunk, it is the last one in the list */
+    while (arena->chunks->next != NULL)
+    {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        block_free(chunk, chunk->size);
+    }
+
+    arena->chunks->used = ALIGN_UP(sizeof(struct arena_chunk), BITMAP_BUF_ALIGN);
+
+    return;
+}
+
+void bitmap_arena_destroy(struct bitmap_arena *arena)
+{
+    struct arena_chunk *chunk = NULL;
+
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    if (current_allocator == &arena->allocator)
+    {
+        current_allocator = &malloc_allocator;
+    }
+
+    while (arena->chunks != NULL)
+    {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        block_free(chunk, chunk->size);
+    }
+
+    free(arena);
+
+    return;
+}
@@ -0,0 +1,127 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bitmap-internal.h"
+#include "bitmap.h"
+
+#if defined(__x86_64__)
+    #include <nmmintrin.h>
+    #define CRC32C_HW 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78 /* Castagnoli, reversed */
+
+static u32 crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+/*****************************************************************************
+ *
+ *   Name:       crc32c_table_init
+ *
+ *   Input:      None
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Fill the table of the byte at a time fallback
+ ******************************************************************************/
+static void crc32c_table_init(void);
+
+/*****************************************************************************
+ *
+ *   Name:       crc32c_sw
+ *
+ *   Input:      crc         Running CRC, already inverted
+ *               data        The data
+ *               len         Number of bytes in data
+ *   Return:     Success     The new running CRC
+ *               Failed      None
+ *   Description            Table driven CRC32C, a byte at a time
+ ******************************************************************************/
+static u32 crc32c_sw(u32 crc, const u8 *data, size_t len);
+
+#ifdef CRC32C_HW
+/*****************************************************************************
+ *
+ *   Name:       crc32c_hw
+ *
+ *   Input:      crc         Running CRC, already inverted
+ *               data        The data
+ *               len         Number of bytes in data
+ *   Return:     Success     The new running CRC
+ *               Failed      None
+ *   Description            CRC32C with the SSE4.2 crc32 instruction, 8 bytes at a time
+ ******************************************************************************/
+static u32 crc32c_hw(u32 crc, const u8 *data, size_t len);
+#endif
+
+static void crc32c_table_init(void)
+{
+    u32 crc = 0;
+    u32 i = 0;
+    u32 bit = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        crc = i;
+
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+
+        crc32c_table[i] = crc;
+    }
+
+    return;
+}
+
+static u32 crc32c_sw(u32 crc, const u8 *data, size_t len)
+{
+    pthread_once(&crc32c_table_once, crc32c_table_init);
+
+    while (len-- > 0)
+    {
+        crc = crc32c_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef CRC32C_HW
+__attribute__((target("sse4.2"))) static u32 crc32c_hw(u32 crc, const u8 *data, size_t len)
+{
+    uint64_t crc64 = crc;
+    uint64_t chunk = 0;
+
+    while (len >= sizeof(chunk))
+    {
+        memcpy(&chunk, data, sizeof(chunk));
+        crc64 = _mm_crc32_u64(crc64, chunk);
+        data += sizeof(chunk);
+        len -= sizeof(chunk);
+    }
+
+    crc = (u32)crc64;
+
+    while (len-- > 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+
+    return crc;
+}
+#endif
+
+u32 crc32c(u32 crc, const void *data, size_t len)
+{
+    crc = ~crc;
+
+#ifdef CRC32C_HW
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return ~crc32c_hw(crc, (const u8 *)data, len);
+    }
+#endif
+
+    return ~crc32c_sw(crc, (const u8 *)data, len);
+}
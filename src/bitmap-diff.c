@@ -0,0 +1,397 @@
+#include <string.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "bitmap-diff.h"
+#include "bitmap-internal.h"
+#include "bitmap.h"
+
+#define DIFF_MAGIC 0x46494442 /* "BDIF" */
+#define DIFF_VERSION 1
+#define DIFF_HEADER_SIZE 16   /* magic, version, encoding, from and to capacity, reserved, count */
+#define DIFF_RUNS 1           /* count runs of a u16 first word, a u16 length and the XORs */
+#define DIFF_BITS 2           /* count u16 flipped bits, padded to 4 bytes */
+#define DIFF_PAD(len) (((size_t)(len) + 3) & ~(size_t)3)
+
+/*****************************************************************************
+ *
+ *   Name:       get_u16
+ *
+ *   Input:      buf         Two bytes, little endian
+ *   Return:     Success     The value
+ *               Failed      None
+ *   Description            Read a little endian u16 from any address
+ ******************************************************************************/
+static inline u16 get_u16(const u8 *buf);
+
+/*****************************************************************************
+ *
+ *   Name:       get_u32
+ *
+ *   Input:      buf         Four bytes, little endian
+ *   Return:     Success     The value
+ *               Failed      None
+ *   Description            Read a little endian u32 from any address
+ ******************************************************************************/
+static inline u32 get_u32(const u8 *buf);
+
+/*****************************************************************************
+ *
+ *   Name:       put_u16
+ *
+ *   Input:      buf         Gets two bytes
+ *               value       The value
+ *   Return:     Success     buf + 2
+ *               Failed      None
+ *   Description            Write a little endian u16 to any address
+ ******************************************************************************/
+static inline u8 *put_u16(u8 *buf, u32 value);
+
+/*****************************************************************************
+ *
+ *   Name:       put_u32
+ *
+ *   Input:      buf         Gets four bytes
+ *               value       The value
+ *   Return:     Success     buf + 4
+ *               Failed      None
+ *   Description            Write a little endian u32 to any address
+ ******************************************************************************/
+static inline u8 *put_u32(u8 *buf, u32 value);
+
+/*****************************************************************************
+ *
+ *   Name:       diff_word
+ *
+ *   Input:      bm          A valid bitmap
+ *               index       Index of a word, may be past buf_len
+ *   Return:     Success     The word, 0 past buf_len
+ *               Failed      None
+ *   Description            Read a word as if the shorter bitmap was padded with zeros
+ ******************************************************************************/
+static inline u32 diff_word(const struct bitmap *bm, u32 index);
+
+/*****************************************************************************
+ *
+ *   Name:       diff_next
+ *
+ *   Input:      from        The old bitmap
+ *               to          The new bitmap
+ *               index       First word to look at
+ *               words       Words of the longer bitmap
+ *   Return:     Success     Index of the first word from index on that differs, words when
+ *                           none does
+ *               Failed      None
+ *   Description            Skip identical words, 4 at a time while both bitmaps have them
+ ******************************************************************************/
+static u32 diff_next(const struct bitmap *from, const struct bitmap *to, u32 index, u32 words);
+
+/*****************************************************************************
+ *
+ *   Name:       patch_check
+ *
+ *   Input:      patch       The body of a patch, after the header
+ *               len         Size of the body
+ *               encoding    DIFF_RUNS or DIFF_BITS
+ *               count       Number of runs or bits
+ *               words       Words of the longer bitmap
+ *   Return:     Success     true
+ *               Failed      false, the body is short, long, or out of range
+ *   Description            Check a patch before anything is changed
+ ******************************************************************************/
+static bool patch_check(const u8 *patch, size_t len, u8 encoding, u32 count, u32 words);
+
+static inline u16 get_u16(const u8 *buf)
+{
+    return (u16)(buf[0] | (buf[1] << 8));
+}
+
+static inline u32 get_u32(const u8 *buf)
+{
+    return (u32)buf[0] | ((u32)buf[1] << 8) | ((u32)buf[2] << 16) | ((u32)buf[3] << 24);
+}
+
+static inline u8 *put_u16(u8 *buf, u32 value)
+{
+    buf[0] = (u8)value;
+    buf[1] = (u8)(value >> 8);
+
+    return buf + 2;
+}
+
+static inline u8 *put_u32(u8 *buf, u32 value)
+{
+    buf[0] = (u8)value;
+    buf[1] = (u8)(value >> 8);
+    buf[2] = (u8)(value >> 16);
+    buf[3] = (u8)(value >> 24);
+
+    return buf + 4;
+}
+
+static inline u32 diff_word(const struct bitmap *bm, u32 index)
+{
+    return (index < bm->buf_len) ? bm->buf[index] : 0;
+}
+
+static u32 diff_next(const struct bitmap *from, const struct bitmap *to, u32 index, u32 words)
+{
+    const u32 *a = from->buf;
+    const u32 *b = to->buf;
+    u32 common = (from->buf_len < to->buf_len) ? from->buf_len : to->buf_len;
+
+#ifdef __SSE2__
+    while (index + 4 <= common &&
+           _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + index)),
+                                             _mm_loadu_si128((const __m128i *)(b + index)))) ==
+               0xffff)
+    {
+        index += 4;
+    }
+#else
+    while (index + 4 <= common &&
+           ((a[index] ^ b[index]) | (a[index + 1] ^ b[index + 1]) | (a[index + 2] ^ b[index + 2]) |
+            (a[index + 3] ^ b[index + 3])) == 0)
+    {
+        index += 4;
+    }
+#endif
+
+    /* The group that differs, the tail, and the words only the longer bitmap has */
+    while (index < words && diff_word(from, index) == diff_word(to, index))
+    {
+        index++;
+    }
+
+    return index;
+}
+
+static bool patch_check(const u8 *patch, size_t len, u8 encoding, u32 count, u32 words)
+{
+    size_t pos = 0;
+    u32 start = 0;
+    u32 run_len = 0;
+    u32 i = 0;
+
+    if (encoding == DIFF_BITS)
+    {
+        if (len != DIFF_PAD((size_t)count * sizeof(u16)))
+        {
+            return false;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            if (get_u16(patch + i * sizeof(u16)) >= words * BITSIZEOF(u32))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    if (encoding != DIFF_RUNS)
+    {
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (len - pos < 2 * sizeof(u16))
+        {
+            return false;
+        }
+
+        start = get_u16(patch + pos);
+        run_len = get_u16(patch + pos + sizeof(u16));
+        pos += 2 * sizeof(u16);
+
+        if (run_len == 0 || start + run_len > words || len - pos < run_len * sizeof(u32))
+        {
+            return false;
+        }
+
+        pos += run_len * sizeof(u32);
+    }
+
+    return pos == len;
+}
+
+size_t bitmap_diff(const struct bitmap *from, const struct bitmap *to, u8 *buf, size_t len)
+{
+    size_t runs_size = 0;
+    size_t bits_size = 0;
+    size_t size = 0;
+    u8 *pos = NULL;
+    u8 *run = NULL;
+    u32 words = 0;
+    u32 runs = 0;
+    u32 changed = 0;
+    u32 flipped = 0;
+    u32 start = 0;
+    u32 word = 0;
+    u32 i = 0;
+    u8 encoding = DIFF_RUNS;
+
+    if (!bitmap_check(from) || !bitmap_check(to))
+    {
+        return 0;
+    }
+
+    words = (from->buf_len > to->buf_len) ? from->buf_len : to->buf_len;
+
+    /* Size both encodings first */
+    for (i = diff_next(from, to, 0, words); i < words; i = diff_next(from, to, i, words))
+    {
+        runs++;
+
+        while (i < words && (word = diff_word(from, i) ^ diff_word(to, i)) != 0)
+        {
+            changed++;
+            flipped += (u32)__builtin_popcount(word);
+            i++;
+        }
+    }
+
+    runs_size = DIFF_HEADER_SIZE + (size_t)runs * 2 * sizeof(u16) + (size_t)changed * sizeof(u32);
+    bits_size = DIFF_HEADER_SIZE + DIFF_PAD((size_t)flipped * sizeof(u16));
+
+    if (bits_size <= runs_size)
+    {
+        encoding = DIFF_BITS;
+    }
+
+    size = (encoding == DIFF_BITS) ? bits_size : runs_size;
+
+    if (size > len)
+    {
+        return size;
+    }
+
+    pos = put_u32(buf, DIFF_MAGIC);
+    *pos++ = DIFF_VERSION;
+    *pos++ = encoding;
+    pos = put_u16(pos, from->max_value);
+    pos = put_u16(pos, to->max_value);
+    pos = put_u16(pos, 0);
+    pos = put_u32(pos, (encoding == DIFF_BITS) ? flipped : runs);
+
+    for (i = diff_next(from, to, 0, words); i < words; i = diff_next(from, to, i, words))
+    {
+        start = i;
+        run = pos;
+
+        if (encoding == DIFF_RUNS)
+        {
+            pos += 2 * sizeof(u16); /* Filled in once the length is known */
+        }
+
+        while (i < words && (word = diff_word(from, i) ^ diff_word(to, i)) != 0)
+        {
+            if (encoding == DIFF_RUNS)
+            {
+                pos = put_u32(pos, word);
+            }
+            else
+            {
+                for (; word != 0; word &= word - 1)
+                {
+                    pos = put_u16(pos, i * BITSIZEOF(u32) + (u32)__builtin_ctz(word));
+                }
+            }
+
+            i++;
+        }
+
+        if (encoding == DIFF_RUNS)
+        {
+            put_u16(put_u16(run, start), i - start);
+        }
+    }
+
+    memset(pos, 0, size - (size_t)(pos - buf));
+
+    return size;
+}
+
+bool bitmap_patch(struct bitmap *bm, const u8 *patch, size_t len)
+{
+    const u8 *pos = NULL;
+    u32 words = 0;
+    u32 count = 0;
+    u32 start = 0;
+    u32 run_len = 0;
+    u32 value = 0;
+    u32 i = 0;
+    u32 j = 0;
+    u16 from_max = 0;
+    u16 to_max = 0;
+    u8 encoding = 0;
+
+    if (!bitmap_check_writable(bm) || patch == NULL || len < DIFF_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    encoding = patch[5];
+    from_max = get_u16(patch + 6);
+    to_max = get_u16(patch + 8);
+    count = get_u32(patch + 12);
+
+    if (get_u32(patch) != DIFF_MAGIC || patch[4] != DIFF_VERSION || from_max != bm->max_value ||
+        to_max == 0)
+    {
+        return false;
+    }
+
+    words = words_for_capacity((from_max > to_max) ? from_max : to_max);
+    pos = patch + DIFF_HEADER_SIZE;
+
+    if (!patch_check(pos, len - DIFF_HEADER_SIZE, encoding, count, words))
+    {
+        return false;
+    }
+
+    /* Resize first, a shrink drops the words whose changes would be cut off anyway */
+    if (to_max != from_max && !bitmap_resize(bm, to_max))
+    {
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (encoding == DIFF_BITS)
+        {
+            value = get_u16(pos);
+            pos += sizeof(u16);
+
+            if (value / BITSIZEOF(u32) < bm->buf_len)
+            {
+                bm->buf[value / BITSIZEOF(u32)] ^= 1U << (value % BITSIZEOF(u32));
+                bitmap_mark_dirty(bm, (u16)value);
+            }
+
+            continue;
+        }
+
+        start = get_u16(pos);
+        run_len = get_u16(pos + sizeof(u16));
+        pos += 2 * sizeof(u16);
+
+        for (j = start; j < start + run_len && j < bm->buf_len; j++)
+        {
+            bm->buf[j] ^= get_u32(pos + (j - start) * sizeof(u32));
+            bitmap_mark_dirty(bm, (u16)(j * BITSIZEOF(u32)));
+        }
+
+        pos += run_len * sizeof(u32);
+    }
+
+    clear_tail_bits(bm);
+    update_info(bm);
+
+    return true;
+}
@@ -0,0 +1,264 @@
+#include <string.h>
+
+#include "bitmap-format.h"
+#include "bitmap-internal.h"
+#include "bitmap.h"
+
+#define ENTRY_MAX_LEN 12 /* ",65533-65534" */
+
+static const char hex_chars[16] = "0123456789abcdef";
+
+/* "00" to "99", two digits per lookup */
+static const char decimal_pairs[200] = "00010203040506070809"
+                                       "10111213141516171819"
+                                       "20212223242526272829"
+                                       "30313233343536373839"
+                                       "40414243444546474849"
+                                       "50515253545556575859"
+                                       "60616263646566676869"
+                                       "70717273747576777879"
+                                       "80818283848586878889"
+                                       "90919293949596979899";
+
+/*****************************************************************************
+ *
+ *   Name:       format_decimal
+ *
+ *   Input:      out         Gets the digits, room for 5
+ *               value       The value that will be formatted
+ *   Return:     Success     Number of digits written
+ *               Failed      None
+ *   Description            Write a value in decimal, two digits at a time
+ ******************************************************************************/
+static inline u32 format_decimal(char *out, u32 value);
+
+/*****************************************************************************
+ *
+ *   Name:       format_entry
+ *
+ *   Input:      out         Gets the entry, room for ENTRY_MAX_LEN
+ *               start       First value of the run
+ *               end         Last value of the run
+ *               separator   Write an entry separator first
+ *   Return:     Success     Number of bytes written
+ *               Failed      None
+ *   Description            Write one entry of a range list
+ ******************************************************************************/
+static inline u32 format_entry(char *out, u32 start, u32 end, bool separator);
+
+/*****************************************************************************
+ *
+ *   Name:       format_hex_group
+ *
+ *   Input:      out         Gets the digits
+ *               word        The word that will be formatted
+ *               digits      Number of digits, the low ones of word
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Write a word as a fixed number of hex digits
+ ******************************************************************************/
+static inline void format_hex_group(char *out, u32 word, u32 digits);
+
+static inline u32 format_decimal(char *out, u32 value)
+{
+    char digits[8];
+    u32 pos = sizeof(digits);
+    u32 len = 0;
+
+    /* Fill from the end, then copy out the used part */
+    while (value >= 100)
+    {
+        pos -= 2;
+        memcpy(digits + pos, decimal_pairs + (value % 100) * 2, 2);
+        value /= 100;
+    }
+
+    if (value >= 10)
+    {
+        pos -= 2;
+        memcpy(digits + pos, decimal_pairs + value * 2, 2);
+    }
+    else
+    {
+        digits[--pos] = (char)('0' + value);
+    }
+
+    len = sizeof(digits) - pos;
+    memcpy(out, digits + pos, len);
+
+    return len;
+}
+
+static inline u32 format_entry(char *out, u32 start, u32 end, bool separator)
+{
+    u32 len = 0;
+
+    if (separator)
+    {
+        out[len++] = CHAR_ENTRY_SEPARATOR;
+    }
+
+    len += format_decimal(out + len, start);
+
+    if (end != start)
+    {
+        out[len++] = CHAR_RANGE_SEPARATOR;
+        len += format_decimal(out + len, end);
+    }
+
+    return len;
+}
+
+static inline void format_hex_group(char *out, u32 word, u32 digits)
+{
+    while (digits-- > 0)
+    {
+        out[digits] = hex_chars[word & 0xf];
+        word >>= 4;
+    }
+
+    return;
+}
+
+size_t bitmap_format_hex(const struct bitmap *bm, char *buf, size_t len)
+{
+    char group[HEX_GROUP_DIGITS + 1];
+    size_t needed = 0;
+    size_t pos = 0;
+    size_t copy = 0;
+    u32 top_bits = 0;
+    u32 digits = 0;
+    u32 i = 0;
+
+    if (len > 0)
+    {
+        buf[0] = CHAR_NULL;
+    }
+
+    if (!bitmap_check(bm) || bm->buf_len == 0)
+    {
+        return 0;
+    }
+
+    top_bits = bm->max_value - (u32)(bm->buf_len - 1) * BITSIZEOF(u32);
+    digits = (top_bits + 3) / 4;
+    needed = digits + (size_t)(bm->buf_len - 1) * (HEX_GROUP_DIGITS + 1);
+
+    /* Most significant word first, every later group starts with its separator */
+    format_hex_group(group, bm->buf[bm->buf_len - 1], digits);
+
+    for (i = bm->buf_len - 1;; i--)
+    {
+        if (len > 0 && pos < len - 1)
+        {
+            copy = (len - 1 - pos < digits) ? len - 1 - pos : digits;
+            memcpy(buf + pos, group, copy);
+        }
+
+        pos += digits;
+
+        if (i == 0)
+        {
+            break;
+        }
+
+        group[0] = HEX_GROUP_SEPARATOR;
+        format_hex_group(group + 1, bm->buf[i - 1], HEX_GROUP_DIGITS);
+        digits = HEX_GROUP_DIGITS + 1;
+    }
+
+    if (len > 0)
+    {
+        buf[(needed < len) ? needed : len - 1] = CHAR_NULL;
+    }
+
+    return needed;
+}
+
+size_t bitmap_format(const struct bitmap *bm, char *buf, size_t len)
+{
+    char entry[ENTRY_MAX_LEN];
+    size_t pos = 0;
+    size_t copy = 0;
+    u32 entry_len = 0;
+    u32 start = 0;
+    u32 end = 0;
+
+    if (len > 0)
+    {
+        buf[0] = CHAR_NULL;
+    }
+
+    if (!bitmap_check(bm))
+    {
+        return 0;
+    }
+
+    while (bitmap_next_run(bm, start, &start, &end))
+    {
+        if (pos + ENTRY_MAX_LEN < len)
+        {
+            /* Enough room left, write in place */
+            pos += format_entry(buf + pos, start, end, pos > 0);
+        }
+        else
+        {
+            entry_len = format_entry(entry, start, end, pos > 0);
+
+            if (pos < len)
+            {
+                copy = (len - 1 - pos < entry_len) ? len - 1 - pos : entry_len;
+                memcpy(buf + pos, entry, copy);
+            }
+
+            pos += entry_len;
+        }
+
+        start = end + 2; /* end + 1 is clear */
+    }
+
+    if (len > 0)
+    {
+        buf[(pos < len) ? pos : len - 1] = CHAR_NULL;
+    }
+
+    return pos;
+}
+
+void bitmap_format_init(struct bitmap_format_state *state)
+{
+    state->next = 0;
+    state->started = false;
+
+    return;
+}
+
+size_t bitmap_format_next(const struct bitmap *bm, struct bitmap_format_state *state, char *buf,
+                          size_t len)
+{
+    size_t pos = 0;
+    u32 start = 0;
+    u32 end = 0;
+
+    if (state == NULL || buf == NULL || len < BITMAP_FORMAT_CHUNK_MIN || !bitmap_check(bm))
+    {
+        return 0;
+    }
+
+    while (pos + ENTRY_MAX_LEN < len && bitmap_next_run(bm, state->next, &start, &end))
+    {
+        pos += format_entry(buf + pos, start, end, state->started);
+        state->next = end + 2; /* end + 1 is clear */
+        state->started = true;
+    }
+
+    if (pos == 0)
+    {
+        /* Nothing left, stay done on later calls */
+        state->next = (u32)bm->max_value + 1;
+    }
+
+    buf[pos] = CHAR_NULL;
+
+    return pos;
+}
@@ -0,0 +1,320 @@
+#ifndef __BITMAP_INTERNAL_H__
+#define __BITMAP_INTERNAL_H__
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "bitmap.h"
+
+/* Shared by the src/bitmap*.c files only, not part of the public interface */
+
+#ifdef DEBUG
+    #define debug(fmt, ...) printf("%s:%d %s => " fmt, __FILE__, __LINE__, __func__, ##__VA_ARGS__);
+#else
+    #define debug(fmt, ...)
+#endif
+
+#ifdef BITMAP_STATS
+    /* Count and time the rest of the enclosing function, see bitmap-stats.h */
+    #define STATS_SCOPE(op)                                                                        \
+        struct stats_scope stats_scope __attribute__((cleanup(stats_scope_end))) = {              \
+            (op), 0, stats_now_ns()}
+    #define STATS_WORDS(n) (stats_scope.words = (u32)(n))
+#else
+    #define STATS_SCOPE(op)
+    #define STATS_WORDS(n)
+#endif
+
+#define BITSIZEOF(type) (CHAR_BIT * sizeof(type))
+#define CHAR_SPACE ' '
+#define CHAR_NULL '\0'
+#define CHAR_ENTRY_SEPARATOR ','
+#define CHAR_RANGE_SEPARATOR '-'
+#define HEX_GROUP_DIGITS 8 /* A group of a hex mask is one u32 word */
+#define HEX_GROUP_SEPARATOR ','
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_check
+ *
+ *   Input:      bm          A bitmap that need to check
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Check a bitmap whether it's exist
+ ******************************************************************************/
+bool bitmap_check(const struct bitmap *bm);
+
+/*****************************************************************************
+ *
+ *   Name:       update_info
+ *
+ *   Input:      bm          A bitmap that need to check
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Update bitmap first_value, last_value and numbers
+ ******************************************************************************/
+void update_info(struct bitmap *bm);
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_check_writable
+ *
+ *   Input:      bm          A bitmap that need to check
+ *   Return:     Success     true
+ *               Failed      false, invalid or read-only
+ *   Description            bitmap_check for the functions that change a bitmap
+ ******************************************************************************/
+static inline bool bitmap_check_writable(const struct bitmap *bm)
+{
+    return bitmap_check(bm) && !(bm->flags & BITMAP_FLAG_READONLY);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       words_for_capacity
+ *
+ *   Input:      capacity    Number of bits
+ *   Return:     Success     Number of u32 words needed to hold capacity bits
+ *               Failed      None
+ *   Description            Calculate the buf_len of a bitmap
+ ******************************************************************************/
+static inline u16 words_for_capacity(u16 capacity)
+{
+    return (u16)((capacity + BITSIZEOF(u32) - 1) / BITSIZEOF(u32));
+}
+
+/*****************************************************************************
+ *
+ *   Name:       clear_tail_bits
+ *
+ *   Input:      bm          A bitmap whose last word will be masked
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Clear the bits of the last word at or above max_value
+ ******************************************************************************/
+static inline void clear_tail_bits(struct bitmap *bm)
+{
+    u32 num_bits_in_last_buf = 0;
+
+    num_bits_in_last_buf = (bm->max_value % BITSIZEOF(u32));
+
+    if (num_bits_in_last_buf != 0)
+    {
+        bm->buf[bm->buf_len - 1] &= (1U << num_bits_in_last_buf) - 1;
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       mark_all_dirty
+ *
+ *   Input:      bm          A bitmap whose words all changed
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Mark every block for replication, bits past the last block
+ *                           are ignored
+ ******************************************************************************/
+static inline void mark_all_dirty(struct bitmap *bm)
+{
+    u32 i = 0;
+
+    for (i = 0; i < BITMAP_DIRTY_LEN; i++)
+    {
+        bm->dirty[i] = UINT64_MAX;
+    }
+
+    return;
+}
+
+/* Called for every entry of a range list, a single value has start == end */
+typedef bool (*range_emit_t)(void *ctx, u16 start, u16 end);
+
+/* Resumable "1-3,5" range list scanner, input can be fed in pieces of any size */
+struct range_parser
+{
+    u32 value;       /* The number being read */
+    u32 range_start; /* First number of the range being read */
+    size_t offset;   /* Offset of the next input byte, or of the bad byte after an error */
+    u8 state;
+    bool in_range;
+    bool has_entry;
+    bool allow_newline; /* Treat '\n' and '\r' like spaces, for files */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       range_parser_init
+ *
+ *   Input:      parser      The parser that will be reset
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Prepare a parser for a new range list
+ ******************************************************************************/
+void range_parser_init(struct range_parser *parser);
+
+/*****************************************************************************
+ *
+ *   Name:       range_parser_feed
+ *
+ *   Input:      parser      The parser
+ *               buf         The next piece of the range list
+ *               len         Number of bytes in buf
+ *               emit        Called for each complete entry
+ *               ctx         Passed to emit
+ *   Return:     Success     true
+ *               Failed      false, invalid input or emit failed, see parser->offset
+ *   Description            Scan a piece of a range list, an entry split across two
+ *                           pieces is emitted once the second piece completes it
+ ******************************************************************************/
+bool range_parser_feed(struct range_parser *parser, const u8 *buf, size_t len, range_emit_t emit,
+                       void *ctx);
+
+/*****************************************************************************
+ *
+ *   Name:       range_parser_finish
+ *
+ *   Input:      parser      The parser
+ *               emit        Called for the last entry
+ *               ctx         Passed to emit
+ *   Return:     Success     true
+ *               Failed      false, the list is empty or ends in the middle of an entry
+ *   Description            Signal the end of the input
+ ******************************************************************************/
+bool range_parser_finish(struct range_parser *parser, range_emit_t emit, void *ctx);
+
+/*****************************************************************************
+ *
+ *   Name:       fill_words
+ *
+ *   Input:      words       A word array that will get bits set
+ *               start       First bit to set
+ *               end         Last bit to set
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Set bits [start, end] a whole word at a time
+ ******************************************************************************/
+void fill_words(u32 *words, u16 start, u16 end);
+
+/*****************************************************************************
+ *
+ *   Name:       crc32c
+ *
+ *   Input:      crc         0, or the result for the data before this piece
+ *               data        The data
+ *               len         Number of bytes in data
+ *   Return:     Success     CRC32C (Castagnoli) of everything so far
+ *               Failed      None
+ *   Description            Checksum for the on-disk formats, uses the SSE4.2 crc32
+ *                           instruction when the CPU has it
+ ******************************************************************************/
+u32 crc32c(u32 crc, const void *data, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       sync_dir
+ *
+ *   Input:      path        A file that was just created or renamed, the buffer is changed
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            fsync the directory of path, so its entry survives a crash
+ ******************************************************************************/
+bool sync_dir(char *path);
+
+#ifdef BITMAP_STATS
+/* A call being timed by STATS_SCOPE */
+struct stats_scope
+{
+    u32 op;    /* enum bitmap_stats_op */
+    u32 words; /* Set by STATS_WORDS */
+    uint64_t start_ns;
+};
+
+/*****************************************************************************
+ *
+ *   Name:       stats_now_ns
+ *
+ *   Input:      None
+ *   Return:     Success     A monotonic time in nanoseconds
+ *               Failed      None
+ *   Description            Clock of the latency histograms
+ ******************************************************************************/
+uint64_t stats_now_ns(void);
+
+/*****************************************************************************
+ *
+ *   Name:       stats_scope_end
+ *
+ *   Input:      scope       The call that returns
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Add a call to the counters of the calling thread
+ ******************************************************************************/
+void stats_scope_end(struct stats_scope *scope);
+#endif
+
+/*****************************************************************************
+ *
+ *   Name:       bitmap_next_run
+ *
+ *   Input:      bm          A valid bitmap
+ *               from        First value to look at
+ *               start       Gets the first value of the run
+ *               end         Gets the last value of the run
+ *   Return:     Success     true
+ *               Failed      false, there is no value at or after from
+ *   Description            Find the next run of set bits, a word at a time
+ ******************************************************************************/
+static inline bool bitmap_next_run(const struct bitmap *bm, u32 from, u32 *start, u32 *end)
+{
+    u32 index = 0;
+    u32 word = 0;
+
+    if (bm->numbers == 0 || from > bm->last_value)
+    {
+        return false;
+    }
+
+    if (from < bm->first_value)
+    {
+        from = bm->first_value;
+    }
+
+    /* First set bit at or after from */
+    index = from / BITSIZEOF(u32);
+    word = bm->buf[index] & (UINT32_MAX << (from % BITSIZEOF(u32)));
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            return false;
+        }
+
+        word = bm->buf[index];
+    }
+
+    *start = index * BITSIZEOF(u32) + (u32)__builtin_ctz(word);
+
+    /* First clear bit after it, bits past max_value are always clear */
+    word = ~bm->buf[index] & (UINT32_MAX << (*start % BITSIZEOF(u32)));
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            *end = (u32)bm->buf_len * BITSIZEOF(u32) - 1;
+            return true;
+        }
+
+        word = ~bm->buf[index];
+    }
+
+    *end = index * BITSIZEOF(u32) + (u32)__builtin_ctz(word) - 1;
+
+    return true;
+}
+
+#endif /* __BITMAP_INTERNAL_H__ */
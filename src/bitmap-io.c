@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-io.h"
+#include "bitmap.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error "bitmap files are little endian, add byte swapping for this target"
+#endif
+
+#define TMP_SUFFIX ".tmp"
+
+/*****************************************************************************
+ *
+ *   Name:       read_full
+ *
+ *   Input:      fd          A file descriptor
+ *               buf         Gets the data
+ *               len         Number of bytes to read
+ *   Return:     Success     true
+ *               Failed      false, error or end of file first
+ *   Description            read until len bytes arrived
+ ******************************************************************************/
+static bool read_full(int fd, void *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       writev_full
+ *
+ *   Input:      fd          A file descriptor
+ *               iov         The pieces to write, updated as they go out
+ *               iovcnt      Number of pieces
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            writev until every piece was written
+ ******************************************************************************/
+static bool writev_full(int fd, struct iovec *iov, int iovcnt);
+
+/*****************************************************************************
+ *
+ *   Name:       header_crc
+ *
+ *   Input:      header      A file header
+ *   Return:     Success     CRC32C of the header up to header_crc
+ *               Failed      None
+ *   Description            Checksum of a file header
+ ******************************************************************************/
+static inline u32 header_crc(const struct bitmap_file_header *header);
+
+static bool read_full(int fd, void *buf, size_t len)
+{
+    ssize_t ret = 0;
+    u8 *pos = (u8 *)buf;
+
+    while (len > 0)
+    {
+        ret = read(fd, pos, len);
+
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (ret <= 0)
+        {
+            return false;
+        }
+
+        pos += ret;
+        len -= (size_t)ret;
+    }
+
+    return true;
+}
+
+static bool writev_full(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t ret = 0;
+    size_t done = 0;
+
+    while (iovcnt > 0)
+    {
+        ret = writev(fd, iov, iovcnt);
+
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (ret < 0)
+        {
+            return false;
+        }
+
+        /* Skip what went out, usually everything */
+        done = (size_t)ret;
+
+        while (iovcnt > 0 && done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (u8 *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    return true;
+}
+
+static inline u32 header_crc(const struct bitmap_file_header *header)
+{
+    return crc32c(0, header, offsetof(struct bitmap_file_header, header_crc));
+}
+
+bool bitmap_file_header_check(const struct bitmap_file_header *header)
+{
+    if (header == NULL || header->magic != BITMAP_FILE_MAGIC)
+    {
+        return false;
+    }
+
+    if (header->version > BITMAP_FILE_VERSION || header->header_size != BITMAP_FILE_HEADER_SIZE ||
+        header->word_size != sizeof(u32))
+    {
+        debug("Unsupported version %u\n", header->version);
+        return false;
+    }
+
+    if (header->header_crc != header_crc(header))
+    {
+        debug("Header checksum mismatch\n");
+        return false;
+    }
+
+    if (header->max_value == 0 || header->buf_len != words_for_capacity(header->max_value) ||
+        header->numbers > header->max_value)
+    {
+        return false;
+    }
+
+    if (header->numbers != 0 &&
+        (header->first_value > header->last_value || header->last_value >= header->max_value))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool bitmap_save(const struct bitmap *bm, int fd)
+{
+    struct bitmap_file_header header;
+    struct iovec iov[2];
+
+    if (!bitmap_check(bm) || fd < 0)
+    {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = BITMAP_FILE_MAGIC;
+    header.version = BITMAP_FILE_VERSION;
+    header.header_size = BITMAP_FILE_HEADER_SIZE;
+    header.word_size = sizeof(u32);
+    header.max_value = bm->max_value;
+    header.numbers = bm->numbers;
+    header.first_value = bm->first_value;
+    header.last_value = bm->last_value;
+    header.buf_len = bm->buf_len;
+    header.flags = bm->flags & BITMAP_FLAG_AUTOGROW;
+    header.words_crc = crc32c(0, bm->buf, bm->buf_len * sizeof(u32));
+    header.header_crc = header_crc(&header);
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = bm->buf;
+    iov[1].iov_len = bm->buf_len * sizeof(u32);
+
+    return writev_full(fd, iov, 2);
+}
+
+struct bitmap *bitmap_load(int fd)
+{
+    struct bitmap_file_header header;
+    struct bitmap *bm = NULL;
+    u32 tail_bits = 0;
+
+    if (fd < 0 || !read_full(fd, &header, sizeof(header)) || !bitmap_file_header_check(&header))
+    {
+        return NULL;
+    }
+
+    bm = bitmap_create(header.max_value);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    if (!read_full(fd, bm->buf, bm->buf_len * sizeof(u32)) ||
+        (!(header.flags & BITMAP_FILE_FLAG_DIRTY) &&
+         crc32c(0, bm->buf, bm->buf_len * sizeof(u32)) != header.words_crc))
+    {
+        debug("Words missing or corrupted\n");
+        goto failed;
+    }
+
+    tail_bits = bm->max_value % BITSIZEOF(u32);
+
+    if (tail_bits != 0 && (bm->buf[bm->buf_len - 1] >> tail_bits) != 0)
+    {
+        goto failed;
+    }
+
+    bm->flags |= header.flags & BITMAP_FLAG_AUTOGROW;
+
+    if (header.flags & BITMAP_FILE_FLAG_DIRTY)
+    {
+        /* The writer did not get to its next checkpoint */
+        update_info(bm);
+        return bm;
+    }
+
+    /* The checksum covers the words and the header, trust the saved summary */
+    bm->numbers = header.numbers;
+    bm->first_value = header.first_value;
+    bm->last_value = header.last_value;
+
+    return bm;
+
+failed:
+    bitmap_destroy(bm);
+
+    return NULL;
+}
+
+bool sync_dir(char *path)
+{
+    int fd = -1;
+    bool ret = false;
+
+    fd = open(dirname(path), O_RDONLY | O_DIRECTORY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    ret = fsync(fd) == 0;
+    close(fd);
+
+    return ret;
+}
+
+bool bitmap_save_file(const struct bitmap *bm, const char *path)
+{
+    char *tmp_path = NULL;
+    size_t path_len = 0;
+    int fd = -1;
+    bool ret = false;
+
+    if (path == NULL)
+    {
+        return false;
+    }
+
+    path_len = strlen(path);
+    tmp_path = (char *)malloc(path_len + sizeof(TMP_SUFFIX));
+
+    if (tmp_path == NULL)
+    {
+        return false;
+    }
+
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, TMP_SUFFIX, sizeof(TMP_SUFFIX));
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        goto cleanup;
+    }
+
+    if (!bitmap_save(bm, fd) || fsync(fd) != 0)
+    {
+        close(fd);
+        unlink(tmp_path);
+        goto cleanup;
+    }
+
+    close(fd);
+
+    if (rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        goto cleanup;
+    }
+
+    /* Until the directory is synced a crash can bring back the old file */
+    memcpy(tmp_path, path, path_len + 1);
+    ret = sync_dir(tmp_path);
+
+cleanup:
+    free(tmp_path);
+
+    return ret;
+}
+
+struct bitmap *bitmap_load_file(const char *path)
+{
+    struct bitmap *bm = NULL;
+    int fd = -1;
+
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    bm = bitmap_load(fd);
+    close(fd);
+
+    return bm;
+}
@@ -0,0 +1,239 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-io.h"
+#include "bitmap-mmap.h"
+#include "bitmap.h"
+
+/*****************************************************************************
+ *
+ *   Name:       header_seal
+ *
+ *   Input:      header      A mapped file header
+ *               flags       New value of header->flags
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Update the header flags and checksum and wait until the header
+ *                           is on disk
+ ******************************************************************************/
+static bool header_seal(struct bitmap_file_header *header, u16 flags);
+
+/*****************************************************************************
+ *
+ *   Name:       map_checkpoint
+ *
+ *   Input:      mapped      A writable mapping
+ *               keep_dirty  The writer goes on, mark the file dirty again
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Flush the words, then store the summary and the checksum in the
+ *                           header and flush it
+ ******************************************************************************/
+static bool map_checkpoint(struct bitmap_mapped *mapped, bool keep_dirty);
+
+static bool header_seal(struct bitmap_file_header *header, u16 flags)
+{
+    header->flags = flags;
+    header->header_crc = crc32c(0, header, offsetof(struct bitmap_file_header, header_crc));
+
+    /* The header is at the start of the mapping, so it is page aligned */
+    return msync(header, sizeof(*header), MS_SYNC) == 0;
+}
+
+bool bitmap_map_file(struct bitmap_mapped *mapped, const char *path, int mode)
+{
+    struct bitmap_file_header *header = NULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    u32 *words = NULL;
+    size_t words_size = 0;
+    u32 tail_bits = 0;
+    int fd = -1;
+    int prot = PROT_READ;
+
+    if (mapped == NULL || path == NULL)
+    {
+        return false;
+    }
+
+    fd = open(path, (mode & BITMAP_MAP_WRITE) ? O_RDWR : O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct bitmap_file_header))
+    {
+        goto failed;
+    }
+
+    if (mode & BITMAP_MAP_WRITE)
+    {
+        prot |= PROT_WRITE;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        goto failed;
+    }
+
+    header = (struct bitmap_file_header *)map;
+
+    if (!bitmap_file_header_check(header))
+    {
+        goto failed;
+    }
+
+    words_size = header->buf_len * sizeof(u32);
+
+    if ((size_t)st.st_size < header->header_size + words_size)
+    {
+        goto failed;
+    }
+
+    words = (u32 *)((u8 *)map + header->header_size);
+
+    if ((mode & BITMAP_MAP_VERIFY) && !(header->flags & BITMAP_FILE_FLAG_DIRTY) &&
+        crc32c(0, words, words_size) != header->words_crc)
+    {
+        debug("Words checksum mismatch\n");
+        goto failed;
+    }
+
+    /* Bits past the capacity would be counted like values, bitmap_load rejects them too */
+    tail_bits = header->max_value % BITSIZEOF(u32);
+
+    if (tail_bits != 0 && (words[header->buf_len - 1] >> tail_bits) != 0)
+    {
+        debug("Bits set past the capacity\n");
+        goto failed;
+    }
+
+    /* Like bitmap_init_external, without the scan when the header summary is good */
+    mapped->bm.bm_self = &mapped->bm;
+    mapped->bm.buf = words;
+    mapped->bm.allocator = NULL;
+    mapped->bm.max_value = header->max_value;
+    mapped->bm.buf_len = header->buf_len;
+    mapped->bm.flags = BITMAP_FLAG_EXTERNAL;
+    mark_all_dirty(&mapped->bm);
+
+    if (!(mode & BITMAP_MAP_WRITE))
+    {
+        mapped->bm.flags |= BITMAP_FLAG_READONLY;
+    }
+
+    if (header->flags & BITMAP_FILE_FLAG_DIRTY)
+    {
+        update_info(&mapped->bm);
+    }
+    else
+    {
+        mapped->bm.numbers = header->numbers;
+        mapped->bm.first_value = header->first_value;
+        mapped->bm.last_value = header->last_value;
+    }
+
+    /* Mark the file before the first change can reach it */
+    if ((mode & BITMAP_MAP_WRITE) && !(header->flags & BITMAP_FILE_FLAG_DIRTY) &&
+        !header_seal(header, header->flags | BITMAP_FILE_FLAG_DIRTY))
+    {
+        goto failed;
+    }
+
+    mapped->header = header;
+    mapped->map_len = (size_t)st.st_size;
+    mapped->fd = fd;
+    mapped->mode = mode;
+
+    return true;
+
+failed:
+    if (map != MAP_FAILED)
+    {
+        munmap(map, (size_t)st.st_size);
+    }
+
+    close(fd);
+
+    return false;
+}
+
+static bool map_checkpoint(struct bitmap_mapped *mapped, bool keep_dirty)
+{
+    struct bitmap_file_header *header = NULL;
+    struct bitmap *bm = NULL;
+
+    header = mapped->header;
+    bm = &mapped->bm;
+
+    /* Words first, a crash before the header is written leaves the file dirty */
+    if (msync(header, mapped->map_len, MS_SYNC) != 0)
+    {
+        return false;
+    }
+
+    header->numbers = bm->numbers;
+    header->first_value = bm->first_value;
+    header->last_value = bm->last_value;
+    header->words_crc = crc32c(0, bm->buf, bm->buf_len * sizeof(u32));
+
+    if (!header_seal(header, header->flags & ~BITMAP_FILE_FLAG_DIRTY))
+    {
+        return false;
+    }
+
+    /* Back to dirty for the changes after this checkpoint */
+    return !keep_dirty || header_seal(header, header->flags | BITMAP_FILE_FLAG_DIRTY);
+}
+
+bool bitmap_map_sync(struct bitmap_mapped *mapped)
+{
+    if (mapped == NULL || !(mapped->mode & BITMAP_MAP_WRITE) || !bitmap_check(&mapped->bm))
+    {
+        return false;
+    }
+
+    return map_checkpoint(mapped, true);
+}
+
+struct bitmap *bitmap_map_refresh(struct bitmap_mapped *mapped)
+{
+    if (mapped == NULL || mapped->header == NULL || !bitmap_check(&mapped->bm))
+    {
+        return NULL;
+    }
+
+    update_info(&mapped->bm);
+
+    return &mapped->bm;
+}
+
+bool bitmap_unmap(struct bitmap_mapped *mapped)
+{
+    bool ret = true;
+
+    if (mapped == NULL || mapped->header == NULL)
+    {
+        return false;
+    }
+
+    if (mapped->mode & BITMAP_MAP_WRITE)
+    {
+        ret = bitmap_check(&mapped->bm) && map_checkpoint(mapped, false);
+    }
+
+    munmap(mapped->header, mapped->map_len);
+    close(mapped->fd);
+    mapped->header = NULL;
+    mapped->bm.bm_self = NULL;
+
+    return ret;
+}
@@ -0,0 +1,902 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-parse.h"
+#include "bitmap.h"
+
+#define IS_DIGIT(c) ((u8)((c) - '0') < 10)
+#define IS_SPACE(parser, c)                                                                        \
+    ((c) == CHAR_SPACE || ((parser)->allow_newline && ((c) == '\n' || (c) == '\r')))
+#define WORDS_MAX ((UINT16_MAX + 31) / 32) /* Words of the largest possible bitmap */
+#define PARSE_CHUNK_SIZE (16 * 1024)
+#define PARSE_MAX_THREADS 64
+#define PARSE_MIN_SEGMENT (256 * 1024) /* Smaller pieces are not worth a thread */
+
+enum parse_state
+{
+    PARSE_ENTRY,        /* Before the first number of an entry */
+    PARSE_NUMBER,       /* Inside a number */
+    PARSE_AFTER_NUMBER, /* After a number, before ',' '-' or the end */
+    PARSE_RANGE_END,    /* After '-', before the second number of a range */
+    PARSE_ERROR,
+};
+
+/* Scratch space of bitmap_parse_str, big enough for any u16 range list */
+struct parse_words
+{
+    u32 words[WORDS_MAX];
+    u32 zeroed;    /* words[0 .. zeroed) have been cleared */
+    u16 max_value; /* Largest value seen */
+};
+
+/* State of the stream parsers, the bitmap grows with the values */
+struct parse_growing
+{
+    struct bitmap *bm;
+    u16 max_value;
+};
+
+/* One piece of a parallel parse, it starts right after an entry separator */
+struct parse_segment
+{
+    const u8 *str;
+    size_t len;
+    size_t base; /* Offset of str in the whole input */
+    bool allow_newline;
+    struct parse_words scratch; /* The partial bitmap of this piece */
+    bool has_entry;
+    bool failed;
+    size_t error_offset; /* Offset in the whole input */
+};
+
+/* Value + 1 of each hex digit, 0 for anything else */
+static const u8 hex_digit[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,  ['6'] = 7,
+    ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14,
+    ['e'] = 15, ['f'] = 16, ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15,
+    ['F'] = 16,
+};
+
+/* Reads up to len bytes, returns the count, 0 at the end or -1 on error */
+typedef ssize_t (*read_chunk_t)(void *src, u8 *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       emit_entry
+ *
+ *   Input:      parser      A parser that just finished reading an entry
+ *               emit        Called with the entry
+ *               ctx         Passed to emit
+ *   Return:     Success     true
+ *               Failed      false, the range is reversed or emit failed
+ *   Description            Hand a finished single value or range to emit
+ ******************************************************************************/
+static bool emit_entry(struct range_parser *parser, range_emit_t emit, void *ctx);
+
+/*****************************************************************************
+ *
+ *   Name:       emit_words
+ *
+ *   Input:      ctx         struct parse_words
+ *               start       First value of the entry
+ *               end         Last value of the entry
+ *   Return:     Success     true
+ *               Failed      None
+ *   Description            Set an entry in the scratch words, clearing them lazily
+ ******************************************************************************/
+static bool emit_words(void *ctx, u16 start, u16 end);
+
+/*****************************************************************************
+ *
+ *   Name:       emit_growing
+ *
+ *   Input:      ctx         struct parse_growing
+ *               start       First value of the entry
+ *               end         Last value of the entry
+ *   Return:     Success     true
+ *               Failed      false, the bitmap could not be created or grown
+ *   Description            Set an entry in a bitmap, growing it when end does not fit
+ ******************************************************************************/
+static bool emit_growing(void *ctx, u16 start, u16 end);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_stream
+ *
+ *   Input:      read_chunk  Reads the next piece of input from src
+ *               src         The input
+ *   Return:     Success     A bitmap that stores the data from the input
+ *               Failed      NULL
+ *   Description            Parse a range list read piece by piece
+ ******************************************************************************/
+static struct bitmap *parse_stream(read_chunk_t read_chunk, void *src);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_segment_worker
+ *
+ *   Input:      arg         struct parse_segment
+ *   Return:     Success     NULL
+ *               Failed      NULL, with segment->failed set
+ *   Description            Parse one piece of a parallel parse into its own words
+ ******************************************************************************/
+static void *parse_segment_worker(void *arg);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_parallel
+ *
+ *   Input:      str         The range list
+ *               len         Number of bytes in str
+ *               threads     Number of threads, 0 for one per online CPU
+ *               allow_newline Treat line breaks like spaces
+ *               error_offset Gets the offset of the first invalid byte, may be NULL
+ *   Return:     Success     A bitmap that stores the data from str
+ *               Failed      NULL
+ *   Description            Split a range list at entry separators, parse the pieces in
+ *                           threads and OR the partial results together
+ ******************************************************************************/
+static struct bitmap *parse_parallel(const u8 *str, size_t len, u32 threads, bool allow_newline,
+                                     size_t *error_offset);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_hex_group
+ *
+ *   Input:      str         First digit of the group
+ *               len         Number of digits, 1 to 8
+ *               word        Gets the value of the group
+ *   Return:     Success     true
+ *               Failed      false, str holds something else than hex digits
+ *   Description            Convert one group of a hex mask to a word
+ ******************************************************************************/
+static inline bool parse_hex_group(const u8 *str, size_t len, u32 *word);
+
+static ssize_t read_file(void *src, u8 *buf, size_t len);
+static ssize_t read_fd(void *src, u8 *buf, size_t len);
+
+void range_parser_init(struct range_parser *parser)
+{
+    memset(parser, 0, sizeof(struct range_parser));
+    parser->state = PARSE_ENTRY;
+
+    return;
+}
+
+static bool emit_entry(struct range_parser *parser, range_emit_t emit, void *ctx)
+{
+    u16 start = 0;
+
+    start = (u16)(parser->in_range ? parser->range_start : parser->value);
+
+    if (start > parser->value)
+    {
+        debug("Invalid range: Range start is less than range end!\n");
+        return false;
+    }
+
+    parser->in_range = false;
+    parser->has_entry = true;
+
+    return emit(ctx, start, (u16)parser->value);
+}
+
+bool range_parser_feed(struct range_parser *parser, const u8 *buf, size_t len, range_emit_t emit,
+                       void *ctx)
+{
+    size_t i = 0;
+    u32 value = 0;
+    u8 c = 0;
+
+    if (parser->state == PARSE_ERROR)
+    {
+        return false;
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        c = buf[i];
+
+        switch (parser->state)
+        {
+            case PARSE_ENTRY:
+            case PARSE_RANGE_END:
+                if (IS_SPACE(parser, c))
+                {
+                    continue;
+                }
+
+                if (!IS_DIGIT(c))
+                {
+                    goto error;
+                }
+
+                parser->value = 0;
+                parser->state = PARSE_NUMBER;
+                /* fall through */
+
+            case PARSE_NUMBER:
+                if (IS_DIGIT(c))
+                {
+                    /* Read the whole number here instead of once around the loop per digit */
+                    value = parser->value;
+
+                    while (i < len && IS_DIGIT(buf[i]))
+                    {
+                        value = value * 10 + (u32)(buf[i] - '0');
+
+                        if (value >= UINT16_MAX)
+                        {
+                            debug("Out of range\n");
+                            goto error;
+                        }
+
+                        i++;
+                    }
+
+                    parser->value = value;
+                    i--; /* The number may go on in the next piece */
+                    continue;
+                }
+
+                parser->state = PARSE_AFTER_NUMBER;
+                /* fall through */
+
+            case PARSE_AFTER_NUMBER:
+                if (IS_SPACE(parser, c))
+                {
+                    continue;
+                }
+
+                if (c == CHAR_ENTRY_SEPARATOR)
+                {
+                    if (!emit_entry(parser, emit, ctx))
+                    {
+                        goto error;
+                    }
+
+                    parser->state = PARSE_ENTRY;
+                    continue;
+                }
+
+                if (c == CHAR_RANGE_SEPARATOR && !parser->in_range)
+                {
+                    /* this was first value of range */
+                    parser->range_start = parser->value;
+                    parser->in_range = true;
+                    parser->state = PARSE_RANGE_END;
+                    continue;
+                }
+
+                goto error;
+
+            default:
+                goto error;
+        }
+    }
+
+    parser->offset += len;
+
+    return true;
+
+error:
+    debug("Invalid string at offset %zu\n", parser->offset + i);
+    parser->offset += i;
+    parser->state = PARSE_ERROR;
+
+    return false;
+}
+
+bool range_parser_finish(struct range_parser *parser, range_emit_t emit, void *ctx)
+{
+    switch (parser->state)
+    {
+        case PARSE_ENTRY:
+            /* A trailing separator is fine, an empty list is not */
+            return parser->has_entry;
+
+        case PARSE_NUMBER:
+        case PARSE_AFTER_NUMBER:
+            if (emit_entry(parser, emit, ctx))
+            {
+                return true;
+            }
+
+            parser->state = PARSE_ERROR;
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+void fill_words(u32 *words, u16 start, u16 end)
+{
+    u32 i = 0;
+    u32 first_word = 0;
+    u32 last_word = 0;
+    u32 head = 0;
+    u32 tail = 0;
+
+    first_word = start / BITSIZEOF(u32);
+    last_word = end / BITSIZEOF(u32);
+    head = UINT32_MAX << (start % BITSIZEOF(u32));
+    tail = UINT32_MAX >> (BITSIZEOF(u32) - 1 - end % BITSIZEOF(u32));
+
+    if (first_word == last_word)
+    {
+        words[first_word] |= head & tail;
+        return;
+    }
+
+    words[first_word] |= head;
+
+    for (i = first_word + 1; i < last_word; i++)
+    {
+        words[i] = UINT32_MAX;
+    }
+
+    words[last_word] |= tail;
+
+    return;
+}
+
+static bool emit_words(void *ctx, u16 start, u16 end)
+{
+    struct parse_words *scratch = (struct parse_words *)ctx;
+    u32 end_word = 0;
+
+    end_word = end / BITSIZEOF(u32);
+
+    if (end_word >= scratch->zeroed)
+    {
+        memset(&scratch->words[scratch->zeroed], 0,
+               (end_word + 1 - scratch->zeroed) * sizeof(u32));
+        scratch->zeroed = end_word + 1;
+    }
+
+    if (end > scratch->max_value)
+    {
+        scratch->max_value = end;
+    }
+
+    fill_words(scratch->words, start, end);
+
+    return true;
+}
+
+struct bitmap *bitmap_parse_str(u8 *str)
+{
+    struct parse_words scratch;
+    struct range_parser parser;
+    struct bitmap *bm = NULL;
+
+    if (str == NULL || *str == CHAR_NULL)
+    {
+        return NULL;
+    }
+
+    debug("str: %s\n", str);
+
+    /* One pass over the input, entries go straight into words sized for any u16 list */
+    scratch.zeroed = 0;
+    scratch.max_value = 0;
+    range_parser_init(&parser);
+
+    if (!range_parser_feed(&parser, str, strlen((char *)str), emit_words, &scratch) ||
+        !range_parser_finish(&parser, emit_words, &scratch))
+    {
+        debug("Invalid string \n");
+        return NULL;
+    }
+
+    debug("Max val in str: %" PRIu16 "\n", scratch.max_value);
+    bm = bitmap_create(scratch.max_value + 1);
+
+    if (bm == NULL)
+    {
+        debug("call to bitmap_create failed\n");
+        return NULL;
+    }
+
+    memcpy(bm->buf, scratch.words, bm->buf_len * sizeof(u32));
+    update_info(bm);
+
+    return bm;
+}
+
+static bool emit_growing(void *ctx, u16 start, u16 end)
+{
+    struct parse_growing *growing = (struct parse_growing *)ctx;
+    u32 new_capacity = 0;
+
+    if (growing->bm == NULL)
+    {
+        growing->bm = bitmap_create(end + 1);
+
+        if (growing->bm == NULL)
+        {
+            return false;
+        }
+    }
+    else if (end >= growing->bm->max_value)
+    {
+        /* Double like auto-growing bitmaps so a rising list is not resized per entry */
+        new_capacity = (u32)growing->bm->max_value * 2;
+
+        if (new_capacity <= end)
+        {
+            new_capacity = (u32)end + 1;
+        }
+
+        if (new_capacity > UINT16_MAX)
+        {
+            new_capacity = UINT16_MAX;
+        }
+
+        if (!bitmap_resize(growing->bm, (u16)new_capacity))
+        {
+            return false;
+        }
+    }
+
+    if (end > growing->max_value)
+    {
+        growing->max_value = end;
+    }
+
+    fill_words(growing->bm->buf, start, end);
+
+    return true;
+}
+
+static ssize_t read_file(void *src, u8 *buf, size_t len)
+{
+    FILE *fp = (FILE *)src;
+    size_t read_len = 0;
+
+    read_len = fread(buf, 1, len, fp);
+
+    if (read_len == 0 && ferror(fp))
+    {
+        return -1;
+    }
+
+    return (ssize_t)read_len;
+}
+
+static ssize_t read_fd(void *src, u8 *buf, size_t len)
+{
+    int fd = *(int *)src;
+    ssize_t read_len = 0;
+
+    do
+    {
+        read_len = read(fd, buf, len);
+    } while (read_len < 0 && errno == EINTR);
+
+    return read_len;
+}
+
+static struct bitmap *parse_stream(read_chunk_t read_chunk, void *src)
+{
+    u8 chunk[PARSE_CHUNK_SIZE];
+    ssize_t len = 0;
+    struct parse_growing growing;
+    struct range_parser parser;
+
+    growing.bm = NULL;
+    growing.max_value = 0;
+    range_parser_init(&parser);
+    parser.allow_newline = true;
+
+    /* Memory stays at one chunk plus the bitmap, entries split by a chunk end are resumed */
+    while ((len = read_chunk(src, chunk, sizeof(chunk))) > 0)
+    {
+        if (!range_parser_feed(&parser, chunk, (size_t)len, emit_growing, &growing))
+        {
+            goto cleanup;
+        }
+    }
+
+    if (len < 0 || !range_parser_finish(&parser, emit_growing, &growing))
+    {
+        goto cleanup;
+    }
+
+    /* Doubling may have overshot, end up with the same capacity as bitmap_parse_str */
+    if (!bitmap_resize(growing.bm, growing.max_value + 1))
+    {
+        goto cleanup;
+    }
+
+    update_info(growing.bm);
+
+    return growing.bm;
+
+cleanup:
+    debug("Invalid stream at offset %zu\n", parser.offset);
+    bitmap_destroy(growing.bm);
+
+    return NULL;
+}
+
+struct bitmap *bitmap_parse_stream(FILE *fp)
+{
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    return parse_stream(read_file, fp);
+}
+
+struct bitmap *bitmap_parse_fd(int fd)
+{
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    return parse_stream(read_fd, &fd);
+}
+
+static void *parse_segment_worker(void *arg)
+{
+    struct parse_segment *segment = (struct parse_segment *)arg;
+    struct range_parser parser;
+
+    segment->scratch.zeroed = 0;
+    segment->scratch.max_value = 0;
+    range_parser_init(&parser);
+    parser.allow_newline = segment->allow_newline;
+
+    if (!range_parser_feed(&parser, segment->str, segment->len, emit_words, &segment->scratch) ||
+        (!range_parser_finish(&parser, emit_words, &segment->scratch) &&
+         parser.state != PARSE_ENTRY))
+    {
+        /* Only a piece without any entry may end outside of one, it is all spaces */
+        segment->failed = true;
+        segment->error_offset = segment->base + parser.offset;
+    }
+
+    segment->has_entry = parser.has_entry;
+
+    return NULL;
+}
+
+static struct bitmap *parse_parallel(const u8 *str, size_t len, u32 threads, bool allow_newline,
+                                     size_t *error_offset)
+{
+    pthread_t tids[PARSE_MAX_THREADS];
+    bool started[PARSE_MAX_THREADS] = {false};
+    struct parse_segment *segments = NULL;
+    struct bitmap *bm = NULL;
+    const u8 *separator = NULL;
+    size_t start = 0;
+    size_t end = 0;
+    u32 max_value = 0;
+    u32 i = 0;
+    u32 j = 0;
+    bool has_entry = false;
+    bool failed = false;
+
+    if (str == NULL || len == 0)
+    {
+        return NULL;
+    }
+
+    if (threads == 0)
+    {
+        threads = (u32)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (threads > len / PARSE_MIN_SEGMENT + 1)
+    {
+        threads = (u32)(len / PARSE_MIN_SEGMENT + 1);
+    }
+
+    if (threads > PARSE_MAX_THREADS)
+    {
+        threads = PARSE_MAX_THREADS;
+    }
+
+    segments = (struct parse_segment *)calloc(threads, sizeof(struct parse_segment));
+
+    if (segments == NULL)
+    {
+        return NULL;
+    }
+
+    /* Cut after the separator following each even split point, pieces start a new entry */
+    for (i = 0; i < threads; i++)
+    {
+        end = len;
+
+        if (i < threads - 1 && (size_t)len * (i + 1) / threads > start)
+        {
+            separator = (const u8 *)memchr(str + len * (i + 1) / threads, CHAR_ENTRY_SEPARATOR,
+                                           len - len * (i + 1) / threads);
+            end = (separator != NULL) ? (size_t)(separator - str) + 1 : len;
+        }
+        else if (i < threads - 1)
+        {
+            end = start; /* The previous cut already went past this split point */
+        }
+
+        segments[i].str = str + start;
+        segments[i].len = end - start;
+        segments[i].base = start;
+        segments[i].allow_newline = allow_newline;
+        start = end;
+    }
+
+    /* The calling thread takes the last piece */
+    for (i = 0; i < threads - 1; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, parse_segment_worker, &segments[i]) == 0;
+
+        if (!started[i])
+        {
+            parse_segment_worker(&segments[i]);
+        }
+    }
+
+    parse_segment_worker(&segments[threads - 1]);
+
+    for (i = 0; i < threads - 1; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+    }
+
+    /* The first failing piece holds the first error of the input */
+    for (i = 0; i < threads; i++)
+    {
+        if (segments[i].failed)
+        {
+            debug("Invalid string at offset %zu\n", segments[i].error_offset);
+
+            if (error_offset != NULL)
+            {
+                *error_offset = segments[i].error_offset;
+            }
+
+            failed = true;
+            break;
+        }
+
+        if (segments[i].has_entry)
+        {
+            has_entry = true;
+
+            if (segments[i].scratch.max_value > max_value)
+            {
+                max_value = segments[i].scratch.max_value;
+            }
+        }
+    }
+
+    if (failed || !has_entry)
+    {
+        if (!failed && error_offset != NULL)
+        {
+            *error_offset = len;
+        }
+
+        goto cleanup;
+    }
+
+    bm = bitmap_create((u16)(max_value + 1));
+
+    if (bm == NULL)
+    {
+        goto cleanup;
+    }
+
+    /* Merge the partial bitmaps word by word */
+    for (i = 0; i < threads; i++)
+    {
+        for (j = 0; j < segments[i].scratch.zeroed; j++)
+        {
+            bm->buf[j] |= segments[i].scratch.words[j];
+        }
+    }
+
+    update_info(bm);
+
+cleanup:
+    free(segments);
+
+    return bm;
+}
+
+struct bitmap *bitmap_parse_parallel(const u8 *str, size_t len, u32 threads, size_t *error_offset)
+{
+    return parse_parallel(str, len, threads, false, error_offset);
+}
+
+struct bitmap *bitmap_parse_file(const char *path, u32 threads, size_t *error_offset)
+{
+    int fd = -1;
+    void *map = MAP_FAILED;
+    struct stat st;
+    struct bitmap *bm = NULL;
+
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        goto cleanup;
+    }
+
+    /* Workers read their pieces straight from the page cache */
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        goto cleanup;
+    }
+
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    bm = parse_parallel((const u8 *)map, (size_t)st.st_size, threads, true, error_offset);
+    munmap(map, (size_t)st.st_size);
+
+cleanup:
+    close(fd);
+
+    return bm;
+}
+
+static inline bool parse_hex_group(const u8 *str, size_t len, u32 *word)
+{
+    u32 value = 0;
+    u8 digit = 0;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        digit = hex_digit[str[i]];
+
+        if (digit == 0)
+        {
+            return false;
+        }
+
+        value = (value << 4) | (u32)(digit - 1);
+    }
+
+    *word = value;
+
+    return true;
+}
+
+struct bitmap *bitmap_parse_hex(const u8 *str, size_t len)
+{
+    struct bitmap *bm = NULL;
+    size_t end = 0;
+    size_t start = 0;
+    size_t groups = 1;
+    size_t first_digits = 0;
+    size_t width = 0;
+    size_t word_index = 0;
+    size_t i = 0;
+    u32 word = 0;
+    u32 tail_bits = 0;
+
+    if (str == NULL)
+    {
+        return NULL;
+    }
+
+    /* Masks read from sysfs end with a line break */
+    while (len > 0 && (str[len - 1] == CHAR_SPACE || str[len - 1] == '\n'))
+    {
+        len--;
+    }
+
+    while (len > 0 && str[0] == CHAR_SPACE)
+    {
+        str++;
+        len--;
+    }
+
+    if (len == 0)
+    {
+        return NULL;
+    }
+
+    /* The capacity is the width of the mask: full words plus the digits of the first group */
+    for (i = 0; i < len; i++)
+    {
+        if (str[i] == HEX_GROUP_SEPARATOR)
+        {
+            if (groups == 1)
+            {
+                first_digits = i;
+            }
+
+            groups++;
+        }
+    }
+
+    if (groups == 1)
+    {
+        first_digits = len;
+    }
+
+    width = (groups - 1) * BITSIZEOF(u32) + first_digits * 4;
+    bm = bitmap_create((u16)((width < UINT16_MAX) ? width : UINT16_MAX));
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    /* The least significant group comes last */
+    end = len;
+
+    for (word_index = 0; word_index < groups; word_index++)
+    {
+        start = end;
+
+        while (start > 0 && str[start - 1] != HEX_GROUP_SEPARATOR)
+        {
+            start--;
+        }
+
+        if (end == start || end - start > HEX_GROUP_DIGITS ||
+            !parse_hex_group(str + start, end - start, &word))
+        {
+            debug("Invalid hex group at offset %zu\n", start);
+            goto failed;
+        }
+
+        if (word_index < bm->buf_len)
+        {
+            bm->buf[word_index] = word;
+        }
+        else if (word != 0)
+        {
+            /* Leading zero groups may go past the largest capacity, values may not */
+            goto failed;
+        }
+
+        end = (start > 0) ? start - 1 : 0;
+    }
+
+    tail_bits = bm->max_value % BITSIZEOF(u32);
+
+    if (tail_bits != 0 && (bm->buf[bm->buf_len - 1] >> tail_bits) != 0)
+    {
+        goto failed;
+    }
+
+    update_info(bm);
+
+    return bm;
+
+failed:
+    bitmap_destroy(bm);
+
+    return NULL;
+}
@@ -0,0 +1,474 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-registry.h"
+#include "bitmap.h"
+
+#define REGISTRY_INITIAL_SIZE 16 /* Table slots, always a power of 2 */
+#define REGISTRY_MAX_SIZE (1U << 31)
+
+/* A slot of the table, empty when name is NULL */
+struct registry_entry
+{
+    char *name;
+    struct bitmap *bm;
+    u32 hash;
+    u32 name_len;
+};
+
+struct bitmap_registry
+{
+    struct registry_entry *entries;
+    u32 size;  /* Slots in entries */
+    u32 count; /* Used slots, at most 3/4 of size */
+    size_t name_bytes;
+};
+
+/*****************************************************************************
+ *
+ *   Name:       name_hash
+ *
+ *   Input:      name        A name
+ *               len         Length of the name
+ *   Return:     Success     FNV-1a hash of the name
+ *               Failed      None
+ *   Description            Hash a name
+ ******************************************************************************/
+static u32 name_hash(const char *name, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       name_check
+ *
+ *   Input:      name        A name
+ *               len         Gets the length of the name
+ *   Return:     Success     true
+ *               Failed      false, NULL, empty or longer than BITMAP_REGISTRY_NAME_MAX
+ *   Description            Check a name
+ ******************************************************************************/
+static bool name_check(const char *name, size_t *len);
+
+/*****************************************************************************
+ *
+ *   Name:       registry_lookup
+ *
+ *   Input:      registry    A registry
+ *               name        A name
+ *               len         Length of the name
+ *               hash        Hash of the name
+ *   Return:     Success     Index of the entry with that name, or of the empty slot
+ *                           where it belongs
+ *               Failed      None
+ *   Description            Probe the table for a name
+ ******************************************************************************/
+static u32 registry_lookup(const struct bitmap_registry *registry, const char *name, size_t len,
+                           u32 hash);
+
+/*****************************************************************************
+ *
+ *   Name:       registry_grow
+ *
+ *   Input:      registry    A registry
+ *   Return:     Success     true
+ *               Failed      false, the table is unchanged
+ *   Description            Double the table and move every entry to its new slot
+ ******************************************************************************/
+static bool registry_grow(struct bitmap_registry *registry);
+
+/*****************************************************************************
+ *
+ *   Name:       registry_insert
+ *
+ *   Input:      registry    A registry
+ *               name        A name that is not in the registry
+ *               len         Length of the name
+ *               hash        Hash of the name
+ *               bm          The bitmap
+ *   Return:     Success     true
+ *               Failed      false, out of memory
+ *   Description            Add an entry, growing the table when it gets 3/4 full
+ ******************************************************************************/
+static bool registry_insert(struct bitmap_registry *registry, const char *name, size_t len,
+                            u32 hash, struct bitmap *bm);
+
+static u32 name_hash(const char *name, size_t len)
+{
+    u32 hash = 2166136261U;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= (u8)name[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static bool name_check(const char *name, size_t *len)
+{
+    if (name == NULL)
+    {
+        return false;
+    }
+
+    *len = strnlen(name, BITMAP_REGISTRY_NAME_MAX + 1);
+
+    return *len > 0 && *len <= BITMAP_REGISTRY_NAME_MAX;
+}
+
+static u32 registry_lookup(const struct bitmap_registry *registry, const char *name, size_t len,
+                           u32 hash)
+{
+    const struct registry_entry *entry = NULL;
+    u32 mask = registry->size - 1;
+    u32 i = hash & mask;
+
+    /* The table is never full, so this finds the name or an empty slot */
+    while (true)
+    {
+        entry = &registry->entries[i];
+
+        if (entry->name == NULL)
+        {
+            return i;
+        }
+
+        if (entry->hash == hash && entry->name_len == len && memcmp(entry->name, name, len) == 0)
+        {
+            return i;
+        }
+
+        i = (i + 1) & mask;
+    }
+}
+
+static bool registry_grow(struct bitmap_registry *registry)
+{
+    struct registry_entry *entries = NULL;
+    struct registry_entry *old = registry->entries;
+    u32 old_size = registry->size;
+    u32 size = 0;
+    u32 mask = 0;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (old_size >= REGISTRY_MAX_SIZE)
+    {
+        return false;
+    }
+
+    size = old_size * 2;
+    mask = size - 1;
+    entries = (struct registry_entry *)calloc(size, sizeof(struct registry_entry));
+
+    if (entries == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < old_size; i++)
+    {
+        if (old[i].name == NULL)
+        {
+            continue;
+        }
+
+        /* Names are unique, only an empty slot is needed */
+        for (j = old[i].hash & mask; entries[j].name != NULL; j = (j + 1) & mask)
+        {
+        }
+
+        entries[j] = old[i];
+    }
+
+    free(old);
+    registry->entries = entries;
+    registry->size = size;
+
+    return true;
+}
+
+static bool registry_insert(struct bitmap_registry *registry, const char *name, size_t len,
+                            u32 hash, struct bitmap *bm)
+{
+    struct registry_entry *entry = NULL;
+    char *copy = NULL;
+
+    if ((uint64_t)(registry->count + 1) * 4 > (uint64_t)registry->size * 3 &&
+        !registry_grow(registry))
+    {
+        return false;
+    }
+
+    copy = (char *)malloc(len + 1);
+
+    if (copy == NULL)
+    {
+        return false;
+    }
+
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    entry = &registry->entries[registry_lookup(registry, name, len, hash)];
+    entry->name = copy;
+    entry->bm = bm;
+    entry->hash = hash;
+    entry->name_len = (u32)len;
+
+    registry->count++;
+    registry->name_bytes += len + 1;
+
+    return true;
+}
+
+struct bitmap_registry *bitmap_registry_create(void)
+{
+    struct bitmap_registry *registry = NULL;
+
+    registry = (struct bitmap_registry *)calloc(1, sizeof(struct bitmap_registry));
+
+    if (registry == NULL)
+    {
+        return NULL;
+    }
+
+    registry->entries =
+        (struct registry_entry *)calloc(REGISTRY_INITIAL_SIZE, sizeof(struct registry_entry));
+
+    if (registry->entries == NULL)
+    {
+        free(registry);
+        return NULL;
+    }
+
+    registry->size = REGISTRY_INITIAL_SIZE;
+
+    return registry;
+}
+
+void bitmap_registry_destroy(struct bitmap_registry *registry)
+{
+    u32 i = 0;
+
+    if (registry == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < registry->size; i++)
+    {
+        if (registry->entries[i].name != NULL)
+        {
+            bitmap_destroy(registry->entries[i].bm);
+            free(registry->entries[i].name);
+        }
+    }
+
+    free(registry->entries);
+    free(registry);
+
+    return;
+}
+
+struct bitmap *bitmap_registry_find(const struct bitmap_registry *registry, const char *name)
+{
+    size_t len = 0;
+    u32 index = 0;
+
+    if (registry == NULL || !name_check(name, &len))
+    {
+        return NULL;
+    }
+
+    index = registry_lookup(registry, name, len, name_hash(name, len));
+
+    return registry->entries[index].bm;
+}
+
+struct bitmap *bitmap_registry_get(struct bitmap_registry *registry, const char *name,
+                                   u16 capacity)
+{
+    struct bitmap *bm = NULL;
+    size_t len = 0;
+    u32 hash = 0;
+    u32 index = 0;
+
+    if (registry == NULL || !name_check(name, &len))
+    {
+        return NULL;
+    }
+
+    hash = name_hash(name, len);
+    index = registry_lookup(registry, name, len, hash);
+
+    if (registry->entries[index].name != NULL)
+    {
+        return registry->entries[index].bm;
+    }
+
+    bm = bitmap_create(capacity);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    if (!registry_insert(registry, name, len, hash, bm))
+    {
+        bitmap_destroy(bm);
+        return NULL;
+    }
+
+    return bm;
+}
+
+bool bitmap_registry_set(struct bitmap_registry *registry, const char *name, struct bitmap *bm)
+{
+    struct registry_entry *entry = NULL;
+    size_t len = 0;
+    u32 hash = 0;
+
+    if (registry == NULL || bm == NULL || !name_check(name, &len))
+    {
+        return false;
+    }
+
+    hash = name_hash(name, len);
+    entry = &registry->entries[registry_lookup(registry, name, len, hash)];
+
+    if (entry->name == NULL)
+    {
+        return registry_insert(registry, name, len, hash, bm);
+    }
+
+    if (entry->bm != bm)
+    {
+        bitmap_destroy(entry->bm);
+        entry->bm = bm;
+    }
+
+    return true;
+}
+
+bool bitmap_registry_remove(struct bitmap_registry *registry, const char *name)
+{
+    struct registry_entry *entries = NULL;
+    size_t len = 0;
+    u32 mask = 0;
+    u32 hole = 0;
+    u32 i = 0;
+    u32 home = 0;
+
+    if (registry == NULL || !name_check(name, &len))
+    {
+        return false;
+    }
+
+    entries = registry->entries;
+    mask = registry->size - 1;
+    hole = registry_lookup(registry, name, len, name_hash(name, len));
+
+    if (entries[hole].name == NULL)
+    {
+        return false;
+    }
+
+    bitmap_destroy(entries[hole].bm);
+    free(entries[hole].name);
+    registry->count--;
+    registry->name_bytes -= len + 1;
+
+    /*
+     * Shift the rest of the probe run back into the hole, so no lookup stops early at it.
+     * An entry can move when its home slot is not between the hole and itself, cyclically.
+     */
+    for (i = (hole + 1) & mask; entries[i].name != NULL; i = (i + 1) & mask)
+    {
+        home = entries[i].hash & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            entries[hole] = entries[i];
+            hole = i;
+        }
+    }
+
+    entries[hole].name = NULL;
+    entries[hole].bm = NULL;
+
+    return true;
+}
+
+u32 bitmap_registry_count(const struct bitmap_registry *registry)
+{
+    if (registry == NULL)
+    {
+        return 0;
+    }
+
+    return registry->count;
+}
+
+size_t bitmap_registry_memory(const struct bitmap_registry *registry)
+{
+    size_t bytes = 0;
+    u32 i = 0;
+
+    if (registry == NULL)
+    {
+        return 0;
+    }
+
+    bytes = sizeof(struct bitmap_registry) + registry->size * sizeof(struct registry_entry) +
+            registry->name_bytes;
+
+    for (i = 0; i < registry->size; i++)
+    {
+        if (registry->entries[i].name != NULL)
+        {
+            bytes += sizeof(struct bitmap) + registry->entries[i].bm->buf_len * sizeof(u32);
+        }
+    }
+
+    return bytes;
+}
+
+bool bitmap_registry_next(const struct bitmap_registry *registry, u32 *iter, const char **name,
+                          struct bitmap **bm)
+{
+    u32 i = 0;
+
+    if (registry == NULL || iter == NULL)
+    {
+        return false;
+    }
+
+    for (i = *iter; i < registry->size; i++)
+    {
+        if (registry->entries[i].name == NULL)
+        {
+            continue;
+        }
+
+        if (name != NULL)
+        {
+            *name = registry->entries[i].name;
+        }
+
+        if (bm != NULL)
+        {
+            *bm = registry->entries[i].bm;
+        }
+
+        *iter = i + 1;
+
+        return true;
+    }
+
+    *iter = registry->size;
+
+    return false;
+}
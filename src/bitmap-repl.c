@@ -0,0 +1,610 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-registry.h"
+#include "bitmap-repl.h"
+#include "bitmap.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error "replication records are little endian, add byte swapping for this target"
+#endif
+
+#define REPL_MAGIC 0x4c505242 /* "BRPL" */
+#define REPL_VERSION 1
+#define REPL_TYPE_BLOCKS 1    /* Primary to follower, dirty blocks of one bitmap */
+#define REPL_TYPE_ACK 2       /* Follower to primary, seq and time_ns of the last record applied */
+#define REPL_PAD(len) (((size_t)(len) + 3) & ~(size_t)3)
+#define REPL_BLOCKS_MAX (BITMAP_DIRTY_LEN * 64)
+#define REPL_RECORD_MAX                                                                            \
+    (sizeof(struct repl_header) + REPL_PAD(BITMAP_REGISTRY_NAME_MAX) +                             \
+     REPL_BLOCKS_MAX * sizeof(struct repl_block))
+#define REPL_IN_SIZE (2 * REPL_RECORD_MAX) /* Always room for a whole record after a partial one */
+
+/* Start of a record, followed by the name padded to 4 bytes and the blocks */
+struct repl_header
+{
+    u32 magic;        /* REPL_MAGIC */
+    u8 version;       /* REPL_VERSION */
+    u8 type;          /* REPL_TYPE_* */
+    u16 name_len;     /* 0 for REPL_TYPE_ACK */
+    u16 max_value;    /* Capacity of the bitmap on the primary */
+    u16 blocks;       /* Number of struct repl_block */
+    u32 crc;          /* CRC32C of the record with this field 0 */
+    uint64_t seq;     /* Numbers the records of a stream from 1 */
+    uint64_t time_ns; /* CLOCK_REALTIME of the send */
+};
+
+/* Words [index * BITMAP_BLOCK_WORDS, index * BITMAP_BLOCK_WORDS + BITMAP_BLOCK_WORDS) */
+struct repl_block
+{
+    u16 index;
+    u16 reserved;
+    u32 words[BITMAP_BLOCK_WORDS]; /* Words past buf_len are 0 */
+};
+
+_Static_assert(sizeof(struct repl_header) == 32, "repl_header is 32 bytes on the wire");
+_Static_assert(REPL_BLOCKS_MAX * BITMAP_BLOCK_WORDS * 32 >= UINT16_MAX,
+               "bm->dirty has a bit for every block of the largest bitmap");
+
+struct bitmap_repl
+{
+    int fd;
+    struct bitmap_registry *registry; /* The follower applies to it, NULL for a primary */
+    u8 *record;                       /* Primary: the record being sent */
+    u8 *in;                           /* Bytes received and not handled yet */
+    size_t in_len;
+    struct repl_header last;          /* Follower: header of the last record applied */
+    bool unacked;                     /* Follower: last was not acknowledged yet */
+    struct bitmap_repl_stats stats;
+};
+
+/*****************************************************************************
+ *
+ *   Name:       now_ns
+ *
+ *   Input:      None
+ *   Return:     Success     The wall clock in nanoseconds
+ *               Failed      None
+ *   Description            Clock of the record timestamps and the lag
+ ******************************************************************************/
+static uint64_t now_ns(void);
+
+/*****************************************************************************
+ *
+ *   Name:       repl_write
+ *
+ *   Input:      repl        A replication stream
+ *               buf         Bytes to send
+ *               len         Number of bytes
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Send all of buf, waiting when a non-blocking socket is full
+ ******************************************************************************/
+static bool repl_write(struct bitmap_repl *repl, const void *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       repl_record_len
+ *
+ *   Input:      buf         Received bytes
+ *               len         Number of bytes
+ *   Return:     Success     Length of the record at the start of buf, 0 when incomplete
+ *               Failed      -1, not a record
+ *   Description            Check a record header and frame a record
+ ******************************************************************************/
+static ssize_t repl_record_len(const u8 *buf, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       repl_apply
+ *
+ *   Input:      repl        A follower
+ *               header      Header of a REPL_TYPE_BLOCKS record
+ *               body        The name and the blocks after it
+ *   Return:     Success     true
+ *               Failed      false, the blocks do not fit the bitmap or it can not be made
+ *   Description            Copy the blocks of a record into the bitmap of its name
+ ******************************************************************************/
+static bool repl_apply(struct bitmap_repl *repl, const struct repl_header *header, const u8 *body);
+
+/*****************************************************************************
+ *
+ *   Name:       repl_handle
+ *
+ *   Input:      repl        A primary or a follower
+ *               record      A whole record, framed by repl_record_len, its crc field is
+ *                           zeroed
+ *               len         Length of the record
+ *   Return:     Success     true
+ *               Failed      false, bad checksum or a record the role does not take
+ *   Description            Apply a record or take an acknowledgment
+ ******************************************************************************/
+static bool repl_handle(struct bitmap_repl *repl, u8 *record, size_t len);
+
+/*****************************************************************************
+ *
+ *   Name:       repl_open
+ *
+ *   Input:      fd          A connected stream socket
+ *               registry    Registry of a follower, NULL for a primary
+ *   Return:     Success     A replication stream
+ *               Failed      NULL
+ *   Description            Allocate a replication stream
+ ******************************************************************************/
+static struct bitmap_repl *repl_open(int fd, struct bitmap_registry *registry);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static bool repl_write(struct bitmap_repl *repl, const void *buf, size_t len)
+{
+    struct pollfd pfd;
+    ssize_t ret = 0;
+    size_t done = 0;
+
+    while (done < len)
+    {
+        ret = send(repl->fd, (const u8 *)buf + done, len - done, MSG_NOSIGNAL);
+
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            pfd.fd = repl->fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if (ret <= 0)
+        {
+            return false;
+        }
+
+        done += (size_t)ret;
+    }
+
+    return true;
+}
+
+static ssize_t repl_record_len(const u8 *buf, size_t len)
+{
+    struct repl_header header;
+
+    if (len < sizeof(header))
+    {
+        return 0;
+    }
+
+    memcpy(&header, buf, sizeof(header));
+
+    if (header.magic != REPL_MAGIC || header.version != REPL_VERSION)
+    {
+        return -1;
+    }
+
+    if (header.type == REPL_TYPE_ACK)
+    {
+        if (header.name_len != 0 || header.blocks != 0)
+        {
+            return -1;
+        }
+    }
+    else if (header.type != REPL_TYPE_BLOCKS || header.name_len == 0 ||
+             header.name_len > BITMAP_REGISTRY_NAME_MAX || header.blocks > REPL_BLOCKS_MAX)
+    {
+        return -1;
+    }
+
+    len = sizeof(header) + REPL_PAD(header.name_len) + header.blocks * sizeof(struct repl_block);
+
+    return (ssize_t)len;
+}
+
+static bool repl_apply(struct bitmap_repl *repl, const struct repl_header *header, const u8 *body)
+{
+    char name[BITMAP_REGISTRY_NAME_MAX + 1];
+    const struct repl_block *block = NULL;
+    struct bitmap *bm = NULL;
+    u32 first = 0;
+    u32 words = 0;
+    u16 i = 0;
+
+    memcpy(name, body, header->name_len);
+    name[header->name_len] = CHAR_NULL;
+
+    if (strlen(name) != header->name_len)
+    {
+        return false;
+    }
+
+    bm = bitmap_registry_find(repl->registry, name);
+
+    if (bm == NULL)
+    {
+        bm = bitmap_create(header->max_value);
+
+        if (bm == NULL)
+        {
+            return false;
+        }
+
+        if (!bitmap_registry_set(repl->registry, name, bm))
+        {
+            bitmap_destroy(bm);
+            return false;
+        }
+    }
+    else if (bm->max_value != header->max_value && !bitmap_resize(bm, header->max_value))
+    {
+        return false;
+    }
+
+    if (!bitmap_check_writable(bm))
+    {
+        return false;
+    }
+
+    /* The name is padded to 4 bytes, so the blocks are word aligned in the input buffer */
+    block = (const struct repl_block *)(body + REPL_PAD(header->name_len));
+
+    for (i = 0; i < header->blocks; i++, block++)
+    {
+        first = (u32)block->index * BITMAP_BLOCK_WORDS;
+
+        if (first >= bm->buf_len)
+        {
+            return false;
+        }
+
+        words = bm->buf_len - first;
+        words = (words < BITMAP_BLOCK_WORDS) ? words : BITMAP_BLOCK_WORDS;
+
+        memcpy(bm->buf + first, block->words, words * sizeof(u32));
+        bm->dirty[block->index / 64] |= 1ULL << (block->index % 64);
+    }
+
+    clear_tail_bits(bm);
+    update_info(bm);
+
+    return true;
+}
+
+static bool repl_handle(struct bitmap_repl *repl, u8 *record, size_t len)
+{
+    struct repl_header header;
+    uint64_t now = 0;
+
+    memcpy(&header, record, sizeof(header));
+    memset(record + offsetof(struct repl_header, crc), 0, sizeof(header.crc));
+
+    if (crc32c(0, record, len) != header.crc)
+    {
+        debug("Record %" PRIu64 " checksum mismatch\n", header.seq);
+        return false;
+    }
+
+    now = now_ns();
+
+    if (header.type == REPL_TYPE_ACK)
+    {
+        if (repl->registry != NULL || header.seq > repl->stats.seq)
+        {
+            return false;
+        }
+
+        repl->stats.seq_ack = header.seq;
+        repl->stats.lag_ns = (now > header.time_ns) ? now - header.time_ns : 0;
+
+        return true;
+    }
+
+    if (repl->registry == NULL || !repl_apply(repl, &header, record + sizeof(header)))
+    {
+        return false;
+    }
+
+    repl->last = header;
+    repl->unacked = true;
+    repl->stats.records++;
+    repl->stats.blocks += header.blocks;
+    repl->stats.bytes += len;
+    repl->stats.seq = header.seq;
+    repl->stats.lag_ns = (now > header.time_ns) ? now - header.time_ns : 0;
+
+    return true;
+}
+
+static struct bitmap_repl *repl_open(int fd, struct bitmap_registry *registry)
+{
+    struct bitmap_repl *repl = NULL;
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    repl = (struct bitmap_repl *)calloc(1, sizeof(struct bitmap_repl));
+
+    if (repl == NULL)
+    {
+        return NULL;
+    }
+
+    repl->fd = fd;
+    repl->registry = registry;
+    repl->in = (u8 *)malloc(REPL_IN_SIZE);
+
+    if (repl->in == NULL)
+    {
+        goto failed;
+    }
+
+    if (registry == NULL)
+    {
+        repl->record = (u8 *)malloc(REPL_RECORD_MAX);
+
+        if (repl->record == NULL)
+        {
+            goto failed;
+        }
+    }
+
+    return repl;
+
+failed:
+    bitmap_repl_close(repl);
+    return NULL;
+}
+
+struct bitmap_repl *bitmap_repl_primary(int fd)
+{
+    return repl_open(fd, NULL);
+}
+
+struct bitmap_repl *bitmap_repl_follower(int fd, struct bitmap_registry *registry)
+{
+    if (registry == NULL)
+    {
+        return NULL;
+    }
+
+    return repl_open(fd, registry);
+}
+
+void bitmap_repl_close(struct bitmap_repl *repl)
+{
+    if (repl == NULL)
+    {
+        return;
+    }
+
+    free(repl->record);
+    free(repl->in);
+    free(repl);
+
+    return;
+}
+
+bool bitmap_repl_send(struct bitmap_repl *repl, const char *name, struct bitmap *bm, u32 flags)
+{
+    struct repl_header header;
+    struct repl_block *block = NULL;
+    uint64_t dirty = 0;
+    size_t name_len = 0;
+    size_t len = 0;
+    u32 blocks_total = 0;
+    u32 index = 0;
+    u32 words = 0;
+    u32 i = 0;
+    u16 blocks = 0;
+
+    if (repl == NULL || repl->registry != NULL || name == NULL || !bitmap_check(bm))
+    {
+        return false;
+    }
+
+    name_len = strlen(name);
+
+    if (name_len == 0 || name_len > BITMAP_REGISTRY_NAME_MAX)
+    {
+        return false;
+    }
+
+    if (flags & BITMAP_REPL_FULL)
+    {
+        mark_all_dirty(bm);
+    }
+
+    blocks_total = ((u32)bm->buf_len + BITMAP_BLOCK_WORDS - 1) / BITMAP_BLOCK_WORDS;
+    len = sizeof(header) + REPL_PAD(name_len);
+    memset(repl->record, 0, len);
+    memcpy(repl->record + sizeof(header), name, name_len);
+
+    for (i = 0; i < BITMAP_DIRTY_LEN; i++)
+    {
+        dirty = bm->dirty[i];
+        bm->dirty[i] = 0;
+
+        /* Bits past the last block come from mark_all_dirty or a shrink, skip them */
+        while (dirty != 0 && (index = i * 64 + (u32)__builtin_ctzll(dirty)) < blocks_total)
+        {
+            dirty &= dirty - 1;
+
+            block = (struct repl_block *)(repl->record + len);
+            block->index = (u16)index;
+            block->reserved = 0;
+
+            words = bm->buf_len - index * BITMAP_BLOCK_WORDS;
+            words = (words < BITMAP_BLOCK_WORDS) ? words : BITMAP_BLOCK_WORDS;
+            memcpy(block->words, bm->buf + index * BITMAP_BLOCK_WORDS, words * sizeof(u32));
+            memset(block->words + words, 0, (BITMAP_BLOCK_WORDS - words) * sizeof(u32));
+
+            len += sizeof(struct repl_block);
+            blocks++;
+        }
+    }
+
+    if (blocks == 0)
+    {
+        return true;
+    }
+
+    header.magic = REPL_MAGIC;
+    header.version = REPL_VERSION;
+    header.type = REPL_TYPE_BLOCKS;
+    header.name_len = (u16)name_len;
+    header.max_value = bm->max_value;
+    header.blocks = blocks;
+    header.crc = 0;
+    header.seq = repl->stats.seq + 1;
+    header.time_ns = now_ns();
+
+    memcpy(repl->record, &header, sizeof(header));
+    header.crc = crc32c(0, repl->record, len);
+    memcpy(repl->record, &header, sizeof(header));
+
+    if (!repl_write(repl, repl->record, len))
+    {
+        return false;
+    }
+
+    repl->stats.records++;
+    repl->stats.blocks += blocks;
+    repl->stats.bytes += len;
+    repl->stats.seq = header.seq;
+
+    return true;
+}
+
+bool bitmap_repl_send_registry(struct bitmap_repl *repl, const struct bitmap_registry *registry,
+                               u32 flags)
+{
+    struct bitmap *bm = NULL;
+    const char *name = NULL;
+    u32 iter = 0;
+
+    if (registry == NULL)
+    {
+        return false;
+    }
+
+    while (bitmap_registry_next(registry, &iter, &name, &bm))
+    {
+        if (!bitmap_repl_send(repl, name, bm, flags))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool bitmap_repl_poll(struct bitmap_repl *repl, int timeout_ms)
+{
+    struct repl_header ack;
+    struct pollfd pfd;
+    ssize_t record_len = 0;
+    ssize_t ret = 0;
+    size_t offset = 0;
+
+    if (repl == NULL)
+    {
+        return false;
+    }
+
+    pfd.fd = repl->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, timeout_ms);
+
+    if (ret <= 0)
+    {
+        return ret == 0 || errno == EINTR;
+    }
+
+    ret = recv(repl->fd, repl->in + repl->in_len, REPL_IN_SIZE - repl->in_len, MSG_DONTWAIT);
+
+    if (ret < 0)
+    {
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    if (ret == 0)
+    {
+        debug("Peer closed the stream\n");
+        return false;
+    }
+
+    repl->in_len += (size_t)ret;
+
+    while ((record_len = repl_record_len(repl->in + offset, repl->in_len - offset)) > 0 &&
+           (size_t)record_len <= repl->in_len - offset)
+    {
+        if (!repl_handle(repl, repl->in + offset, (size_t)record_len))
+        {
+            return false;
+        }
+
+        offset += (size_t)record_len;
+    }
+
+    if (record_len < 0)
+    {
+        return false;
+    }
+
+    memmove(repl->in, repl->in + offset, repl->in_len - offset);
+    repl->in_len -= offset;
+
+    if (!repl->unacked)
+    {
+        return true;
+    }
+
+    /* One acknowledgment for everything this poll applied */
+    memset(&ack, 0, sizeof(ack));
+    ack.magic = REPL_MAGIC;
+    ack.version = REPL_VERSION;
+    ack.type = REPL_TYPE_ACK;
+    ack.seq = repl->last.seq;
+    ack.time_ns = repl->last.time_ns;
+    ack.crc = crc32c(0, &ack, sizeof(ack));
+    repl->unacked = false;
+
+    return repl_write(repl, &ack, sizeof(ack));
+}
+
+void bitmap_repl_get_stats(const struct bitmap_repl *repl, struct bitmap_repl_stats *stats)
+{
+    if (repl == NULL || stats == NULL)
+    {
+        return;
+    }
+
+    *stats = repl->stats;
+
+    return;
+}
@@ -0,0 +1,496 @@
+#include <string.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-roaring.h"
+#include "bitmap.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error "bitmap containers are copied as little endian words, add byte swapping for this target"
+#endif
+
+#define ROARING_ARRAY_MAX 4096                           /* Larger containers are bitmaps */
+#define ROARING_BITMAP_BYTES 8192                        /* 65536 bits */
+#define ROARING_NO_OFFSET_THRESHOLD 4                    /* Fewer run containers, no offsets */
+#define ROARING_WORDS (ROARING_BITMAP_BYTES / sizeof(u32)) /* Words of a bitmap container */
+
+enum roaring_container
+{
+    ROARING_ARRAY,
+    ROARING_BITMAP,
+    ROARING_RUN,
+};
+
+/*****************************************************************************
+ *
+ *   Name:       get_u16
+ *
+ *   Input:      buf         Two bytes, little endian
+ *   Return:     Success     The value
+ *               Failed      None
+ *   Description            Read a little endian u16 from any address
+ ******************************************************************************/
+static inline u16 get_u16(const u8 *buf);
+
+/*****************************************************************************
+ *
+ *   Name:       get_u32
+ *
+ *   Input:      buf         Four bytes, little endian
+ *   Return:     Success     The value
+ *               Failed      None
+ *   Description            Read a little endian u32 from any address
+ ******************************************************************************/
+static inline u32 get_u32(const u8 *buf);
+
+/*****************************************************************************
+ *
+ *   Name:       put_u16
+ *
+ *   Input:      buf         Gets two bytes
+ *               value       The value
+ *   Return:     Success     buf + 2
+ *               Failed      None
+ *   Description            Write a little endian u16 to any address
+ ******************************************************************************/
+static inline u8 *put_u16(u8 *buf, u32 value);
+
+/*****************************************************************************
+ *
+ *   Name:       put_u32
+ *
+ *   Input:      buf         Gets four bytes
+ *               value       The value
+ *   Return:     Success     buf + 4
+ *               Failed      None
+ *   Description            Write a little endian u32 to any address
+ ******************************************************************************/
+static inline u8 *put_u32(u8 *buf, u32 value);
+
+/*****************************************************************************
+ *
+ *   Name:       count_runs
+ *
+ *   Input:      bm          A valid bitmap
+ *   Return:     Success     Number of runs of set bits
+ *               Failed      None
+ *   Description            Count the runs a word at a time, a run starts at every set bit
+ *                           whose lower neighbour is clear
+ ******************************************************************************/
+static u32 count_runs(const struct bitmap *bm);
+
+/*****************************************************************************
+ *
+ *   Name:       read_container
+ *
+ *   Input:      buf         The container
+ *               len         Bytes left in the input
+ *               type        Type of the container
+ *               cardinality Number of values the header promised
+ *               words       Gets the values, ROARING_WORDS zeroed words
+ *   Return:     Success     Number of bytes used
+ *               Failed      0, the container is invalid or too short
+ *   Description            Decode one container into words
+ ******************************************************************************/
+static size_t read_container(const u8 *buf, size_t len, enum roaring_container type,
+                             u32 cardinality, u32 *words);
+
+static inline u16 get_u16(const u8 *buf)
+{
+    return (u16)(buf[0] | (buf[1] << 8));
+}
+
+static inline u32 get_u32(const u8 *buf)
+{
+    return (u32)buf[0] | ((u32)buf[1] << 8) | ((u32)buf[2] << 16) | ((u32)buf[3] << 24);
+}
+
+static inline u8 *put_u16(u8 *buf, u32 value)
+{
+    buf[0] = (u8)value;
+    buf[1] = (u8)(value >> 8);
+
+    return buf + 2;
+}
+
+static inline u8 *put_u32(u8 *buf, u32 value)
+{
+    buf[0] = (u8)value;
+    buf[1] = (u8)(value >> 8);
+    buf[2] = (u8)(value >> 16);
+    buf[3] = (u8)(value >> 24);
+
+    return buf + 4;
+}
+
+static u32 count_runs(const struct bitmap *bm)
+{
+    u32 runs = 0;
+    u32 carry = 0;
+    u32 word = 0;
+    u16 i = 0;
+
+    for (i = 0; i < bm->buf_len; i++)
+    {
+        word = bm->buf[i];
+        runs += (u32)__builtin_popcount(word & ~((word << 1) | carry));
+        carry = word >> (BITSIZEOF(u32) - 1);
+    }
+
+    return runs;
+}
+
+static size_t read_container(const u8 *buf, size_t len, enum roaring_container type,
+                             u32 cardinality, u32 *words)
+{
+    size_t size = 0;
+    u32 runs = 0;
+    u32 count = 0;
+    u32 start = 0;
+    u32 run_len = 0;
+    u32 value = 0;
+    u32 next = 0; /* Values below next were already seen */
+    u32 i = 0;
+
+    switch (type)
+    {
+        case ROARING_ARRAY:
+            size = (size_t)cardinality * sizeof(u16);
+
+            if (len < size)
+            {
+                return 0;
+            }
+
+            for (i = 0; i < cardinality; i++)
+            {
+                value = get_u16(buf + i * sizeof(u16));
+
+                /* Sorted and without duplicates */
+                if (value < next)
+                {
+                    return 0;
+                }
+
+                words[value / BITSIZEOF(u32)] |= 1U << (value % BITSIZEOF(u32));
+                next = value + 1;
+            }
+
+            break;
+
+        case ROARING_BITMAP:
+            size = ROARING_BITMAP_BYTES;
+
+            if (len < size)
+            {
+                return 0;
+            }
+
+            memcpy(words, buf, size);
+
+            for (i = 0; i < ROARING_WORDS; i++)
+            {
+                count += (u32)__builtin_popcount(words[i]);
+            }
+
+            if (count != cardinality)
+            {
+                return 0;
+            }
+
+            break;
+
+        case ROARING_RUN:
+            if (len < sizeof(u16))
+            {
+                return 0;
+            }
+
+            runs = get_u16(buf);
+            size = sizeof(u16) + (size_t)runs * 2 * sizeof(u16);
+
+            if (len < size)
+            {
+                return 0;
+            }
+
+            for (i = 0; i < runs; i++)
+            {
+                start = get_u16(buf + sizeof(u16) + i * 2 * sizeof(u16));
+                run_len = (u32)get_u16(buf + 2 * sizeof(u16) + i * 2 * sizeof(u16)) + 1;
+
+                /* Sorted, not overlapping and inside the container */
+                if (start < next || start + run_len > UINT16_MAX + 1U)
+                {
+                    return 0;
+                }
+
+                fill_words(words, (u16)start, (u16)(start + run_len - 1));
+                count += run_len;
+                next = start + run_len;
+            }
+
+            if (count != cardinality)
+            {
+                return 0;
+            }
+
+            break;
+    }
+
+    return size;
+}
+
+struct bitmap *bitmap_read_roaring(const u8 *buf, size_t len, u16 capacity, size_t *consumed)
+{
+    u32 words[ROARING_WORDS];
+    struct bitmap *bm = NULL;
+    enum roaring_container type = ROARING_ARRAY;
+    size_t pos = 0;
+    size_t used = 0;
+    u32 cookie = 0;
+    u32 containers = 0;
+    u32 cardinality = 0;
+    u32 last = 0;
+    u32 i = 0;
+    bool run_container = false;
+    bool has_offsets = true;
+
+    if (buf == NULL || len < sizeof(u32))
+    {
+        return NULL;
+    }
+
+    cookie = get_u32(buf);
+    pos = sizeof(u32);
+
+    if ((cookie & 0xffff) == BITMAP_ROARING_COOKIE)
+    {
+        containers = (cookie >> 16) + 1;
+
+        /* One bit per container, set for run containers */
+        if (len < pos + (containers + 7) / 8)
+        {
+            return NULL;
+        }
+
+        run_container = buf[pos] & 1;
+        pos += (containers + 7) / 8;
+        has_offsets = containers >= ROARING_NO_OFFSET_THRESHOLD;
+    }
+    else if (cookie == BITMAP_ROARING_COOKIE_NO_RUN)
+    {
+        if (len < pos + sizeof(u32))
+        {
+            return NULL;
+        }
+
+        containers = get_u32(buf + pos);
+        pos += sizeof(u32);
+    }
+    else
+    {
+        debug("Not a Roaring bitmap, cookie %u\n", cookie);
+        return NULL;
+    }
+
+    /* A second container would hold values from 65536 on */
+    if (containers > 1)
+    {
+        return NULL;
+    }
+
+    memset(words, 0, sizeof(words));
+
+    if (containers == 1)
+    {
+        if (len < pos + 2 * sizeof(u16))
+        {
+            return NULL;
+        }
+
+        if (get_u16(buf + pos) != 0)
+        {
+            return NULL;
+        }
+
+        cardinality = (u32)get_u16(buf + pos + sizeof(u16)) + 1;
+        pos += 2 * sizeof(u16);
+
+        if (has_offsets)
+        {
+            if (len < pos + sizeof(u32))
+            {
+                return NULL;
+            }
+
+            pos += sizeof(u32);
+        }
+
+        if (run_container)
+        {
+            type = ROARING_RUN;
+        }
+        else if (cardinality > ROARING_ARRAY_MAX)
+        {
+            type = ROARING_BITMAP;
+        }
+
+        used = read_container(buf + pos, len - pos, type, cardinality, words);
+
+        if (used == 0)
+        {
+            debug("Invalid container\n");
+            return NULL;
+        }
+
+        pos += used;
+    }
+
+    /* Largest value, it decides the capacity and must fit in it */
+    for (i = ROARING_WORDS; i-- > 0;)
+    {
+        if (words[i] != 0)
+        {
+            last = i * BITSIZEOF(u32) + (BITSIZEOF(u32) - 1 - (u32)__builtin_clz(words[i]));
+            break;
+        }
+    }
+
+    if (cardinality > 0 && (last >= UINT16_MAX || (capacity != 0 && last >= capacity)))
+    {
+        return NULL;
+    }
+
+    if (capacity == 0)
+    {
+        if (cardinality == 0)
+        {
+            return NULL;
+        }
+
+        capacity = (u16)(last + 1);
+    }
+
+    bm = bitmap_create(capacity);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(bm->buf, words, bm->buf_len * sizeof(u32));
+    update_info(bm);
+
+    if (consumed != NULL)
+    {
+        *consumed = pos;
+    }
+
+    return bm;
+}
+
+size_t bitmap_write_roaring(const struct bitmap *bm, u8 *buf, size_t len)
+{
+    enum roaring_container type = ROARING_ARRAY;
+    size_t container_size = 0;
+    size_t size = 0;
+    u8 *pos = NULL;
+    u32 runs = 0;
+    u32 word = 0;
+    u32 start = 0;
+    u32 end = 0;
+    u16 i = 0;
+
+    if (!bitmap_check(bm))
+    {
+        return 0;
+    }
+
+    if (bm->numbers == 0)
+    {
+        /* Cookie and a container count of 0 */
+        size = 2 * sizeof(u32);
+
+        if (len >= size)
+        {
+            pos = put_u32(buf, BITMAP_ROARING_COOKIE_NO_RUN);
+            put_u32(pos, 0);
+        }
+
+        return size;
+    }
+
+    /* Pick the smallest container, runs only when they beat the other two */
+    runs = count_runs(bm);
+    type = (bm->numbers > ROARING_ARRAY_MAX) ? ROARING_BITMAP : ROARING_ARRAY;
+    container_size =
+        (type == ROARING_BITMAP) ? ROARING_BITMAP_BYTES : (size_t)bm->numbers * sizeof(u16);
+
+    if (sizeof(u16) + (size_t)runs * 2 * sizeof(u16) < container_size)
+    {
+        type = ROARING_RUN;
+        container_size = sizeof(u16) + (size_t)runs * 2 * sizeof(u16);
+    }
+
+    /* Cookie, then a run bit set of one byte or the container count and an offset */
+    size = sizeof(u32) + 2 * sizeof(u16) + container_size;
+    size += (type == ROARING_RUN) ? 1 : 2 * sizeof(u32);
+
+    if (len < size)
+    {
+        return size;
+    }
+
+    if (type == ROARING_RUN)
+    {
+        pos = put_u32(buf, BITMAP_ROARING_COOKIE); /* Container count - 1 = 0 above the cookie */
+        *pos++ = 1;
+    }
+    else
+    {
+        pos = put_u32(buf, BITMAP_ROARING_COOKIE_NO_RUN);
+        pos = put_u32(pos, 1);
+    }
+
+    pos = put_u16(pos, 0);
+    pos = put_u16(pos, (u32)bm->numbers - 1);
+
+    if (type != ROARING_RUN)
+    {
+        pos = put_u32(pos, (u32)(pos - buf) + sizeof(u32));
+    }
+
+    switch (type)
+    {
+        case ROARING_ARRAY:
+            for (i = 0; i < bm->buf_len; i++)
+            {
+                for (word = bm->buf[i]; word != 0; word &= word - 1)
+                {
+                    pos = put_u16(pos, i * BITSIZEOF(u32) + (u32)__builtin_ctz(word));
+                }
+            }
+
+            break;
+
+        case ROARING_BITMAP:
+            memcpy(pos, bm->buf, bm->buf_len * sizeof(u32));
+            memset(pos + bm->buf_len * sizeof(u32), 0,
+                   ROARING_BITMAP_BYTES - bm->buf_len * sizeof(u32));
+            break;
+
+        case ROARING_RUN:
+            pos = put_u16(pos, runs);
+
+            while (bitmap_next_run(bm, start, &start, &end))
+            {
+                pos = put_u16(pos, start);
+                pos = put_u16(pos, end - start);
+                start = end + 2; /* end + 1 is clear */
+            }
+
+            break;
+    }
+
+    return size;
+}
@@ -0,0 +1,363 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-shm.h"
+#include "bitmap.h"
+
+_Static_assert(sizeof(struct bitmap_shm_header) == BITMAP_SHM_HEADER_SIZE,
+               "bitmap_shm_header is shared between processes");
+
+/*****************************************************************************
+ *
+ *   Name:       shm_attach
+ *
+ *   Input:      shm         Caller owned memory for the mapping
+ *               map         The mapped segment, its header checked
+ *               map_len     Size of the mapping
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Point the process local view at a mapped segment
+ ******************************************************************************/
+static void shm_attach(struct bitmap_shm *shm, void *map, size_t map_len);
+
+/*****************************************************************************
+ *
+ *   Name:       shm_word
+ *
+ *   Input:      shm         A mapping
+ *               value       A value below the capacity
+ *   Return:     Success     The shared word holding value
+ *               Failed      None
+ *   Description            Locate the word of a value
+ ******************************************************************************/
+static inline u32 *shm_word(struct bitmap_shm *shm, u16 value);
+
+/*****************************************************************************
+ *
+ *   Name:       shm_lower_first
+ *
+ *   Input:      header      The shared header
+ *               value       A value that was just added
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Move the shared lower bound down to value
+ ******************************************************************************/
+static void shm_lower_first(struct bitmap_shm_header *header, u16 value);
+
+/*****************************************************************************
+ *
+ *   Name:       shm_raise_last
+ *
+ *   Input:      header      The shared header
+ *               value       A value that was just added
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Move the shared upper bound up to value
+ ******************************************************************************/
+static void shm_raise_last(struct bitmap_shm_header *header, u16 value);
+
+static void shm_attach(struct bitmap_shm *shm, void *map, size_t map_len)
+{
+    struct bitmap_shm_header *header = (struct bitmap_shm_header *)map;
+
+    shm->header = header;
+    shm->map_len = map_len;
+
+    /* Like bitmap_init_external, the summary is filled in by bitmap_shm_bitmap */
+    shm->bm.bm_self = &shm->bm;
+    shm->bm.buf = (u32 *)((u8 *)map + header->words_offset);
+    shm->bm.allocator = NULL;
+    shm->bm.max_value = header->max_value;
+    shm->bm.buf_len = header->buf_len;
+    shm->bm.numbers = 0;
+    shm->bm.first_value = UINT16_MAX;
+    shm->bm.last_value = 0;
+    shm->bm.flags = BITMAP_FLAG_EXTERNAL | BITMAP_FLAG_READONLY;
+    mark_all_dirty(&shm->bm);
+
+    return;
+}
+
+static inline u32 *shm_word(struct bitmap_shm *shm, u16 value)
+{
+    return &shm->bm.buf[value / BITSIZEOF(u32)];
+}
+
+static void shm_lower_first(struct bitmap_shm_header *header, u16 value)
+{
+    u16 first = __atomic_load_n(&header->first_value, __ATOMIC_RELAXED);
+
+    while (value < first && !__atomic_compare_exchange_n(&header->first_value, &first, value,
+                                                         true, __ATOMIC_RELAXED,
+                                                         __ATOMIC_RELAXED))
+    {
+    }
+
+    return;
+}
+
+static void shm_raise_last(struct bitmap_shm_header *header, u16 value)
+{
+    u16 last = __atomic_load_n(&header->last_value, __ATOMIC_RELAXED);
+
+    while (value > last && !__atomic_compare_exchange_n(&header->last_value, &last, value, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+
+    return;
+}
+
+bool bitmap_shm_create(struct bitmap_shm *shm, const char *name, u16 capacity)
+{
+    struct bitmap_shm_header *header = NULL;
+    void *map = MAP_FAILED;
+    size_t map_len = 0;
+    u16 buf_len = 0;
+    int fd = -1;
+
+    if (shm == NULL || name == NULL || capacity == 0)
+    {
+        return false;
+    }
+
+    buf_len = words_for_capacity(capacity);
+    map_len = BITMAP_SHM_HEADER_SIZE + buf_len * sizeof(u32);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    /* A new segment reads as zeros, so the words are already empty */
+    if (ftruncate(fd, (off_t)map_len) != 0)
+    {
+        goto failed;
+    }
+
+    map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        goto failed;
+    }
+
+    close(fd);
+
+    header = (struct bitmap_shm_header *)map;
+    header->version = BITMAP_SHM_VERSION;
+    header->max_value = capacity;
+    header->buf_len = buf_len;
+    header->words_offset = BITMAP_SHM_HEADER_SIZE;
+    header->numbers = 0;
+    header->first_value = UINT16_MAX;
+    header->last_value = 0;
+
+    /* The magic publishes the header, an opener that sees it sees the rest */
+    __atomic_store_n(&header->magic, BITMAP_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    shm_attach(shm, map, map_len);
+
+    return true;
+
+failed:
+    close(fd);
+    shm_unlink(name);
+
+    return false;
+}
+
+bool bitmap_shm_open(struct bitmap_shm *shm, const char *name)
+{
+    struct bitmap_shm_header *header = NULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    size_t map_len = 0;
+    int fd = -1;
+
+    if (shm == NULL || name == NULL)
+    {
+        return false;
+    }
+
+    fd = shm_open(name, O_RDWR, 0);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < BITMAP_SHM_HEADER_SIZE)
+    {
+        close(fd);
+        return false;
+    }
+
+    map_len = (size_t)st.st_size;
+    map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    header = (struct bitmap_shm_header *)map;
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != BITMAP_SHM_MAGIC ||
+        header->version != BITMAP_SHM_VERSION || header->max_value == 0 ||
+        header->buf_len != words_for_capacity(header->max_value) ||
+        header->words_offset < BITMAP_SHM_HEADER_SIZE || header->words_offset % sizeof(u32) != 0 ||
+        map_len < header->words_offset + header->buf_len * sizeof(u32))
+    {
+        munmap(map, map_len);
+        return false;
+    }
+
+    shm_attach(shm, map, map_len);
+
+    return true;
+}
+
+void bitmap_shm_close(struct bitmap_shm *shm)
+{
+    if (shm == NULL || shm->header == NULL)
+    {
+        return;
+    }
+
+    munmap(shm->header, shm->map_len);
+    shm->header = NULL;
+    shm->bm.bm_self = NULL;
+
+    return;
+}
+
+bool bitmap_shm_unlink(const char *name)
+{
+    return name != NULL && shm_unlink(name) == 0;
+}
+
+bool bitmap_shm_add(struct bitmap_shm *shm, u16 value)
+{
+    u32 mask = 0;
+    u32 old = 0;
+
+    if (shm == NULL || shm->header == NULL || value >= shm->bm.max_value)
+    {
+        return false;
+    }
+
+    mask = 1U << (value % BITSIZEOF(u32));
+    old = __atomic_fetch_or(shm_word(shm, value), mask, __ATOMIC_RELEASE);
+
+    /* Only the process that flipped the bit counts it */
+    if (!(old & mask))
+    {
+        __atomic_fetch_add(&shm->header->numbers, 1, __ATOMIC_RELAXED);
+        shm_lower_first(shm->header, value);
+        shm_raise_last(shm->header, value);
+    }
+
+    return true;
+}
+
+bool bitmap_shm_del(struct bitmap_shm *shm, u16 value)
+{
+    u32 mask = 0;
+    u32 old = 0;
+
+    if (shm == NULL || shm->header == NULL || value >= shm->bm.max_value)
+    {
+        return false;
+    }
+
+    mask = 1U << (value % BITSIZEOF(u32));
+    old = __atomic_fetch_and(shm_word(shm, value), ~mask, __ATOMIC_RELEASE);
+
+    if (old & mask)
+    {
+        __atomic_fetch_sub(&shm->header->numbers, 1, __ATOMIC_RELAXED);
+    }
+
+    return true;
+}
+
+bool bitmap_shm_test(struct bitmap_shm *shm, u16 value)
+{
+    u32 word = 0;
+
+    if (shm == NULL || shm->header == NULL || value >= shm->bm.max_value)
+    {
+        return false;
+    }
+
+    word = __atomic_load_n(shm_word(shm, value), __ATOMIC_ACQUIRE);
+
+    return (word >> (value % BITSIZEOF(u32))) & 1U;
+}
+
+u32 bitmap_shm_count(struct bitmap_shm *shm)
+{
+    if (shm == NULL || shm->header == NULL)
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(&shm->header->numbers, __ATOMIC_RELAXED);
+}
+
+struct bitmap *bitmap_shm_bitmap(struct bitmap_shm *shm)
+{
+    struct bitmap *bm = NULL;
+    u32 word = 0;
+    u32 numbers = 0;
+    u16 first = 0;
+    u16 last = 0;
+    u16 i = 0;
+
+    if (shm == NULL || shm->header == NULL)
+    {
+        return NULL;
+    }
+
+    bm = &shm->bm;
+    first = __atomic_load_n(&shm->header->first_value, __ATOMIC_RELAXED);
+    last = __atomic_load_n(&shm->header->last_value, __ATOMIC_RELAXED);
+    bm->first_value = UINT16_MAX;
+    bm->last_value = 0;
+
+    /* Values are only inside the shared bounds, scan the words there once */
+    if (first <= last && last < bm->max_value)
+    {
+        for (i = first / BITSIZEOF(u32); i <= last / BITSIZEOF(u32); i++)
+        {
+            word = __atomic_load_n(&bm->buf[i], __ATOMIC_ACQUIRE);
+
+            if (word == 0)
+            {
+                continue;
+            }
+
+            if (numbers == 0)
+            {
+                bm->first_value = (u16)(i * BITSIZEOF(u32) + __builtin_ctz(word));
+            }
+
+            bm->last_value = (u16)(i * BITSIZEOF(u32) + BITSIZEOF(u32) - 1 - __builtin_clz(word));
+            numbers += (u32)__builtin_popcount(word);
+        }
+    }
+
+    bm->numbers = (u16)numbers;
+
+    /* Other processes write the words without marking blocks, so a snapshot is all new */
+    mark_all_dirty(bm);
+
+    return bm;
+}
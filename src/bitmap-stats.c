@@ -0,0 +1,260 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-stats.h"
+#include "bitmap.h"
+
+static const char *const op_names[BITMAP_STATS_OPS] = {
+    "create", "resize", "add", "del", "add_values", "del_values",
+    "test",   "clone",  "not", "or",  "and",        "rescan",
+};
+
+#ifdef BITMAP_STATS
+
+/* The counters of one thread, only that thread writes them */
+struct stats_thread
+{
+    struct bitmap_stats stats;
+    struct stats_thread *prev;
+    struct stats_thread *next;
+};
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static struct stats_thread *stats_threads; /* Threads that counted and still run */
+static struct bitmap_stats stats_retired; /* Sum of the threads that exited */
+static __thread struct stats_thread *stats_self;
+
+/*****************************************************************************
+ *
+ *   Name:       stats_key_init
+ *
+ *   Input:      None
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Create the key whose destructor retires the thread counters
+ ******************************************************************************/
+static void stats_key_init(void);
+
+/*****************************************************************************
+ *
+ *   Name:       stats_thread_exit
+ *
+ *   Input:      arg         The struct stats_thread of the exiting thread
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Move the counters of a thread into stats_retired
+ ******************************************************************************/
+static void stats_thread_exit(void *arg);
+
+/*****************************************************************************
+ *
+ *   Name:       stats_thread_get
+ *
+ *   Input:      None
+ *   Return:     Success     The counters of the calling thread
+ *               Failed      NULL, out of memory, the call is not counted
+ *   Description            Find or register the counters of the calling thread
+ ******************************************************************************/
+static struct stats_thread *stats_thread_get(void);
+
+/*****************************************************************************
+ *
+ *   Name:       stats_add
+ *
+ *   Input:      stats_store Gets the counters added
+ *               stats       Counters another thread may be writing
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Add up counters, reading each once
+ ******************************************************************************/
+static void stats_add(struct bitmap_stats *stats_store, const struct bitmap_stats *stats);
+
+static void stats_key_init(void)
+{
+    pthread_key_create(&stats_key, stats_thread_exit);
+
+    return;
+}
+
+static void stats_add(struct bitmap_stats *stats_store, const struct bitmap_stats *stats)
+{
+    const uint64_t *src = (const uint64_t *)stats;
+    uint64_t *dst = (uint64_t *)stats_store;
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(struct bitmap_stats) / sizeof(uint64_t); i++)
+    {
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+
+    return;
+}
+
+static void stats_thread_exit(void *arg)
+{
+    struct stats_thread *self = (struct stats_thread *)arg;
+
+    pthread_mutex_lock(&stats_lock);
+
+    stats_add(&stats_retired, &self->stats);
+
+    if (self->prev != NULL)
+    {
+        self->prev->next = self->next;
+    }
+    else
+    {
+        stats_threads = self->next;
+    }
+
+    if (self->next != NULL)
+    {
+        self->next->prev = self->prev;
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+    free(self);
+    stats_self = NULL; /* A later destructor that calls the library registers again */
+
+    return;
+}
+
+static struct stats_thread *stats_thread_get(void)
+{
+    struct stats_thread *self = stats_self;
+
+    if (self != NULL)
+    {
+        return self;
+    }
+
+    pthread_once(&stats_once, stats_key_init);
+    self = (struct stats_thread *)calloc(1, sizeof(struct stats_thread));
+
+    if (self == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    self->next = stats_threads;
+
+    if (stats_threads != NULL)
+    {
+        stats_threads->prev = self;
+    }
+
+    stats_threads = self;
+    pthread_mutex_unlock(&stats_lock);
+
+    pthread_setspecific(stats_key, self);
+    stats_self = self;
+
+    return self;
+}
+
+uint64_t stats_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void stats_scope_end(struct stats_scope *scope)
+{
+    struct stats_thread *self = stats_thread_get();
+    struct bitmap_stats_counters *counters = NULL;
+    uint64_t ns = stats_now_ns() - scope->start_ns;
+    u32 bucket = 0;
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    counters = &self->stats.ops[scope->op];
+    bucket = (ns == 0) ? 0 : 63 - (u32)__builtin_clzll(ns);
+    bucket = (bucket < BITMAP_STATS_BUCKETS) ? bucket : BITMAP_STATS_BUCKETS - 1;
+
+    /* Plain increments, the relaxed stores only keep a snapshot from reading torn values */
+    __atomic_store_n(&counters->calls, counters->calls + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters->words, counters->words + scope->words, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters->latency[bucket], counters->latency[bucket] + 1, __ATOMIC_RELAXED);
+
+    return;
+}
+
+bool bitmap_stats_snapshot(struct bitmap_stats *stats)
+{
+    struct stats_thread *thread = NULL;
+
+    if (stats == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    *stats = stats_retired;
+
+    for (thread = stats_threads; thread != NULL; thread = thread->next)
+    {
+        stats_add(stats, &thread->stats);
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+
+    return true;
+}
+
+#else
+
+bool bitmap_stats_snapshot(struct bitmap_stats *stats)
+{
+    (void)stats;
+
+    return false;
+}
+
+#endif /* BITMAP_STATS */
+
+const char *bitmap_stats_op_name(u32 op)
+{
+    return (op < BITMAP_STATS_OPS) ? op_names[op] : NULL;
+}
+
+uint64_t bitmap_stats_percentile(const struct bitmap_stats_counters *counters, u32 percent)
+{
+    uint64_t rank = 0;
+    uint64_t seen = 0;
+    u32 i = 0;
+
+    if (counters == NULL || counters->calls == 0)
+    {
+        return 0;
+    }
+
+    percent = (percent < 100) ? percent : 100;
+
+    /* Nearest rank, at least the first call */
+    rank = (counters->calls * percent + 99) / 100;
+    rank = (rank != 0) ? rank : 1;
+
+    for (i = 0; i < BITMAP_STATS_BUCKETS - 1; i++)
+    {
+        seen += counters->latency[i];
+
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+
+    return (uint64_t)2 << i;
+}
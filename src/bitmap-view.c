@@ -0,0 +1,183 @@
+#include "bitmap-internal.h"
+#include "bitmap-view.h"
+
+/*****************************************************************************
+ *
+ *   Name:       view_len
+ *
+ *   Input:      view        A view
+ *   Return:     Success     Number of bits in the view
+ *               Failed      None
+ *   Description            Get the size of a view
+ ******************************************************************************/
+static inline u32 view_len(const struct bitmap_view *view);
+
+/*****************************************************************************
+ *
+ *   Name:       view_word
+ *
+ *   Input:      view        A view
+ *               index       Index of the 32 bit word of the view
+ *   Return:     Success     Bits [index * 32, index * 32 + 32) of the view, bits past the
+ *                           end of the view are 0
+ *               Failed      None
+ *   Description            Read a word of a view, shifting it out of the bitmap words
+ *                           when start is not word aligned
+ ******************************************************************************/
+static inline u32 view_word(const struct bitmap_view *view, u32 index);
+
+/*****************************************************************************
+ *
+ *   Name:       view_check
+ *
+ *   Input:      view        A view that need to check
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Check a view and the bitmap it looks at
+ ******************************************************************************/
+static bool view_check(const struct bitmap_view *view);
+
+static inline u32 view_len(const struct bitmap_view *view)
+{
+    return (u32)view->end - view->start;
+}
+
+static inline u32 view_word(const struct bitmap_view *view, u32 index)
+{
+    u32 bit = 0;
+    u32 word_index = 0;
+    u32 shift = 0;
+    u32 word = 0;
+    u32 remaining = 0;
+
+    bit = view->start + index * BITSIZEOF(u32);
+    word_index = bit / BITSIZEOF(u32);
+    shift = bit % BITSIZEOF(u32);
+
+    word = view->bm->buf[word_index] >> shift;
+
+    if (shift != 0 && word_index + 1 < view->bm->buf_len)
+    {
+        word |= view->bm->buf[word_index + 1] << (BITSIZEOF(u32) - shift);
+    }
+
+    remaining = view_len(view) - index * BITSIZEOF(u32);
+
+    if (remaining < BITSIZEOF(u32))
+    {
+        word &= (1U << remaining) - 1;
+    }
+
+    return word;
+}
+
+static bool view_check(const struct bitmap_view *view)
+{
+    if (view == NULL || !bitmap_check(view->bm))
+    {
+        return false;
+    }
+
+    if (view->start > view->end || view->end > view->bm->max_value)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool bitmap_view_init(struct bitmap_view *view, const struct bitmap *bm, u16 start, u16 end)
+{
+    if (view == NULL)
+    {
+        return false;
+    }
+
+    view->bm = bm;
+    view->start = start;
+    view->end = end;
+
+    return view_check(view);
+}
+
+u32 bitmap_view_count(const struct bitmap_view *view)
+{
+    u32 i = 0;
+    u32 words = 0;
+    u32 count = 0;
+
+    if (!view_check(view))
+    {
+        return 0;
+    }
+
+    /* The summary already holds the answer for a view of the whole bitmap */
+    if (view->start == 0 && view->end == view->bm->max_value)
+    {
+        return view->bm->numbers;
+    }
+
+    words = (view_len(view) + BITSIZEOF(u32) - 1) / BITSIZEOF(u32);
+
+    for (i = 0; i < words; i++)
+    {
+        count += (u32)__builtin_popcount(view_word(view, i));
+    }
+
+    return count;
+}
+
+int32_t bitmap_view_next(const struct bitmap_view *view, u32 from)
+{
+    u32 i = 0;
+    u32 words = 0;
+    u32 word = 0;
+
+    if (!view_check(view) || from >= view_len(view))
+    {
+        return BITMAP_VIEW_END;
+    }
+
+    words = (view_len(view) + BITSIZEOF(u32) - 1) / BITSIZEOF(u32);
+    i = from / BITSIZEOF(u32);
+
+    /* Drop the bits before from in the first word */
+    word = view_word(view, i) & ~((1U << (from % BITSIZEOF(u32))) - 1);
+
+    while (word == 0)
+    {
+        if (++i >= words)
+        {
+            return BITMAP_VIEW_END;
+        }
+
+        word = view_word(view, i);
+    }
+
+    return (int32_t)(i * BITSIZEOF(u32) + __builtin_ctz(word));
+}
+
+u32 bitmap_view_and_count(const struct bitmap_view *view1, const struct bitmap_view *view2)
+{
+    u32 i = 0;
+    u32 len = 0;
+    u32 words = 0;
+    u32 count = 0;
+
+    if (!view_check(view1) || !view_check(view2))
+    {
+        return 0;
+    }
+
+    /* AND only upto minimum size of the two views */
+    len = (view_len(view1) < view_len(view2)) ? view_len(view1) : view_len(view2);
+    words = (len + BITSIZEOF(u32) - 1) / BITSIZEOF(u32);
+
+    for (i = 0; i < words; i++)
+    {
+        /* The shorter view reads 0 past its end, so the AND drops the rest of the longer one */
+        count += (u32)__builtin_popcount(view_word(view1, i) & view_word(view2, i));
+    }
+
+    return count;
+}
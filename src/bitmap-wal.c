@@ -0,0 +1,559 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitmap-internal.h"
+#include "bitmap-io.h"
+#include "bitmap-wal.h"
+#include "bitmap.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error "log records are little endian, add byte swapping for this target"
+#endif
+
+#define WAL_MAGIC 0x4c415742 /* "BWAL" */
+#define WAL_VERSION 1
+#define WAL_SUFFIX ".wal"
+#define WAL_BUFFER_DEFAULT (64 * 1024)
+#define WAL_RECORD_VALUES 4096 /* Longer batches are split over several records */
+#define WAL_OP_ADD 1
+#define WAL_OP_DEL 2
+
+/* Start of the log file */
+struct wal_file_header
+{
+    u32 magic;    /* WAL_MAGIC */
+    u16 version;  /* WAL_VERSION */
+    u16 reserved;
+};
+
+/* One batch of adds or deletes, followed by count u16 values */
+struct wal_record_header
+{
+    u32 crc;     /* CRC32C of the rest of the record, op to the last value */
+    u8 op;       /* WAL_OP_* */
+    u8 reserved;
+    u16 count;
+};
+
+struct bitmap_wal
+{
+    struct bitmap *bm;
+    char *path;            /* The snapshot */
+    int fd;                /* The log, opened O_APPEND */
+    size_t log_size;       /* Bytes in the log file */
+    u8 *buffer;            /* Records not written yet */
+    size_t buffer_len;
+    size_t buffer_size;
+    int sync;              /* BITMAP_WAL_SYNC_* */
+    u32 sync_interval_ms;
+    size_t compact_size;
+    uint64_t last_sync_ms;
+    bool unsynced;         /* Records were written since the last sync */
+};
+
+/*****************************************************************************
+ *
+ *   Name:       now_ms
+ *
+ *   Input:      None
+ *   Return:     Success     A monotonic time in milliseconds
+ *               Failed      None
+ *   Description            Clock of the interval sync policy
+ ******************************************************************************/
+static uint64_t now_ms(void);
+
+/*****************************************************************************
+ *
+ *   Name:       wal_write
+ *
+ *   Input:      wal         A logged bitmap
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Write the buffered records to the log with one write
+ ******************************************************************************/
+static bool wal_write(struct bitmap_wal *wal);
+
+/*****************************************************************************
+ *
+ *   Name:       wal_sync
+ *
+ *   Input:      wal         A logged bitmap
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            fdatasync the written records
+ ******************************************************************************/
+static bool wal_sync(struct bitmap_wal *wal);
+
+/*****************************************************************************
+ *
+ *   Name:       wal_reserve
+ *
+ *   Input:      wal         A logged bitmap
+ *               count       Number of values of the next change
+ *   Return:     Success     true, wal_append of count values fits in the buffer
+ *               Failed      false, a full buffer could not be written or grown
+ *   Description            Make room for the records of a change before it is applied
+ ******************************************************************************/
+static bool wal_reserve(struct bitmap_wal *wal, size_t count);
+
+/*****************************************************************************
+ *
+ *   Name:       wal_append
+ *
+ *   Input:      wal         A logged bitmap, wal_reserve for count succeeded
+ *               op          WAL_OP_ADD or WAL_OP_DEL
+ *               values      The values of the change
+ *               count       Number of values
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Buffer the records of a change
+ ******************************************************************************/
+static void wal_append(struct bitmap_wal *wal, u8 op, const u16 *values, size_t count);
+
+/*****************************************************************************
+ *
+ *   Name:       wal_replay
+ *
+ *   Input:      wal         A logged bitmap with the snapshot loaded and the log open
+ *   Return:     Success     true
+ *               Failed      false, the log is not a log or a record does not apply
+ *   Description            Apply the records of the log, cut off a torn tail, and start an
+ *                           empty log when there is none
+ ******************************************************************************/
+static bool wal_replay(struct bitmap_wal *wal);
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static bool wal_write(struct bitmap_wal *wal)
+{
+    ssize_t ret = 0;
+    size_t done = 0;
+
+    while (done < wal->buffer_len)
+    {
+        ret = write(wal->fd, wal->buffer + done, wal->buffer_len - done);
+
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (ret < 0)
+        {
+            /* Drop what went out, so the records are not written twice */
+            memmove(wal->buffer, wal->buffer + done, wal->buffer_len - done);
+            wal->buffer_len -= done;
+            wal->log_size += done;
+            return false;
+        }
+
+        done += (size_t)ret;
+    }
+
+    wal->log_size += done;
+    wal->unsynced = wal->unsynced || done > 0;
+    wal->buffer_len = 0;
+
+    return true;
+}
+
+static bool wal_sync(struct bitmap_wal *wal)
+{
+    if (wal->unsynced && fdatasync(wal->fd) != 0)
+    {
+        return false;
+    }
+
+    wal->unsynced = false;
+    wal->last_sync_ms = now_ms();
+
+    return true;
+}
+
+static bool wal_reserve(struct bitmap_wal *wal, size_t count)
+{
+    size_t records = (count + WAL_RECORD_VALUES - 1) / WAL_RECORD_VALUES;
+    size_t size = records * sizeof(struct wal_record_header) + count * sizeof(u16);
+    u8 *buffer = NULL;
+
+    if (wal->buffer_len + size <= wal->buffer_size)
+    {
+        return true;
+    }
+
+    if (!wal_write(wal))
+    {
+        return false;
+    }
+
+    /* A change is buffered whole, so a failure never leaves half of it logged */
+    if (size > wal->buffer_size)
+    {
+        buffer = (u8 *)realloc(wal->buffer, size);
+
+        if (buffer == NULL)
+        {
+            return false;
+        }
+
+        wal->buffer = buffer;
+        wal->buffer_size = size;
+    }
+
+    return true;
+}
+
+static void wal_append(struct bitmap_wal *wal, u8 op, const u16 *values, size_t count)
+{
+    struct wal_record_header record;
+    size_t values_size = 0;
+    u16 n = 0;
+
+    while (count > 0)
+    {
+        n = (u16)((count < WAL_RECORD_VALUES) ? count : WAL_RECORD_VALUES);
+        values_size = n * sizeof(u16);
+
+        record.op = op;
+        record.reserved = 0;
+        record.count = n;
+        record.crc = crc32c(0, &record.op, sizeof(record) - offsetof(struct wal_record_header, op));
+        record.crc = crc32c(record.crc, values, values_size);
+
+        memcpy(wal->buffer + wal->buffer_len, &record, sizeof(record));
+        memcpy(wal->buffer + wal->buffer_len + sizeof(record), values, values_size);
+        wal->buffer_len += sizeof(record) + values_size;
+
+        values += n;
+        count -= n;
+    }
+
+    return;
+}
+
+static bool wal_replay(struct bitmap_wal *wal)
+{
+    struct wal_file_header header;
+    struct wal_record_header record;
+    struct stat st;
+    const u16 *values = NULL;
+    u8 *map = NULL;
+    size_t pos = 0;
+    size_t values_size = 0;
+    u32 records = 0;
+    bool ret = false;
+
+    if (fstat(wal->fd, &st) != 0)
+    {
+        return false;
+    }
+
+    /* A new log, or a crash before its header was written */
+    if ((size_t)st.st_size < sizeof(header))
+    {
+        header.magic = WAL_MAGIC;
+        header.version = WAL_VERSION;
+        header.reserved = 0;
+
+        if (ftruncate(wal->fd, 0) != 0 ||
+            write(wal->fd, &header, sizeof(header)) != sizeof(header) || fsync(wal->fd) != 0)
+        {
+            return false;
+        }
+
+        wal->log_size = sizeof(header);
+
+        return true;
+    }
+
+    map = (u8 *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, wal->fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    memcpy(&header, map, sizeof(header));
+
+    if (header.magic != WAL_MAGIC || header.version > WAL_VERSION)
+    {
+        debug("Not a bitmap log\n");
+        goto cleanup;
+    }
+
+    pos = sizeof(header);
+
+    while (pos + sizeof(record) <= (size_t)st.st_size)
+    {
+        memcpy(&record, map + pos, sizeof(record));
+        values_size = record.count * sizeof(u16);
+
+        if (pos + sizeof(record) + values_size > (size_t)st.st_size ||
+            record.crc != crc32c(0, map + pos + offsetof(struct wal_record_header, op),
+                                 sizeof(record) - offsetof(struct wal_record_header, op) +
+                                     values_size))
+        {
+            break; /* Torn write, everything before it is good */
+        }
+
+        values = (const u16 *)(map + pos + sizeof(record));
+
+        if (record.op == WAL_OP_ADD)
+        {
+            ret = bitmap_add_values(wal->bm, values, record.count);
+        }
+        else if (record.op == WAL_OP_DEL)
+        {
+            ret = bitmap_del_values(wal->bm, values, record.count);
+        }
+        else
+        {
+            ret = false;
+        }
+
+        if (!ret)
+        {
+            debug("Record at %zu does not apply\n", pos);
+            goto cleanup;
+        }
+
+        pos += sizeof(record) + values_size;
+        records++;
+    }
+
+    debug("Replayed %u records\n", records);
+
+    if (pos < (size_t)st.st_size && (ftruncate(wal->fd, (off_t)pos) != 0 || fsync(wal->fd) != 0))
+    {
+        ret = false;
+        goto cleanup;
+    }
+
+    wal->log_size = pos;
+    ret = true;
+
+cleanup:
+    munmap(map, (size_t)st.st_size);
+
+    return ret;
+}
+
+struct bitmap_wal *bitmap_wal_open(const char *path, const struct bitmap_wal_options *options)
+{
+    struct bitmap_wal *wal = NULL;
+    char *log_path = NULL;
+    size_t path_len = 0;
+
+    if (path == NULL || options == NULL)
+    {
+        return NULL;
+    }
+
+    wal = (struct bitmap_wal *)calloc(1, sizeof(struct bitmap_wal));
+
+    if (wal == NULL)
+    {
+        return NULL;
+    }
+
+    wal->fd = -1;
+    wal->sync = options->sync;
+    wal->sync_interval_ms = options->sync_interval_ms;
+    wal->compact_size = options->compact_size;
+    wal->buffer_size = (options->buffer_size != 0) ? options->buffer_size : WAL_BUFFER_DEFAULT;
+
+    /* A full record must fit */
+    if (wal->buffer_size < sizeof(struct wal_record_header) + WAL_RECORD_VALUES * sizeof(u16))
+    {
+        wal->buffer_size = sizeof(struct wal_record_header) + WAL_RECORD_VALUES * sizeof(u16);
+    }
+
+    path_len = strlen(path);
+    wal->path = strdup(path);
+    log_path = (char *)malloc(path_len + sizeof(WAL_SUFFIX));
+    wal->buffer = (u8 *)malloc(wal->buffer_size);
+
+    if (wal->path == NULL || log_path == NULL || wal->buffer == NULL)
+    {
+        goto failed;
+    }
+
+    memcpy(log_path, path, path_len);
+    memcpy(log_path + path_len, WAL_SUFFIX, sizeof(WAL_SUFFIX));
+
+    /* No snapshot yet is a new bitmap, a broken one is an error */
+    if (access(path, F_OK) == 0)
+    {
+        wal->bm = bitmap_load_file(path);
+    }
+    else if (errno == ENOENT)
+    {
+        wal->bm = bitmap_create(options->capacity);
+
+        if (wal->bm != NULL && options->autogrow)
+        {
+            bitmap_set_autogrow(wal->bm, true);
+        }
+    }
+
+    if (wal->bm == NULL)
+    {
+        goto failed;
+    }
+
+    wal->fd = open(log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    /* A log that was just created is lost in a crash until its directory is synced */
+    if (wal->fd < 0 || !wal_replay(wal) || !sync_dir(log_path))
+    {
+        goto failed;
+    }
+
+    wal->last_sync_ms = now_ms();
+    free(log_path);
+
+    return wal;
+
+failed:
+    if (wal->fd >= 0)
+    {
+        close(wal->fd);
+    }
+
+    bitmap_destroy(wal->bm);
+    free(wal->buffer);
+    free(wal->path);
+    free(wal);
+    free(log_path);
+
+    return NULL;
+}
+
+struct bitmap *bitmap_wal_bitmap(struct bitmap_wal *wal)
+{
+    return (wal != NULL) ? wal->bm : NULL;
+}
+
+bool bitmap_wal_add(struct bitmap_wal *wal, const u16 *values, size_t count)
+{
+    /* Room first, then the change: after either fails nothing was added or logged */
+    if (wal == NULL || !wal_reserve(wal, count) || !bitmap_add_values(wal->bm, values, count))
+    {
+        return false;
+    }
+
+    wal_append(wal, WAL_OP_ADD, values, count);
+
+    return true;
+}
+
+bool bitmap_wal_del(struct bitmap_wal *wal, const u16 *values, size_t count)
+{
+    if (wal == NULL || !wal_reserve(wal, count) || !bitmap_del_values(wal->bm, values, count))
+    {
+        return false;
+    }
+
+    wal_append(wal, WAL_OP_DEL, values, count);
+
+    return true;
+}
+
+bool bitmap_wal_commit(struct bitmap_wal *wal)
+{
+    if (wal == NULL || !wal_write(wal))
+    {
+        return false;
+    }
+
+    switch (wal->sync)
+    {
+        case BITMAP_WAL_SYNC_COMMIT:
+            if (!wal_sync(wal))
+            {
+                return false;
+            }
+
+            break;
+
+        case BITMAP_WAL_SYNC_INTERVAL:
+            if (now_ms() - wal->last_sync_ms >= wal->sync_interval_ms && !wal_sync(wal))
+            {
+                return false;
+            }
+
+            break;
+
+        default:
+            break;
+    }
+
+    if (wal->compact_size != 0 && wal->log_size >= wal->compact_size)
+    {
+        return bitmap_wal_compact(wal);
+    }
+
+    return true;
+}
+
+bool bitmap_wal_compact(struct bitmap_wal *wal)
+{
+    if (wal == NULL || !wal_write(wal))
+    {
+        return false;
+    }
+
+    /*
+     * The log stays valid until the new snapshot is in place, replaying it again is harmless.
+     * bitmap_save_file syncs the directory, so the old snapshot can not come back with the
+     * truncated log.
+     */
+    if (!bitmap_save_file(wal->bm, wal->path))
+    {
+        return false;
+    }
+
+    if (ftruncate(wal->fd, sizeof(struct wal_file_header)) != 0)
+    {
+        return false;
+    }
+
+    wal->log_size = sizeof(struct wal_file_header);
+    wal->unsynced = true;
+
+    return wal_sync(wal);
+}
+
+bool bitmap_wal_close(struct bitmap_wal *wal)
+{
+    bool ret = false;
+
+    if (wal == NULL)
+    {
+        return false;
+    }
+
+    ret = wal_write(wal) && wal_sync(wal);
+
+    close(wal->fd);
+    bitmap_destroy(wal->bm);
+    free(wal->buffer);
+    free(wal->path);
+    free(wal);
+
+    return ret;
+}
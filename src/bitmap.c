@@ -1,66 +1,46 @@
-#include <ctype.h>
-#include <errno.h>
-#include <limits.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "bitmap-alloc.h"
+#include "bitmap-format.h"
+#include "bitmap-internal.h"
+#include "bitmap-stats.h"
 #include "bitmap.h"
 
-#ifdef DEBUG
-    #define debug(fmt, ...) printf("%s:%d %s => " fmt, __FILE__, __LINE__, __func__, ##__VA_ARGS__);
-#else
-    #define debug(fmt, ...)
-#endif
-
-#define BITSIZEOF(type) (CHAR_BIT * sizeof(type))
-#define CHAR_SPACE ' '
-#define CHAR_NULL '\0'
-#define CHAR_ENTRY_SEPARATOR ','
-#define CHAR_RANGE_SEPARATOR '-'
-
-static inline u8 *skip_space(u8 *str);
-
 /*****************************************************************************
  *
- *   Name:       bitmap_check
+ *   Name:       buf_realloc
  *
- *   Input:      bm          A bitmap that need to check
- *   Return:     Success     true
- *               Failed      false
- *   Description            Check a bitmap whether it's exist
+ *   Input:      allocator   The allocator that owns buf
+ *               buf         The word buffer that will be resized
+ *               old_len     Current number of words in buf
+ *               new_len     Wanted number of words in buf
+ *   Return:     Success     The resized buffer, the first min(old_len, new_len) words kept
+ *               Failed      NULL, buf is left untouched
+ *   Description            Resize a word buffer, in place when the allocator can
  ******************************************************************************/
-static bool bitmap_check(struct bitmap *bm);
+static u32 *buf_realloc(const struct bitmap_allocator *allocator, u32 *buf, u16 old_len,
+                        u16 new_len);
 
 /*****************************************************************************
  *
- *   Name:       update_info
+ *   Name:       grow_for
  *
- *   Input:      bm          A bitmap that need to check
- *   Return:     Success     None
- *               Failed      None
- *   Description            Update bitmap first_value, last_value and numbers
+ *   Input:      bm          A valid bitmap
+ *               value       A value at or above bm->max_value
+ *   Return:     Success     true, value fits now
+ *               Failed      false, bm is not growable or value can never fit
+ *   Description            Grow an autogrow bitmap so value fits
  ******************************************************************************/
-static void update_info(struct bitmap *bm);
+static bool grow_for(struct bitmap *bm, u16 value);
 
-static inline u8 *skip_space(u8 *str)
-{
-    if (str == NULL)
-    {
-        return NULL;
-    }
-
-    while (*str == CHAR_SPACE)
-    {
-        str++;
-    }
-
-    return str;
-}
-
-static void update_info(struct bitmap *bm)
+void update_info(struct bitmap *bm)
 {
     u16 i = 0;
+    u32 word = 0;
+    u32 num_bits_in_last_buf = 0;
+
+    STATS_SCOPE(BITMAP_STATS_RESCAN);
 
     if (bm == NULL)
     {
@@ -70,65 +50,127 @@ static void update_info(struct bitmap *bm)
     bm->first_value = UINT16_MAX;
     bm->last_value = 0;
     bm->numbers = 0;
+    STATS_WORDS(bm->buf_len);
+
+    num_bits_in_last_buf = bm->max_value % BITSIZEOF(u32);
 
-    for (i = 0; i < bm->max_value; i++)
+    for (i = 0; i < bm->buf_len; i++)
     {
-        if (bm->buf[i / BITSIZEOF(u32)] & (1U << (i % BITSIZEOF(u32))))
+        word = bm->buf[i];
+
+        /* Bits at or above max_value do not count, external words may have some */
+        if (i == bm->buf_len - 1 && num_bits_in_last_buf != 0)
         {
-            bm->numbers++;
-
-            if (i < bm->first_value)
-            {
-                bm->first_value = i;
-            }
-            if (i > bm->last_value)
-            {
-                bm->last_value = i;
-            }
+            word &= (1U << num_bits_in_last_buf) - 1;
         }
+
+        if (word == 0)
+        {
+            continue;
+        }
+
+        if (bm->numbers == 0)
+        {
+            bm->first_value = (u16)(i * BITSIZEOF(u32) + __builtin_ctz(word));
+        }
+
+        bm->last_value = (u16)(i * BITSIZEOF(u32) + BITSIZEOF(u32) - 1 - __builtin_clz(word));
+        bm->numbers += (u16)__builtin_popcount(word);
     }
 
     return;
 }
 
+static u32 *buf_realloc(const struct bitmap_allocator *allocator, u32 *buf, u16 old_len,
+                        u16 new_len)
+{
+    u32 *new_buf = NULL;
+
+    if (allocator->realloc != NULL)
+    {
+        return (u32 *)allocator->realloc(buf, old_len * sizeof(u32), new_len * sizeof(u32),
+                                         allocator->ctx);
+    }
+
+    new_buf = (u32 *)allocator->alloc(new_len * sizeof(u32), allocator->ctx);
+
+    if (new_buf == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_buf, buf, ((old_len < new_len) ? old_len : new_len) * sizeof(u32));
+    allocator->free(buf, old_len * sizeof(u32), allocator->ctx);
+
+    return new_buf;
+}
+
 struct bitmap *bitmap_create(u16 capacity)
 {
     u16 buf_len = 0;
-    size_t size_of_bitmap = 0;
+    const struct bitmap_allocator *allocator = NULL;
     struct bitmap *bm = NULL;
 
+    STATS_SCOPE(BITMAP_STATS_CREATE);
+
     if (capacity == 0)
     {
         return NULL;
     }
 
-    buf_len = capacity / BITSIZEOF(u32);
+    buf_len = words_for_capacity(capacity);
+    STATS_WORDS(buf_len);
+    allocator = bitmap_get_allocator();
+    bm = (struct bitmap *)allocator->alloc(sizeof(struct bitmap), allocator->ctx);
 
-    if (buf_len * BITSIZEOF(u32) < capacity)
+    if (bm == NULL)
     {
-        buf_len++;
+        return NULL;
     }
 
-    size_of_bitmap = sizeof(struct bitmap) + buf_len * sizeof(u32);
-    bm = (struct bitmap *)malloc(size_of_bitmap);
+    bm->buf = (u32 *)allocator->alloc(buf_len * sizeof(u32), allocator->ctx);
 
-    if (bm == NULL)
+    if (bm->buf == NULL)
     {
+        allocator->free(bm, sizeof(struct bitmap), allocator->ctx);
         return NULL;
     }
 
     bm->bm_self = bm;
+    bm->allocator = allocator;
     bm->max_value = capacity;
     bm->first_value = UINT16_MAX;
     bm->last_value = 0;
     bm->numbers = 0;
     bm->buf_len = buf_len;
+    bm->flags = 0;
 
     memset(bm->buf, 0, buf_len * sizeof(u32));
+    mark_all_dirty(bm); /* New to a replica, even when empty */
 
     return bm;
 }
 
+bool bitmap_init_external(struct bitmap *bm, u32 *words, u16 nbits)
+{
+    if (bm == NULL || words == NULL || nbits == 0)
+    {
+        return false;
+    }
+
+    bm->bm_self = bm;
+    bm->buf = words;
+    bm->allocator = NULL;
+    bm->max_value = nbits;
+    bm->buf_len = words_for_capacity(nbits);
+    bm->flags = BITMAP_FLAG_EXTERNAL;
+    mark_all_dirty(bm);
+
+    update_info(bm); /* The caller's words may already hold values */
+
+    return true;
+}
+
 void bitmap_destroy(struct bitmap *bm)
 {
     if (bm == NULL)
@@ -138,13 +180,125 @@ void bitmap_destroy(struct bitmap *bm)
 
     bm->bm_self = NULL;
 
-    free(bm);
+    if (bm->flags & BITMAP_FLAG_EXTERNAL)
+    {
+        /* Nothing was allocated, the memory stays with the caller */
+        return;
+    }
+
+    bm->allocator->free(bm->buf, bm->buf_len * sizeof(u32), bm->allocator->ctx);
+    bm->buf = NULL;
+    bm->allocator->free(bm, sizeof(struct bitmap), bm->allocator->ctx);
     bm = NULL;
 
     return;
 }
 
-static bool bitmap_check(struct bitmap *bm)
+bool bitmap_resize(struct bitmap *bm, u16 new_capacity)
+{
+    u16 i = 0;
+    u16 new_len = 0;
+    u16 dropped = 0;
+    u32 word = 0;
+    u32 *new_buf = NULL;
+
+    STATS_SCOPE(BITMAP_STATS_RESIZE);
+
+    if (!bitmap_check_writable(bm) || new_capacity == 0 || (bm->flags & BITMAP_FLAG_EXTERNAL))
+    {
+        return false;
+    }
+
+    new_len = words_for_capacity(new_capacity);
+    STATS_WORDS(new_len);
+
+    if (new_capacity < bm->max_value && bm->numbers != 0 && bm->last_value >= new_capacity)
+    {
+        /* Count the bits that fall off the end before the words are gone */
+        i = new_capacity / BITSIZEOF(u32);
+        word = bm->buf[i] & ~((1U << (new_capacity % BITSIZEOF(u32))) - 1);
+        dropped = (u16)__builtin_popcount(word);
+
+        for (i++; i < bm->buf_len; i++)
+        {
+            dropped += (u16)__builtin_popcount(bm->buf[i]);
+        }
+    }
+
+    if (new_len != bm->buf_len)
+    {
+        new_buf = buf_realloc(bm->allocator, bm->buf, bm->buf_len, new_len);
+
+        if (new_buf == NULL)
+        {
+            return false;
+        }
+
+        if (new_len > bm->buf_len)
+        {
+            /* Only the new tail needs clearing, bits above max_value are always 0 */
+            memset(new_buf + bm->buf_len, 0, (new_len - bm->buf_len) * sizeof(u32));
+        }
+
+        bm->buf = new_buf;
+        bm->buf_len = new_len;
+    }
+
+    bm->max_value = new_capacity;
+    mark_all_dirty(bm);
+
+    if (dropped == 0)
+    {
+        return true;
+    }
+
+    clear_tail_bits(bm);
+    bm->numbers -= dropped;
+
+    if (bm->numbers == 0)
+    {
+        bm->first_value = UINT16_MAX;
+        bm->last_value = 0;
+        return true;
+    }
+
+    /* The new last value is the highest bit left, search backwards word by word */
+    i = new_len;
+
+    while (i-- > 0)
+    {
+        word = bm->buf[i];
+
+        if (word != 0)
+        {
+            bm->last_value = (u16)(i * BITSIZEOF(u32) + BITSIZEOF(u32) - 1 - __builtin_clz(word));
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool bitmap_set_autogrow(struct bitmap *bm, bool enable)
+{
+    if (!bitmap_check_writable(bm))
+    {
+        return false;
+    }
+
+    if (enable)
+    {
+        bm->flags |= BITMAP_FLAG_AUTOGROW;
+    }
+    else
+    {
+        bm->flags &= ~BITMAP_FLAG_AUTOGROW;
+    }
+
+    return true;
+}
+
+bool bitmap_check(const struct bitmap *bm)
 {
     if (bm == NULL)
     {
@@ -166,7 +320,7 @@ static bool bitmap_check(struct bitmap *bm)
         return false;
     }
 
-    if (bm->buf_len * BITSIZEOF(u32) < bm->max_value)
+    if (bm->buf_len * BITSIZEOF(u32) < bm->max_value || bm->buf == NULL)
     {
         return false;
     }
@@ -174,12 +328,52 @@ static bool bitmap_check(struct bitmap *bm)
     return true;
 }
 
+static bool grow_for(struct bitmap *bm, u16 value)
+{
+    u32 new_capacity = 0;
+
+    if (!(bm->flags & BITMAP_FLAG_AUTOGROW) || value == UINT16_MAX)
+    {
+        return false;
+    }
+
+    /* Double the capacity so a run of growing adds costs amortized O(1) */
+    new_capacity = (u32)bm->max_value * 2;
+
+    if (new_capacity <= value)
+    {
+        new_capacity = (u32)value + 1;
+    }
+
+    if (new_capacity > UINT16_MAX)
+    {
+        new_capacity = UINT16_MAX;
+    }
+
+    if (!bitmap_resize(bm, (u16)new_capacity))
+    {
+        return false;
+    }
+
+    debug("Grew bitmap to %" PRIu32 "\n", new_capacity);
+
+    return true;
+}
+
 bool bitmap_add_value(struct bitmap *bm, u16 value)
 {
     u16 index = 0;
     u16 bit_position = 0;
 
-    if (!bitmap_check(bm) || value >= bm->max_value)
+    STATS_SCOPE(BITMAP_STATS_ADD);
+    STATS_WORDS(1);
+
+    if (!bitmap_check_writable(bm))
+    {
+        return false;
+    }
+
+    if (value >= bm->max_value && !grow_for(bm, value))
     {
         return false;
     }
@@ -194,6 +388,7 @@ bool bitmap_add_value(struct bitmap *bm, u16 value)
     }
 
     bm->buf[index] |= (1U << bit_position);
+    bitmap_mark_dirty(bm, value);
 
     if (value < bm->first_value)
     {
@@ -217,7 +412,10 @@ bool bitmap_del_value(struct bitmap *bm, u16 value)
     u16 index = 0;
     u16 bit_position = 0;
 
-    if (!bitmap_check(bm) || value >= bm->max_value)
+    STATS_SCOPE(BITMAP_STATS_DEL);
+    STATS_WORDS(1);
+
+    if (!bitmap_check_writable(bm) || value >= bm->max_value)
     {
         return false;
     }
@@ -232,83 +430,208 @@ bool bitmap_del_value(struct bitmap *bm, u16 value)
     }
 
     bm->buf[index] &= ~(1U << bit_position);
+    bm->numbers--;
+    bitmap_mark_dirty(bm, value);
 
-    update_info(bm); /* Recalculate info from buffer */
+    if (value == bm->first_value || value == bm->last_value)
+    {
+        bitmap_update_bounds(bm, value); /* Only the bounds need a search, not a rescan */
+    }
 
     debug("Bit reset at %d\n", value);
 
     return true;
 }
 
-void bitmap_print(struct bitmap *bm)
+bool bitmap_add_values(struct bitmap *bm, const u16 *values, size_t count)
 {
-    bool in_range = false;
-    u16 range_start = 0;
-    u16 range_end = 0;
-    u16 i = 0;
+    u32 *word = NULL;
+    u32 mask = 0;
+    u32 added = 0;
+    u16 min_value = UINT16_MAX;
+    u16 max_value = 0;
+    size_t i = 0;
 
-    if (!bitmap_check(bm))
+    STATS_SCOPE(BITMAP_STATS_ADD_VALUES);
+    STATS_WORDS(count);
+
+    if (!bitmap_check_writable(bm) || (values == NULL && count > 0))
     {
-        printf("Invalid Bitmap\n");
-        return;
+        return false;
     }
 
-    if (bm->numbers == 0)
+    if (count == 0)
     {
-        printf("No values\n");
-        goto debug_print;
+        return true;
     }
 
-    in_range = false;
+    for (i = 0; i < count; i++)
+    {
+        min_value = (values[i] < min_value) ? values[i] : min_value;
+        max_value = (values[i] > max_value) ? values[i] : max_value;
+    }
 
-    for (i = bm->first_value; i <= bm->last_value; i++)
+    if (max_value >= bm->max_value && !grow_for(bm, max_value))
     {
-        if (bm->buf[i / BITSIZEOF(u32)] & (1U << (i % BITSIZEOF(u32))))
-        {
-            if (!in_range)
-            {
-                /* Start of new range */
-                range_start = i;
-                in_range = true;
-            }
-        }
-        else
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        word = &bm->buf[values[i] / BITSIZEOF(u32)];
+        mask = 1U << (values[i] % BITSIZEOF(u32));
+        added += (u32)((*word & mask) == 0);
+        *word |= mask;
+        bitmap_mark_dirty(bm, values[i]);
+    }
+
+    bm->numbers += (u16)added;
+    bm->first_value = (min_value < bm->first_value) ? min_value : bm->first_value;
+    bm->last_value = (max_value > bm->last_value) ? max_value : bm->last_value;
+
+    return true;
+}
+
+bool bitmap_del_values(struct bitmap *bm, const u16 *values, size_t count)
+{
+    u32 *word = NULL;
+    u32 mask = 0;
+    u32 removed = 0;
+    u16 first_value = 0;
+    u16 last_value = 0;
+    size_t i = 0;
+
+    STATS_SCOPE(BITMAP_STATS_DEL_VALUES);
+    STATS_WORDS(count);
+
+    if (!bitmap_check_writable(bm) || (values == NULL && count > 0))
+    {
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (values[i] >= bm->max_value)
         {
-            if (in_range)
-            {
-                /* End of the current range */
-                range_end = i - 1;
-
-                if (range_start == range_end)
-                {
-                    printf("%u", range_start);
-                }
-                else
-                {
-                    printf("%u%c%u", range_start, CHAR_RANGE_SEPARATOR, range_end);
-                }
-
-                in_range = false;
-
-                if (i < bm->last_value)
-                {
-                    putchar(CHAR_ENTRY_SEPARATOR);
-                }
-            }
+            return false;
         }
     }
 
-    if (in_range)
+    for (i = 0; i < count; i++)
+    {
+        word = &bm->buf[values[i] / BITSIZEOF(u32)];
+        mask = 1U << (values[i] % BITSIZEOF(u32));
+        removed += (u32)((*word & mask) != 0);
+        *word &= ~mask;
+        bitmap_mark_dirty(bm, values[i]);
+    }
+
+    if (removed == 0)
+    {
+        return true;
+    }
+
+    bm->numbers -= (u16)removed;
+    first_value = bm->first_value;
+    last_value = bm->last_value;
+
+    /* Search from the old bounds, once for the whole batch */
+    if (!bitmap_test(bm, first_value))
+    {
+        bitmap_update_bounds(bm, first_value);
+    }
+
+    if (bm->numbers != 0 && bm->last_value == last_value && !bitmap_test(bm, last_value))
+    {
+        bitmap_update_bounds(bm, last_value);
+    }
+
+    return true;
+}
+
+bool bitmap_test_value(struct bitmap *bm, u16 value)
+{
+    STATS_SCOPE(BITMAP_STATS_TEST);
+    STATS_WORDS(1);
+
+    if (!bitmap_check(bm) || value >= bm->max_value)
+    {
+        return false;
+    }
+
+    return bitmap_test(bm, value);
+}
+
+void bitmap_update_bounds(struct bitmap *bm, u16 value)
+{
+    u32 i = 0;
+    u32 word = 0;
+
+    if (bm->numbers == 0)
     {
-        /* last range extends to last_value */
-        if (range_start == bm->last_value)
+        bm->first_value = UINT16_MAX;
+        bm->last_value = 0;
+        return;
+    }
+
+    if (value == bm->first_value)
+    {
+        /* Search forward from the removed value, everything before it is clear */
+        i = value / BITSIZEOF(u32);
+        word = bm->buf[i] & ~((1U << (value % BITSIZEOF(u32))) - 1);
+
+        while (word == 0)
         {
-            printf("%u", range_start);
+            word = bm->buf[++i];
         }
-        else
+
+        bm->first_value = (u16)(i * BITSIZEOF(u32) + __builtin_ctz(word));
+    }
+
+    if (value == bm->last_value)
+    {
+        /* Search backward from the removed value, everything after it is clear */
+        i = value / BITSIZEOF(u32);
+        word = bm->buf[i] & (UINT32_MAX >> (BITSIZEOF(u32) - 1 - value % BITSIZEOF(u32)));
+
+        while (word == 0)
         {
-            printf("%u%c%u", range_start, CHAR_RANGE_SEPARATOR, bm->last_value);
+            word = bm->buf[--i];
         }
+
+        bm->last_value = (u16)(i * BITSIZEOF(u32) + BITSIZEOF(u32) - 1 - __builtin_clz(word));
+    }
+
+    return;
+}
+
+void bitmap_print(struct bitmap *bm)
+{
+    struct bitmap_format_state state;
+    char chunk[4096];
+    size_t len = 0;
+#ifdef DEBUG
+    u16 i = 0;
+#endif
+
+    if (!bitmap_check(bm))
+    {
+        printf("Invalid Bitmap\n");
+        return;
+    }
+
+    if (bm->numbers == 0)
+    {
+        printf("No values\n");
+        goto debug_print;
+    }
+
+    /* One write per chunk of entries instead of one printf per range */
+    bitmap_format_init(&state);
+
+    while ((len = bitmap_format_next(bm, &state, chunk, sizeof(chunk))) > 0)
+    {
+        fwrite(chunk, 1, len, stdout);
     }
 
     printf("\n");
@@ -346,25 +669,29 @@ debug_print:
 
 struct bitmap *bitmap_clone(struct bitmap *bm)
 {
-    size_t size_of_bitmap = 0;
     struct bitmap *new_bm = NULL;
 
+    STATS_SCOPE(BITMAP_STATS_CLONE);
+
     if (!bitmap_check(bm))
     {
         return NULL;
     }
 
     /* Allocate memory for the new bitmap structure */
-    size_of_bitmap = sizeof(struct bitmap) + bm->buf_len * sizeof(u32);
-    new_bm = (struct bitmap *)malloc(size_of_bitmap);
+    new_bm = bitmap_create(bm->max_value);
 
     if (new_bm == NULL)
     {
         return NULL;
     }
 
-    memcpy(new_bm, bm, size_of_bitmap);
-    new_bm->bm_self = new_bm;
+    memcpy(new_bm->buf, bm->buf, bm->buf_len * sizeof(u32));
+    STATS_WORDS(bm->buf_len);
+    new_bm->first_value = bm->first_value;
+    new_bm->last_value = bm->last_value;
+    new_bm->numbers = bm->numbers;
+    new_bm->flags = bm->flags & ~(BITMAP_FLAG_EXTERNAL | BITMAP_FLAG_READONLY);
 
     return new_bm;
 }
@@ -372,23 +699,26 @@ struct bitmap *bitmap_clone(struct bitmap *bm)
 bool bitmap_not(struct bitmap *bm)
 {
     u32 i = 0;
-    u32 num_bits_in_last_buf = 0;
 
-    if (!bitmap_check(bm))
+    STATS_SCOPE(BITMAP_STATS_NOT);
+
+    if (!bitmap_check_writable(bm))
     {
         return false;
     }
 
+    STATS_WORDS(bm->buf_len);
+
     /* Invert all bits in place */
-    for (i = 0; i <= bm->max_value / BITSIZEOF(u32); i++)
+    for (i = 0; i < bm->buf_len; i++)
     {
         bm->buf[i] = ~bm->buf[i];
     }
 
     /* undo invert last few extra bits */
-    num_bits_in_last_buf = (bm->max_value % BITSIZEOF(u32));
-    bm->buf[bm->max_value / BITSIZEOF(u32)] &= (1u << num_bits_in_last_buf) - 1;
+    clear_tail_bits(bm);
 
+    mark_all_dirty(bm);
     update_info(bm); /* Recalculate info from buffer */
 
     return true;
@@ -398,15 +728,17 @@ bool bitmap_or(struct bitmap *bm_store, struct bitmap *bm)
 {
     u16 i = 0;
     u16 min_buffer_len = 0;
-    u32 num_bits_in_last_buf = 0;
 
-    if (!bitmap_check(bm_store) || !bitmap_check(bm))
+    STATS_SCOPE(BITMAP_STATS_OR);
+
+    if (!bitmap_check_writable(bm_store) || !bitmap_check(bm))
     {
         return false;
     }
 
     /* OR only upto minimum size of the two bitmap */
     min_buffer_len = (bm_store->buf_len < bm->buf_len) ? bm_store->buf_len : bm->buf_len;
+    STATS_WORDS(bm_store->buf_len);
 
     for (i = 0; i < min_buffer_len; i++)
     {
@@ -414,9 +746,9 @@ bool bitmap_or(struct bitmap *bm_store, struct bitmap *bm)
     }
 
     /* clear last few extra bits, if any */
-    num_bits_in_last_buf = (bm_store->max_value % BITSIZEOF(u32));
-    bm_store->buf[bm_store->max_value / BITSIZEOF(u32)] &= (1u << num_bits_in_last_buf) - 1;
+    clear_tail_bits(bm_store);
 
+    mark_all_dirty(bm_store);
     update_info(bm_store); /* Recalculate info from buffer */
 
     return true;
@@ -426,14 +758,16 @@ bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm)
 {
     u16 i = 0;
     u16 min_buffer_len = 0;
-    u32 num_bits_in_last_buf = 0;
 
-    if (!bitmap_check(bm_store) || !bitmap_check(bm))
+    STATS_SCOPE(BITMAP_STATS_AND);
+
+    if (!bitmap_check_writable(bm_store) || !bitmap_check(bm))
     {
         return false;
     }
 
     min_buffer_len = (bm_store->buf_len < bm->buf_len) ? bm_store->buf_len : bm->buf_len;
+    STATS_WORDS(bm_store->buf_len);
 
     for (i = 0; i < min_buffer_len; i++)
     {
@@ -441,8 +775,7 @@ bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm)
     }
 
     /* clear last few extra bits, if any */
-    num_bits_in_last_buf = (bm_store->max_value % BITSIZEOF(u32));
-    bm_store->buf[bm_store->max_value / BITSIZEOF(u32)] &= (1u << num_bits_in_last_buf) - 1;
+    clear_tail_bits(bm_store);
 
     /* clear rest of the buffer, if any */
     while (i < bm_store->buf_len)
@@ -451,171 +784,8 @@ bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm)
         i++;
     }
 
+    mark_all_dirty(bm_store);
     update_info(bm_store); /* Recalculate info from buffer */
 
     return true;
 }
-
-struct bitmap *bitmap_parse_str(u8 *str)
-{
-    u8 *startptr = NULL;
-    u8 *endptr = NULL;
-    long value = 0;
-    long max_value = 0;
-    u16 start_value = 0;
-    bool in_range = false;
-    struct bitmap *bm = NULL;
-
-    if (str == NULL || *str == CHAR_NULL)
-    {
-        return NULL;
-    }
-
-    debug("str: %s\n", str);
-
-    /* Find max value, also if the string contains invalid characters */
-    startptr = str;
-    max_value = -1;
-
-    while (*startptr != CHAR_NULL)
-    {
-        if (*startptr == CHAR_SPACE || *startptr == CHAR_RANGE_SEPARATOR ||
-            *startptr == CHAR_ENTRY_SEPARATOR)
-        {
-            startptr++;
-            continue;
-        }
-
-        if (isdigit(*startptr))
-        {
-            errno = 0;
-            value = strtol((char *)startptr, (char **)&endptr, 10);
-
-            if (value >= UINT16_MAX || value < 0 || errno == ERANGE)
-            {
-                debug("Out of range\n");
-                goto cleanup;
-            }
-
-            if (value > max_value)
-            {
-                max_value = value;
-            }
-
-            startptr = endptr;
-        }
-        else
-        {
-            debug("Invalid character in string\n");
-            goto cleanup;
-        }
-    }
-
-    if (max_value < 0)
-    {
-        debug("No value in string\n");
-        goto cleanup;
-    }
-
-    debug("Max val in str: %ld\n", max_value);
-    bm = bitmap_create((u16)max_value + 1);
-
-    if (bm == NULL)
-    {
-        debug("call to bitmap_create failed\n");
-        goto cleanup;
-    }
-
-    /* Parse the string and set bits */
-    start_value = 0;
-    startptr = str;
-    endptr = NULL;
-    in_range = false;
-
-    while (*startptr != CHAR_NULL)
-    {
-        startptr = skip_space(startptr);
-
-        if (*startptr == CHAR_NULL)
-        {
-            break;
-        }
-
-        if (*startptr == CHAR_RANGE_SEPARATOR)
-        {
-            goto cleanup;
-        }
-
-        errno = 0;
-        value = strtol((char *)startptr, (char **)&endptr, 10);
-
-        if (value >= UINT16_MAX || value < 0 || errno == ERANGE)
-        {
-            debug("This should have been caught in the first iteration,"
-                  " but somehow we found a value that is Out of range");
-            goto cleanup;
-        }
-
-        if (value == 0 && endptr == startptr)
-        {
-            goto cleanup;
-        }
-
-        startptr = skip_space(endptr);
-
-        if (*startptr == CHAR_ENTRY_SEPARATOR || *startptr == CHAR_NULL)
-        {
-            if (in_range)
-            {
-                if (start_value > value)
-                {
-                    debug("Invalid range: Range start is less than range end!\n");
-                    goto cleanup;
-                }
-
-                while (start_value <= value)
-                {
-                    bitmap_add_value(bm, start_value);
-                    start_value++;
-                }
-                in_range = false;
-            }
-            else
-            {
-                bitmap_add_value(bm, (u16)value);
-            }
-
-            if (*startptr == CHAR_ENTRY_SEPARATOR)
-            {
-                startptr++;
-            }
-        }
-        else if (*startptr == CHAR_RANGE_SEPARATOR && !in_range)
-        {
-            /* this was first value of range */
-            debug("Range started\n");
-            in_range = true;
-            start_value = (u16)value;
-            startptr++;
-        }
-        else
-        {
-            debug("Invalid string.\n");
-            goto cleanup;
-        }
-    }
-
-    if (in_range)
-    {
-        goto cleanup;
-    }
-
-    return bm;
-
-cleanup:
-    debug("Invalid string \n");
-    bitmap_destroy(bm);
-    bm = NULL;
-
-    return NULL;
-}
@@ -0,0 +1,785 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-format.h"
+#include "bitmap-registry.h"
+#include "bitmap-stats.h"
+#include "bitmap.h"
+#include "command.h"
+
+#define COMMAND_OUTPUT_MIN 4096
+#define COMMAND_NUMBER_MAX 32
+
+typedef bool (*command_handler_t)(struct command_context *ctx, char *args,
+                                  struct command_output *out);
+
+struct command
+{
+    const char *name;
+    command_handler_t handler;
+};
+
+/*****************************************************************************
+ *
+ *   Name:       next_token
+ *
+ *   Input:      pos         Position in a line, moved past the token
+ *   Return:     Success     The next space separated token, terminated
+ *               Failed      NULL, the line has no more tokens
+ *   Description            Split a line in place
+ ******************************************************************************/
+static char *next_token(char **pos);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_number
+ *
+ *   Input:      token       A token
+ *               max         Largest accepted value
+ *               value       Gets the number
+ *   Return:     Success     true
+ *               Failed      false, not a decimal number up to max
+ *   Description            Convert a token to a number
+ ******************************************************************************/
+static bool parse_number(const char *token, u32 max, u32 *value);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_name
+ *
+ *   Input:      pos         Position in a line, moved past the name
+ *   Return:     Success     The name
+ *               Failed      NULL, missing or too long
+ *   Description            Read the name of a bitmap
+ ******************************************************************************/
+static const char *parse_name(char **pos);
+
+/*****************************************************************************
+ *
+ *   Name:       parse_bitmap
+ *
+ *   Input:      ctx         The bitmaps
+ *               pos         Position in a line, moved past the name
+ *               out         Gets the response when there is no such bitmap
+ *   Return:     Success     The bitmap with the name
+ *               Failed      NULL
+ *   Description            Read the name of an existing bitmap
+ ******************************************************************************/
+static struct bitmap *parse_bitmap(struct command_context *ctx, char **pos,
+                                   struct command_output *out);
+
+/*****************************************************************************
+ *
+ *   Name:       respond
+ *
+ *   Input:      out         The output
+ *               ok          The command succeeded
+ *               text        The response, NULL for "OK"
+ *   Return:     Success     ok
+ *               Failed      None
+ *   Description            Write a response line, "ERR <text>" when the command failed
+ ******************************************************************************/
+static bool respond(struct command_output *out, bool ok, const char *text);
+
+/*****************************************************************************
+ *
+ *   Name:       replace_bitmap
+ *
+ *   Input:      ctx         The bitmaps
+ *               name        Name of the bitmap
+ *               bm          The new bitmap, NULL when creating it failed
+ *               out         The output
+ *   Return:     Success     true
+ *               Failed      false, bm was NULL or could not be added
+ *   Description            Put a new bitmap under a name, the old one is destroyed
+ ******************************************************************************/
+static bool replace_bitmap(struct command_context *ctx, const char *name, struct bitmap *bm,
+                           struct command_output *out);
+
+/*****************************************************************************
+ *
+ *   Name:       change_values
+ *
+ *   Input:      ctx         The bitmaps
+ *               args        "<name> <value>..."
+ *               out         The output
+ *               add         Add the values, else remove them
+ *   Return:     Success     true
+ *               Failed      false
+ *   Description            Shared by add and del. All values are parsed first and go
+ *                           through one batched call, so a failed command changes nothing
+ ******************************************************************************/
+static bool change_values(struct command_context *ctx, char *args, struct command_output *out,
+                          bool add);
+
+static bool cmd_create(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_add(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_del(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_test(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_count(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_or(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_and(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_not(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_parse(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_print(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_clone(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_drop(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_list(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_info(struct command_context *ctx, char *args, struct command_output *out);
+static bool cmd_stats(struct command_context *ctx, char *args, struct command_output *out);
+
+static const struct command commands[] = {
+    {"create", cmd_create}, {"add", cmd_add},     {"del", cmd_del},     {"test", cmd_test},
+    {"count", cmd_count},   {"or", cmd_or},       {"and", cmd_and},     {"not", cmd_not},
+    {"parse", cmd_parse},   {"print", cmd_print}, {"clone", cmd_clone}, {"drop", cmd_drop},
+    {"list", cmd_list},     {"info", cmd_info},   {"stats", cmd_stats},
+};
+
+static char *next_token(char **pos)
+{
+    char *start = *pos;
+    char *end = NULL;
+
+    start += strspn(start, " \t\r");
+
+    if (*start == '\0')
+    {
+        *pos = start;
+        return NULL;
+    }
+
+    end = start + strcspn(start, " \t\r");
+
+    if (*end != '\0')
+    {
+        *end++ = '\0';
+    }
+
+    *pos = end;
+
+    return start;
+}
+
+static bool parse_number(const char *token, u32 max, u32 *value)
+{
+    char *end = NULL;
+    unsigned long number = 0;
+
+    if (token == NULL || *token < '0' || *token > '9')
+    {
+        return false;
+    }
+
+    errno = 0;
+    number = strtoul(token, &end, 10);
+
+    if (errno != 0 || *end != '\0' || number > max)
+    {
+        return false;
+    }
+
+    *value = (u32)number;
+
+    return true;
+}
+
+static const char *parse_name(char **pos)
+{
+    const char *name = next_token(pos);
+
+    if (name == NULL || strlen(name) > BITMAP_REGISTRY_NAME_MAX)
+    {
+        return NULL;
+    }
+
+    return name;
+}
+
+static struct bitmap *parse_bitmap(struct command_context *ctx, char **pos,
+                                   struct command_output *out)
+{
+    const char *name = parse_name(pos);
+    struct bitmap *bm = NULL;
+
+    if (name == NULL)
+    {
+        respond(out, false, "bad name");
+        return NULL;
+    }
+
+    bm = bitmap_registry_find(ctx->registry, name);
+
+    if (bm == NULL)
+    {
+        respond(out, false, "no such bitmap");
+    }
+
+    return bm;
+}
+
+static bool respond(struct command_output *out, bool ok, const char *text)
+{
+    if (!ok)
+    {
+        command_output_append(out, "ERR ", 4);
+    }
+
+    if (text == NULL)
+    {
+        text = "OK";
+    }
+
+    command_output_append(out, text, strlen(text));
+    command_output_append(out, "\n", 1);
+
+    return ok;
+}
+
+static bool replace_bitmap(struct command_context *ctx, const char *name, struct bitmap *bm,
+                           struct command_output *out)
+{
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    if (!bitmap_registry_set(ctx->registry, name, bm))
+    {
+        bitmap_destroy(bm);
+        return false;
+    }
+
+    return respond(out, true, NULL);
+}
+
+static bool change_values(struct command_context *ctx, char *args, struct command_output *out,
+                          bool add)
+{
+    u16 *values = NULL;
+    const char *name = NULL;
+    char *token = NULL;
+    struct bitmap *bm = NULL;
+    u32 value = 0;
+    size_t count = 0;
+    bool created = false;
+    bool ok = false;
+
+    name = parse_name(&args);
+
+    if (name == NULL)
+    {
+        return respond(out, false, "bad name");
+    }
+
+    bm = bitmap_registry_find(ctx->registry, name);
+
+    if (bm == NULL && !add)
+    {
+        return respond(out, false, "no such bitmap");
+    }
+
+    /* Every token takes at least a character and a space */
+    values = (u16 *)malloc((strlen(args) / 2 + 1) * sizeof(u16));
+
+    if (values == NULL)
+    {
+        return respond(out, false, "out of memory");
+    }
+
+    while ((token = next_token(&args)) != NULL)
+    {
+        if (!parse_number(token, UINT16_MAX - 1, &value))
+        {
+            free(values);
+            return respond(out, false, "bad value");
+        }
+
+        values[count++] = (u16)value;
+    }
+
+    /* add creates the bitmap on demand, growing to fit the values */
+    if (bm == NULL)
+    {
+        bm = bitmap_registry_get(ctx->registry, name, COMMAND_DEFAULT_CAPACITY);
+        created = true;
+
+        if (bm == NULL || !bitmap_set_autogrow(bm, true))
+        {
+            bitmap_registry_remove(ctx->registry, name);
+            free(values);
+            return respond(out, false, "create failed");
+        }
+    }
+
+    ok = add ? bitmap_add_values(bm, values, count) : bitmap_del_values(bm, values, count);
+
+    if (!ok && created)
+    {
+        bitmap_registry_remove(ctx->registry, name);
+    }
+
+    free(values);
+
+    return respond(out, ok, ok ? NULL : "value out of range");
+}
+
+static bool cmd_create(struct command_context *ctx, char *args, struct command_output *out)
+{
+    const char *name = NULL;
+    u32 capacity = 0;
+
+    name = parse_name(&args);
+
+    if (name == NULL)
+    {
+        return respond(out, false, "bad name");
+    }
+
+    if (!parse_number(next_token(&args), UINT16_MAX, &capacity) || capacity == 0)
+    {
+        return respond(out, false, "bad capacity");
+    }
+
+    if (!replace_bitmap(ctx, name, bitmap_create((u16)capacity), out))
+    {
+        return respond(out, false, "create failed");
+    }
+
+    return true;
+}
+
+static bool cmd_add(struct command_context *ctx, char *args, struct command_output *out)
+{
+    return change_values(ctx, args, out, true);
+}
+
+static bool cmd_del(struct command_context *ctx, char *args, struct command_output *out)
+{
+    return change_values(ctx, args, out, false);
+}
+
+static bool cmd_test(struct command_context *ctx, char *args, struct command_output *out)
+{
+    struct bitmap *bm = NULL;
+    u32 value = 0;
+
+    bm = parse_bitmap(ctx, &args, out);
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    if (!parse_number(next_token(&args), UINT16_MAX - 1, &value))
+    {
+        return respond(out, false, "bad value");
+    }
+
+    return respond(out, true, bitmap_test_value(bm, (u16)value) ? "1" : "0");
+}
+
+static bool cmd_count(struct command_context *ctx, char *args, struct command_output *out)
+{
+    char number[COMMAND_NUMBER_MAX];
+    struct bitmap *bm = NULL;
+
+    bm = parse_bitmap(ctx, &args, out);
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    snprintf(number, sizeof(number), "%u", bm->numbers);
+
+    return respond(out, true, number);
+}
+
+static bool cmd_or(struct command_context *ctx, char *args, struct command_output *out)
+{
+    struct bitmap *bm_store = NULL;
+    struct bitmap *bm = NULL;
+
+    bm_store = parse_bitmap(ctx, &args, out);
+    bm = (bm_store != NULL) ? parse_bitmap(ctx, &args, out) : NULL;
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    if (!bitmap_or(bm_store, bm))
+    {
+        return respond(out, false, "or failed");
+    }
+
+    return respond(out, true, NULL);
+}
+
+static bool cmd_and(struct command_context *ctx, char *args, struct command_output *out)
+{
+    struct bitmap *bm_store = NULL;
+    struct bitmap *bm = NULL;
+
+    bm_store = parse_bitmap(ctx, &args, out);
+    bm = (bm_store != NULL) ? parse_bitmap(ctx, &args, out) : NULL;
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    if (!bitmap_and(bm_store, bm))
+    {
+        return respond(out, false, "and failed");
+    }
+
+    return respond(out, true, NULL);
+}
+
+static bool cmd_not(struct command_context *ctx, char *args, struct command_output *out)
+{
+    struct bitmap *bm = NULL;
+
+    bm = parse_bitmap(ctx, &args, out);
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    if (!bitmap_not(bm))
+    {
+        return respond(out, false, "not failed");
+    }
+
+    return respond(out, true, NULL);
+}
+
+static bool cmd_parse(struct command_context *ctx, char *args, struct command_output *out)
+{
+    const char *name = NULL;
+
+    name = parse_name(&args);
+
+    if (name == NULL)
+    {
+        return respond(out, false, "bad name");
+    }
+
+    /* The rest of the line is the range list, spaces included */
+    args += strspn(args, " \t");
+
+    if (!replace_bitmap(ctx, name, bitmap_parse_str((u8 *)args), out))
+    {
+        return respond(out, false, "invalid range list");
+    }
+
+    return true;
+}
+
+static bool cmd_print(struct command_context *ctx, char *args, struct command_output *out)
+{
+    struct bitmap_format_state state;
+    struct bitmap *bm = NULL;
+    size_t len = 0;
+
+    bm = parse_bitmap(ctx, &args, out);
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    /* Format straight into the output, a chunk at a time */
+    bitmap_format_init(&state);
+
+    do
+    {
+        if (out->size - out->len < COMMAND_OUTPUT_MIN &&
+            !command_output_append(out, NULL, COMMAND_OUTPUT_MIN))
+        {
+            return false;
+        }
+
+        len = bitmap_format_next(bm, &state, out->buf + out->len, out->size - out->len);
+        out->len += len;
+    } while (len > 0);
+
+    return command_output_append(out, "\n", 1);
+}
+
+static bool cmd_clone(struct command_context *ctx, char *args, struct command_output *out)
+{
+    const char *name_store = NULL;
+    struct bitmap *bm = NULL;
+
+    name_store = parse_name(&args);
+
+    if (name_store == NULL)
+    {
+        return respond(out, false, "bad name");
+    }
+
+    bm = parse_bitmap(ctx, &args, out);
+
+    if (bm == NULL)
+    {
+        return false;
+    }
+
+    if (!replace_bitmap(ctx, name_store, bitmap_clone(bm), out))
+    {
+        return respond(out, false, "clone failed");
+    }
+
+    return true;
+}
+
+static bool cmd_drop(struct command_context *ctx, char *args, struct command_output *out)
+{
+    const char *name = NULL;
+
+    name = parse_name(&args);
+
+    if (name == NULL)
+    {
+        return respond(out, false, "bad name");
+    }
+
+    if (!bitmap_registry_remove(ctx->registry, name))
+    {
+        return respond(out, false, "no such bitmap");
+    }
+
+    return respond(out, true, NULL);
+}
+
+static bool cmd_list(struct command_context *ctx, char *args, struct command_output *out)
+{
+    const char *name = NULL;
+    u32 iter = 0;
+    bool first = true;
+
+    (void)args;
+
+    while (bitmap_registry_next(ctx->registry, &iter, &name, NULL))
+    {
+        if ((!first && !command_output_append(out, " ", 1)) ||
+            !command_output_append(out, name, strlen(name)))
+        {
+            return false;
+        }
+
+        first = false;
+    }
+
+    return command_output_append(out, "\n", 1);
+}
+
+static bool cmd_info(struct command_context *ctx, char *args, struct command_output *out)
+{
+    char info[2 * COMMAND_NUMBER_MAX + 16];
+
+    (void)args;
+
+    snprintf(info, sizeof(info), "bitmaps %u bytes %zu", bitmap_registry_count(ctx->registry),
+             bitmap_registry_memory(ctx->registry));
+
+    return respond(out, true, info);
+}
+
+static bool cmd_stats(struct command_context *ctx, char *args, struct command_output *out)
+{
+    struct bitmap_stats stats;
+    const struct bitmap_stats_counters *counters = NULL;
+    const char *op = NULL;
+    char entry[5 * COMMAND_NUMBER_MAX];
+    bool first = true;
+    int len = 0;
+    u32 i = 0;
+
+    (void)ctx;
+
+    if (!bitmap_stats_snapshot(&stats))
+    {
+        return respond(out, false, "built without BITMAP_STATS");
+    }
+
+    op = next_token(&args);
+
+    /* stats <op>: the counts and the whole histogram of one operation */
+    if (op != NULL)
+    {
+        while (i < BITMAP_STATS_OPS && strcmp(op, bitmap_stats_op_name(i)) != 0)
+        {
+            i++;
+        }
+
+        if (i == BITMAP_STATS_OPS)
+        {
+            return respond(out, false, "unknown operation");
+        }
+
+        counters = &stats.ops[i];
+        len = snprintf(entry, sizeof(entry), "%" PRIu64 " %" PRIu64, counters->calls,
+                       counters->words);
+
+        if (!command_output_append(out, entry, (size_t)len))
+        {
+            return false;
+        }
+
+        for (i = 0; i < BITMAP_STATS_BUCKETS; i++)
+        {
+            len = snprintf(entry, sizeof(entry), " %" PRIu64, counters->latency[i]);
+
+            if (!command_output_append(out, entry, (size_t)len))
+            {
+                return false;
+            }
+        }
+
+        return command_output_append(out, "\n", 1);
+    }
+
+    /* stats: one entry per operation that ran */
+    for (i = 0; i < BITMAP_STATS_OPS; i++)
+    {
+        counters = &stats.ops[i];
+
+        if (counters->calls == 0)
+        {
+            continue;
+        }
+
+        len = snprintf(entry, sizeof(entry), "%s%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
+                       first ? "" : ", ", bitmap_stats_op_name(i), counters->calls,
+                       counters->words, bitmap_stats_percentile(counters, 50),
+                       bitmap_stats_percentile(counters, 99));
+
+        if (!command_output_append(out, entry, (size_t)len))
+        {
+            return false;
+        }
+
+        first = false;
+    }
+
+    return command_output_append(out, "\n", 1);
+}
+
+bool command_output_append(struct command_output *out, const char *data, size_t len)
+{
+    char *buf = NULL;
+    size_t size = 0;
+
+    if (out->size - out->len < len)
+    {
+        size = (out->size != 0) ? out->size : COMMAND_OUTPUT_MIN;
+
+        while (size - out->len < len)
+        {
+            size *= 2;
+        }
+
+        buf = (char *)realloc(out->buf, size);
+
+        if (buf == NULL)
+        {
+            return false;
+        }
+
+        out->buf = buf;
+        out->size = size;
+    }
+
+    /* NULL only makes room */
+    if (data != NULL)
+    {
+        memcpy(out->buf + out->len, data, len);
+        out->len += len;
+    }
+
+    return true;
+}
+
+void command_output_free(struct command_output *out)
+{
+    free(out->buf);
+    out->buf = NULL;
+    out->len = 0;
+    out->size = 0;
+
+    return;
+}
+
+bool command_execute(struct command_context *ctx, char *line, struct command_output *out)
+{
+    char *name = NULL;
+    size_t i = 0;
+
+    if (ctx == NULL || line == NULL || out == NULL)
+    {
+        return false;
+    }
+
+    name = next_token(&line);
+
+    if (name == NULL || *name == '#')
+    {
+        return true;
+    }
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        if (strcmp(name, commands[i].name) == 0)
+        {
+            return commands[i].handler(ctx, line, out);
+        }
+    }
+
+    return respond(out, false, "unknown command");
+}
+
+u32 command_run_script(struct command_context *ctx, FILE *in, FILE *out)
+{
+    struct command_output output = {NULL, 0, 0};
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len = 0;
+    u32 failed = 0;
+
+    while ((len = getline(&line, &line_size, in)) >= 0)
+    {
+        if (len > 0 && line[len - 1] == '\n')
+        {
+            line[--len] = '\0';
+        }
+
+        /* CRLF scripts, like conn_execute_lines in the server */
+        if (len > 0 && line[len - 1] == '\r')
+        {
+            line[--len] = '\0';
+        }
+
+        if (!command_execute(ctx, line, &output))
+        {
+            failed++;
+        }
+
+        if (output.len >= COMMAND_OUTPUT_FLUSH)
+        {
+            fwrite(output.buf, 1, output.len, out);
+            output.len = 0;
+        }
+    }
+
+    fwrite(output.buf, 1, output.len, out);
+    fflush(out);
+    free(line);
+    command_output_free(&output);
+
+    return failed;
+}
@@ -0,0 +1,340 @@
+#include <string.h>
+
+#include "bitmap-registry.h"
+#include "bitmap.h"
+#include "command.h"
+#include "protocol.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error "frames are little endian, add byte swapping for this target"
+#endif
+
+#define PROTOCOL_PAD(len) (((len) + PROTOCOL_ALIGN - 1) & ~(size_t)(PROTOCOL_ALIGN - 1))
+
+_Static_assert(sizeof(struct protocol_header) == 16, "protocol_header is part of the wire format");
+
+/*****************************************************************************
+ *
+ *   Name:       frame_name
+ *
+ *   Input:      frame       A checked frame
+ *               name        Gets the name, terminated
+ *   Return:     Success     true
+ *               Failed      false, empty or with a 0 byte inside
+ *   Description            Copy the bitmap name out of a frame
+ ******************************************************************************/
+static bool frame_name(const u8 *frame, char name[BITMAP_REGISTRY_NAME_MAX + 1]);
+
+/*****************************************************************************
+ *
+ *   Name:       respond
+ *
+ *   Input:      out         The output
+ *               op          Op of the request
+ *               status      PROTOCOL_OK or PROTOCOL_ERR_*
+ *               count       The count field
+ *   Return:     Success     true when status is PROTOCOL_OK
+ *               Failed      false otherwise
+ *   Description            Append a response without payload
+ ******************************************************************************/
+static bool respond(struct command_output *out, u8 op, u8 status, u32 count);
+
+/*****************************************************************************
+ *
+ *   Name:       respond_test
+ *
+ *   Input:      bm          The bitmap
+ *               values      Values to test
+ *               count       Number of values
+ *               out         The output
+ *   Return:     Success     true
+ *               Failed      false, out of memory
+ *   Description            Append the response of a TEST, the packed results
+ ******************************************************************************/
+static bool respond_test(struct bitmap *bm, const u16 *values, u32 count,
+                         struct command_output *out);
+
+static bool frame_name(const u8 *frame, char name[BITMAP_REGISTRY_NAME_MAX + 1])
+{
+    const struct protocol_header *header = (const struct protocol_header *)frame;
+
+    if (header->name_len == 0 ||
+        memchr(frame + sizeof(*header), '\0', header->name_len) != NULL)
+    {
+        return false;
+    }
+
+    memcpy(name, frame + sizeof(*header), header->name_len);
+    name[header->name_len] = '\0';
+
+    return true;
+}
+
+static bool respond(struct command_output *out, u8 op, u8 status, u32 count)
+{
+    protocol_append_frame(out, op, status, NULL, count, NULL, 0);
+
+    return status == PROTOCOL_OK;
+}
+
+static bool respond_test(struct bitmap *bm, const u16 *values, u32 count,
+                         struct command_output *out)
+{
+    struct protocol_header *header = NULL;
+    size_t offset = out->len;
+    u8 *bits = NULL;
+    u32 hits = 0;
+    u32 i = 0;
+
+    /* Reserve a zeroed payload and set the bits in place */
+    if (!protocol_append_frame(out, PROTOCOL_OP_TEST, PROTOCOL_OK, NULL, 0, NULL,
+                               ((size_t)count + 7) / 8))
+    {
+        return false;
+    }
+
+    bits = (u8 *)out->buf + offset + sizeof(struct protocol_header);
+
+    for (i = 0; i < count; i++)
+    {
+        if (values[i] < bm->max_value && bitmap_test(bm, values[i]))
+        {
+            bits[i / 8] |= (u8)(1U << (i % 8));
+            hits++;
+        }
+    }
+
+    header = (struct protocol_header *)(out->buf + offset);
+    header->count = hits;
+
+    return true;
+}
+
+ssize_t protocol_frame_len(const u8 *buf, size_t len)
+{
+    struct protocol_header header;
+
+    if (len < sizeof(header))
+    {
+        return (len > 0 && buf[0] != PROTOCOL_MAGIC) ? -1 : 0;
+    }
+
+    memcpy(&header, buf, sizeof(header));
+
+    if (header.magic != PROTOCOL_MAGIC || header.version != PROTOCOL_VERSION ||
+        header.len > PROTOCOL_FRAME_MAX || header.len % PROTOCOL_ALIGN != 0 ||
+        header.name_len > BITMAP_REGISTRY_NAME_MAX ||
+        header.len < sizeof(header) + PROTOCOL_PAD(header.name_len))
+    {
+        return -1;
+    }
+
+    if (len < header.len)
+    {
+        return 0;
+    }
+
+    return (ssize_t)header.len;
+}
+
+bool protocol_execute(struct command_context *ctx, const u8 *frame, struct command_output *out)
+{
+    const struct protocol_header *header = (const struct protocol_header *)frame;
+    char name[BITMAP_REGISTRY_NAME_MAX + 1];
+    char name2[BITMAP_REGISTRY_NAME_MAX + 1];
+    const u8 *payload = NULL;
+    const u16 *values = NULL;
+    struct bitmap *bm = NULL;
+    struct bitmap *bm2 = NULL;
+    size_t payload_len = 0;
+    u8 op = header->op;
+    bool created = false;
+    bool ok = false;
+
+    payload = frame + sizeof(*header) + PROTOCOL_PAD(header->name_len);
+    payload_len = header->len - (size_t)(payload - frame);
+    values = (const u16 *)payload;
+
+    if (!frame_name(frame, name))
+    {
+        return respond(out, op, PROTOCOL_ERR_NAME, 0);
+    }
+
+    switch (op)
+    {
+        case PROTOCOL_OP_ADD:
+        case PROTOCOL_OP_DEL:
+        case PROTOCOL_OP_TEST:
+            if (payload_len != PROTOCOL_PAD((size_t)header->count * sizeof(u16)))
+            {
+                return respond(out, op, PROTOCOL_ERR_MALFORMED, 0);
+            }
+            break;
+        case PROTOCOL_OP_OR:
+        case PROTOCOL_OP_AND:
+            if (header->count > BITMAP_REGISTRY_NAME_MAX ||
+                payload_len != PROTOCOL_PAD(header->count))
+            {
+                return respond(out, op, PROTOCOL_ERR_MALFORMED, 0);
+            }
+            break;
+        default:
+            if (payload_len != 0)
+            {
+                return respond(out, op, PROTOCOL_ERR_MALFORMED, 0);
+            }
+            break;
+    }
+
+    bm = bitmap_registry_find(ctx->registry, name);
+
+    switch (op)
+    {
+        case PROTOCOL_OP_CREATE:
+            if (header->count == 0 || header->count > UINT16_MAX)
+            {
+                return respond(out, op, PROTOCOL_ERR_RANGE, 0);
+            }
+
+            bm = bitmap_create((u16)header->count);
+
+            if (bm == NULL || !bitmap_registry_set(ctx->registry, name, bm))
+            {
+                bitmap_destroy(bm);
+                return respond(out, op, PROTOCOL_ERR_FAILED, 0);
+            }
+
+            return respond(out, op, PROTOCOL_OK, header->count);
+        case PROTOCOL_OP_ADD:
+            /* Created on demand, growing to fit the values */
+            if (bm == NULL)
+            {
+                bm = bitmap_registry_get(ctx->registry, name, COMMAND_DEFAULT_CAPACITY);
+                created = true;
+
+                if (bm == NULL || !bitmap_set_autogrow(bm, true))
+                {
+                    bitmap_registry_remove(ctx->registry, name);
+                    return respond(out, op, PROTOCOL_ERR_FAILED, 0);
+                }
+            }
+
+            ok = header->count == 0 || bitmap_add_values(bm, values, header->count);
+
+            /* A failed add leaves no bitmap behind, like the text add */
+            if (!ok && created)
+            {
+                bitmap_registry_remove(ctx->registry, name);
+            }
+
+            return respond(out, op, ok ? PROTOCOL_OK : PROTOCOL_ERR_RANGE, header->count);
+        case PROTOCOL_OP_DROP:
+            ok = bitmap_registry_remove(ctx->registry, name);
+
+            return respond(out, op, ok ? PROTOCOL_OK : PROTOCOL_ERR_NAME, 0);
+        case PROTOCOL_OP_DEL:
+        case PROTOCOL_OP_TEST:
+        case PROTOCOL_OP_COUNT:
+        case PROTOCOL_OP_OR:
+        case PROTOCOL_OP_AND:
+        case PROTOCOL_OP_NOT:
+            break;
+        default:
+            return respond(out, op, PROTOCOL_ERR_OP, 0);
+    }
+
+    if (bm == NULL)
+    {
+        return respond(out, op, PROTOCOL_ERR_NAME, 0);
+    }
+
+    switch (op)
+    {
+        case PROTOCOL_OP_DEL:
+            ok = header->count == 0 || bitmap_del_values(bm, values, header->count);
+
+            return respond(out, op, ok ? PROTOCOL_OK : PROTOCOL_ERR_RANGE, header->count);
+        case PROTOCOL_OP_TEST:
+            if (!respond_test(bm, values, header->count, out))
+            {
+                return respond(out, op, PROTOCOL_ERR_FAILED, 0);
+            }
+
+            return true;
+        case PROTOCOL_OP_COUNT:
+            return respond(out, op, PROTOCOL_OK, bm->numbers);
+        case PROTOCOL_OP_NOT:
+            ok = bitmap_not(bm);
+
+            return respond(out, op, ok ? PROTOCOL_OK : PROTOCOL_ERR_FAILED, 0);
+        default:
+            break;
+    }
+
+    /* OR and AND, the second name is the payload */
+    if (header->count == 0 || memchr(payload, '\0', header->count) != NULL)
+    {
+        return respond(out, op, PROTOCOL_ERR_NAME, 0);
+    }
+
+    memcpy(name2, payload, header->count);
+    name2[header->count] = '\0';
+    bm2 = bitmap_registry_find(ctx->registry, name2);
+
+    if (bm2 == NULL)
+    {
+        return respond(out, op, PROTOCOL_ERR_NAME, 0);
+    }
+
+    ok = (op == PROTOCOL_OP_OR) ? bitmap_or(bm, bm2) : bitmap_and(bm, bm2);
+
+    return respond(out, op, ok ? PROTOCOL_OK : PROTOCOL_ERR_FAILED, 0);
+}
+
+bool protocol_append_frame(struct command_output *out, u8 op, u8 status, const char *name,
+                           u32 count, const void *payload, size_t payload_len)
+{
+    struct protocol_header header;
+    size_t name_len = (name != NULL) ? strlen(name) : 0;
+    size_t offset = out->len;
+    size_t len = 0;
+
+    len = sizeof(header) + PROTOCOL_PAD(name_len) + PROTOCOL_PAD(payload_len);
+
+    if (name_len > BITMAP_REGISTRY_NAME_MAX || len > PROTOCOL_FRAME_MAX)
+    {
+        return false;
+    }
+
+    if (!command_output_append(out, NULL, len))
+    {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.op = op;
+    header.status = status;
+    header.name_len = (u16)name_len;
+    header.count = count;
+    header.len = (u32)len;
+
+    /* Padding is 0, a NULL payload too */
+    memset(out->buf + offset, 0, len);
+    memcpy(out->buf + offset, &header, sizeof(header));
+
+    if (name_len > 0)
+    {
+        memcpy(out->buf + offset + sizeof(header), name, name_len);
+    }
+
+    if (payload != NULL && payload_len > 0)
+    {
+        memcpy(out->buf + offset + sizeof(header) + PROTOCOL_PAD(name_len), payload, payload_len);
+    }
+
+    out->len += len;
+
+    return true;
+}
@@ -0,0 +1,501 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "protocol.h"
+#include "server.h"
+
+#define SERVER_MODE_NONE 0   /* Nothing received yet */
+#define SERVER_MODE_TEXT 1   /* Command lines, see command.h */
+#define SERVER_MODE_BINARY 2 /* Frames, see protocol.h */
+
+/* A client */
+struct server_conn
+{
+    int fd;
+    struct command_output in;  /* Received bytes, a partial line at the end */
+    struct command_output out; /* Responses not sent yet */
+    size_t out_sent;           /* Bytes of out already sent */
+    u32 events;                /* EPOLL* currently registered */
+    int mode;                  /* SERVER_MODE_*, set by the first byte */
+    bool closing;              /* The client shut down its side, close after the last response */
+    struct server_conn *prev;  /* List of all clients, to drop them on stop */
+    struct server_conn *next;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+/*****************************************************************************
+ *
+ *   Name:       server_listen
+ *
+ *   Input:      path        Path of the socket
+ *   Return:     Success     A non-blocking listening socket
+ *               Failed      -1
+ *   Description            Create the socket, replacing a stale one at path
+ ******************************************************************************/
+static int server_listen(const char *path);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_accept
+ *
+ *   Input:      epfd        The epoll instance
+ *               listen_fd   The listening socket
+ *               conns       The list of clients
+ *   Return:     Success     None
+ *               Failed      None, a client that cannot be set up is dropped
+ *   Description            Accept every pending client
+ ******************************************************************************/
+static void conn_accept(int epfd, int listen_fd, struct server_conn **conns);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_read
+ *
+ *   Input:      ctx         The bitmaps
+ *               conn        A client with readable data
+ *   Return:     Success     true
+ *               Failed      false, the connection has to be closed
+ *   Description            Read what arrived and execute every complete line
+ ******************************************************************************/
+static bool conn_read(struct command_context *ctx, struct server_conn *conn);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_execute_lines
+ *
+ *   Input:      ctx         The bitmaps
+ *               conn        A text client
+ *   Return:     Success     Bytes of the input buffer that were executed
+ *               Failed      -1, a line is longer than SERVER_LINE_MAX
+ *   Description            Execute every complete command line of the input buffer
+ ******************************************************************************/
+static ssize_t conn_execute_lines(struct command_context *ctx, struct server_conn *conn);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_execute_frames
+ *
+ *   Input:      ctx         The bitmaps
+ *               conn        A binary client
+ *   Return:     Success     Bytes of the input buffer that were executed
+ *               Failed      -1, the input is not a valid frame
+ *   Description            Execute every complete frame of the input buffer
+ ******************************************************************************/
+static ssize_t conn_execute_frames(struct command_context *ctx, struct server_conn *conn);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_write
+ *
+ *   Input:      conn        A client
+ *   Return:     Success     true
+ *               Failed      false, the connection has to be closed
+ *   Description            Send as many pending responses as the socket takes
+ ******************************************************************************/
+static bool conn_write(struct server_conn *conn);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_update
+ *
+ *   Input:      epfd        The epoll instance
+ *               conn        A client
+ *   Return:     Success     true
+ *               Failed      false, the connection has to be closed
+ *   Description            Wait for input while the output backlog is small, and for
+ *                           writability while responses are pending
+ ******************************************************************************/
+static bool conn_update(int epfd, struct server_conn *conn);
+
+/*****************************************************************************
+ *
+ *   Name:       conn_close
+ *
+ *   Input:      epfd        The epoll instance
+ *               conn        A client
+ *               conns       The list of clients
+ *   Return:     Success     None
+ *               Failed      None
+ *   Description            Close a connection and free its buffers
+ ******************************************************************************/
+static void conn_close(int epfd, struct server_conn *conn, struct server_conn **conns);
+
+static int server_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd = -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    /* Only a socket left over by an earlier run is removed, never a regular file */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void conn_accept(int epfd, int listen_fd, struct server_conn **conns)
+{
+    struct server_conn *conn = NULL;
+    struct epoll_event event;
+    int fd = -1;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0)
+    {
+        conn = (struct server_conn *)calloc(1, sizeof(struct server_conn));
+
+        if (conn == NULL || fcntl(fd, F_SETFL, O_NONBLOCK) != 0 ||
+            fcntl(fd, F_SETFD, FD_CLOEXEC) != 0)
+        {
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        event.events = conn->events;
+        event.data.ptr = conn;
+
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        conn->next = *conns;
+
+        if (*conns != NULL)
+        {
+            (*conns)->prev = conn;
+        }
+
+        *conns = conn;
+    }
+
+    return;
+}
+
+static bool conn_read(struct command_context *ctx, struct server_conn *conn)
+{
+    ssize_t len = 0;
+    ssize_t used = 0;
+
+    if (!command_output_append(&conn->in, NULL, SERVER_READ_SIZE))
+    {
+        return false;
+    }
+
+    len = read(conn->fd, conn->in.buf + conn->in.len, conn->in.size - conn->in.len);
+
+    if (len < 0)
+    {
+        return errno == EAGAIN || errno == EINTR;
+    }
+
+    conn->in.len += (size_t)len;
+
+    /* The first byte tells the protocol of the connection */
+    if (conn->mode == SERVER_MODE_NONE && conn->in.len > 0)
+    {
+        conn->mode = ((u8)conn->in.buf[0] == PROTOCOL_MAGIC) ? SERVER_MODE_BINARY
+                                                              : SERVER_MODE_TEXT;
+    }
+
+    if (len == 0)
+    {
+        /* Answer what was sent before the shutdown, a last line may lack its newline */
+        conn->closing = true;
+
+        if (conn->mode == SERVER_MODE_TEXT && conn->in.len > 0 &&
+            !command_output_append(&conn->in, "\n", 1))
+        {
+            return false;
+        }
+    }
+
+    if (conn->mode == SERVER_MODE_BINARY)
+    {
+        used = conn_execute_frames(ctx, conn);
+    }
+    else if (conn->mode == SERVER_MODE_TEXT)
+    {
+        used = conn_execute_lines(ctx, conn);
+    }
+
+    if (used < 0)
+    {
+        return false;
+    }
+
+    memmove(conn->in.buf, conn->in.buf + used, conn->in.len - (size_t)used);
+    conn->in.len -= (size_t)used;
+
+    return true;
+}
+
+static ssize_t conn_execute_lines(struct command_context *ctx, struct server_conn *conn)
+{
+    char *line = NULL;
+    char *end = NULL;
+    size_t used = 0;
+
+    /* Every complete line, in order, responses queue up behind the pending ones */
+    line = conn->in.buf;
+
+    while ((end = memchr(line, '\n', conn->in.len - used)) != NULL)
+    {
+        *end = '\0';
+
+        if (end > line && end[-1] == '\r')
+        {
+            end[-1] = '\0';
+        }
+
+        command_execute(ctx, line, &conn->out);
+        used += (size_t)(end - line) + 1;
+        line = end + 1;
+    }
+
+    if (conn->in.len - used > SERVER_LINE_MAX)
+    {
+        return -1;
+    }
+
+    return (ssize_t)used;
+}
+
+static ssize_t conn_execute_frames(struct command_context *ctx, struct server_conn *conn)
+{
+    const u8 *frame = NULL;
+    ssize_t len = 0;
+    size_t used = 0;
+
+    /* Frames are multiples of PROTOCOL_ALIGN, so each one starts aligned in the buffer */
+    while (true)
+    {
+        frame = (const u8 *)conn->in.buf + used;
+        len = protocol_frame_len(frame, conn->in.len - used);
+
+        if (len <= 0)
+        {
+            break;
+        }
+
+        protocol_execute(ctx, frame, &conn->out);
+        used += (size_t)len;
+    }
+
+    /* A broken frame loses the framing of everything after it */
+    return (len < 0) ? -1 : (ssize_t)used;
+}
+
+static bool conn_write(struct server_conn *conn)
+{
+    ssize_t len = 0;
+
+    while (conn->out_sent < conn->out.len)
+    {
+        len = send(conn->fd, conn->out.buf + conn->out_sent, conn->out.len - conn->out_sent,
+                   MSG_NOSIGNAL);
+
+        if (len < 0)
+        {
+            return errno == EAGAIN || errno == EINTR;
+        }
+
+        conn->out_sent += (size_t)len;
+    }
+
+    conn->out.len = 0;
+    conn->out_sent = 0;
+
+    return true;
+}
+
+static bool conn_update(int epfd, struct server_conn *conn)
+{
+    struct epoll_event event;
+    size_t pending = conn->out.len - conn->out_sent;
+    u32 events = 0;
+
+    if (!conn->closing && pending < SERVER_OUTPUT_MAX)
+    {
+        events |= EPOLLIN;
+    }
+
+    if (pending > 0)
+    {
+        events |= EPOLLOUT;
+    }
+
+    /* Nothing left to read or send */
+    if (events == 0)
+    {
+        return false;
+    }
+
+    if (events == conn->events)
+    {
+        return true;
+    }
+
+    conn->events = events;
+    event.events = events;
+    event.data.ptr = conn;
+
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &event) == 0;
+}
+
+static void conn_close(int epfd, struct server_conn *conn, struct server_conn **conns)
+{
+    if (conn->prev != NULL)
+    {
+        conn->prev->next = conn->next;
+    }
+    else
+    {
+        *conns = conn->next;
+    }
+
+    if (conn->next != NULL)
+    {
+        conn->next->prev = conn->prev;
+    }
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    command_output_free(&conn->in);
+    command_output_free(&conn->out);
+    free(conn);
+
+    return;
+}
+
+bool server_run(struct command_context *ctx, const char *path)
+{
+    struct epoll_event events[SERVER_EVENTS];
+    struct epoll_event event;
+    struct server_conn *conns = NULL;
+    struct server_conn *conn = NULL;
+    int listen_fd = -1;
+    int epfd = -1;
+    int count = 0;
+    int i = 0;
+    bool ok = false;
+
+    if (ctx == NULL || path == NULL)
+    {
+        return false;
+    }
+
+    stopping = 0;
+    listen_fd = server_listen(path);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (listen_fd < 0 || epfd < 0)
+    {
+        goto cleanup;
+    }
+
+    /* The listening socket is the only one without a connection */
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &event) != 0)
+    {
+        goto cleanup;
+    }
+
+    ok = true;
+
+    while (!stopping)
+    {
+        count = epoll_wait(epfd, events, SERVER_EVENTS, SERVER_POLL_MS);
+
+        for (i = 0; i < count; i++)
+        {
+            conn = (struct server_conn *)events[i].data.ptr;
+
+            if (conn == NULL)
+            {
+                conn_accept(epfd, listen_fd, &conns);
+                continue;
+            }
+
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN))
+            {
+                conn_close(epfd, conn, &conns);
+                continue;
+            }
+
+            if (((events[i].events & EPOLLIN) && !conn_read(ctx, conn)) || !conn_write(conn) ||
+                !conn_update(epfd, conn))
+            {
+                conn_close(epfd, conn, &conns);
+            }
+        }
+    }
+
+cleanup:
+    /* Clients still connected are dropped, pending responses are lost */
+    while (conns != NULL)
+    {
+        conn_close(epfd, conns, &conns);
+    }
+
+    if (epfd >= 0)
+    {
+        close(epfd);
+    }
+
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(path);
+    }
+
+    return ok;
+}
+
+void server_stop(void)
+{
+    stopping = 1;
+
+    return;
+}
@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-registry.h"
+#include "command.h"
+#include "test.h"
+
+/*
+ * Scripts through command_run_script, compared with the exact output of the driver.
+ */
+
+static void check_script(const char *script, const char *expected, u32 expected_failed)
+{
+    struct command_context ctx = {NULL};
+    FILE *in = NULL;
+    FILE *out = NULL;
+    char *output = NULL;
+    size_t output_len = 0;
+    u32 failed = 0;
+
+    ctx.registry = bitmap_registry_create();
+    in = fmemopen((void *)script, strlen(script), "r");
+    out = open_memstream(&output, &output_len);
+    TEST_CHECK(ctx.registry != NULL && in != NULL && out != NULL);
+
+    if (ctx.registry != NULL && in != NULL && out != NULL)
+    {
+        failed = command_run_script(&ctx, in, out);
+        fclose(out);
+        out = NULL;
+
+        if (failed != expected_failed || strcmp(output, expected) != 0)
+        {
+            fprintf(stderr, "script:\n%s\ngave %u failures and:\n%s\n", script, failed, output);
+            TEST_CHECK(false);
+        }
+    }
+
+    if (out != NULL)
+    {
+        fclose(out);
+    }
+
+    if (in != NULL)
+    {
+        fclose(in);
+    }
+
+    free(output);
+    bitmap_registry_destroy(ctx.registry);
+
+    return;
+}
+
+int main(void)
+{
+    char values_script[4096] = "create b 1000\nadd b";
+    char *pos = values_script + strlen(values_script);
+    u32 i = 0;
+
+    /* 300 values, more than one batch used to take */
+    for (i = 0; i < 300; i++)
+    {
+        pos += sprintf(pos, " %u", i);
+    }
+
+    strcpy(pos, " bogus\ncount b\n");
+    pos += strlen(pos);
+
+    for (i = 0; i < 300; i++)
+    {
+        pos += sprintf(pos, (i == 0) ? "add b %u" : " %u", i);
+    }
+
+    strcpy(pos, "\ndel b 0 x\ncount b\n");
+    /* LF and CRLF scripts run the same */
+    check_script("parse a 1-3\nprint a\ncount a\n", "OK\n1-3\n3\n", 0);
+    check_script("parse a 1-3\r\nprint a\r\ncount a\r\n", "OK\n1-3\n3\n", 0);
+    check_script("parse a 1-3\r\ncount a", "OK\n3\n", 0);
+
+    /* A bad value anywhere fails add and del before anything changed */
+    check_script(values_script, "OK\nERR bad value\n0\nOK\nERR bad value\n300\n", 2);
+    check_script("add new 1 bogus\nlist\nadd new 1 2\nlist\n", "ERR bad value\n\nOK\nnew\n", 1);
+    check_script("create b 10\nadd b 1 20\ncount b\n", "OK\nERR value out of range\n0\n", 1);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,222 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-diff.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * Round trips of bitmap_diff and bitmap_patch over random pairs: the same capacity, grown
+ * and shrunk, from scattered changes that encode as flipped bits to rewritten ranges that
+ * encode as runs of words. Broken patches must leave the bitmap unchanged.
+ */
+
+#define DIFF_CASES 4000
+#define DIFF_ENCODING 5 /* Byte of the encoding in the patch header */
+#define DIFF_RUNS 1
+#define DIFF_BITS 2
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+static u32 encodings[3];
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return rng_state;
+}
+
+static u16 random_capacity(void)
+{
+    /* Small ones often, to hit the tail word and the SSE2 groups of 4 */
+    return (rng() & 1) ? (u16)(1 + rng() % 300) : (u16)(1 + rng() % UINT16_MAX);
+}
+
+static struct bitmap *random_bitmap(u16 capacity)
+{
+    struct bitmap *bm = bitmap_create(capacity);
+    u32 density = (u32)(rng() % 101);
+    u32 v = 0;
+
+    for (v = 0; bm != NULL && v < capacity; v++)
+    {
+        if (rng() % 100 < density)
+        {
+            bitmap_add_value(bm, (u16)v);
+        }
+    }
+
+    return bm;
+}
+
+/* from with a few flipped bits, or with a range rewritten, or an unrelated bitmap */
+static struct bitmap *changed_bitmap(struct bitmap *from, u16 capacity)
+{
+    struct bitmap *to = NULL;
+    u32 start = 0;
+    u32 end = 0;
+    u32 v = 0;
+    u32 i = 0;
+
+    if (rng() % 3 == 0)
+    {
+        return random_bitmap(capacity);
+    }
+
+    to = bitmap_clone(from);
+
+    if (to == NULL || !bitmap_resize(to, capacity))
+    {
+        bitmap_destroy(to);
+        return NULL;
+    }
+
+    if (rng() & 1)
+    {
+        for (i = rng() % 16; i > 0; i--)
+        {
+            v = (u32)(rng() % capacity);
+
+            if (bitmap_test_value(to, (u16)v))
+            {
+                bitmap_del_value(to, (u16)v);
+            }
+            else
+            {
+                bitmap_add_value(to, (u16)v);
+            }
+        }
+    }
+    else
+    {
+        start = (u32)(rng() % capacity);
+        end = start + (u32)(rng() % (capacity - start));
+
+        for (v = start; v <= end; v++)
+        {
+            if (rng() & 1)
+            {
+                bitmap_add_value(to, (u16)v);
+            }
+            else
+            {
+                bitmap_del_value(to, (u16)v);
+            }
+        }
+    }
+
+    return to;
+}
+
+static bool same_bitmap(const struct bitmap *a, const struct bitmap *b)
+{
+    if (a->max_value != b->max_value || a->numbers != b->numbers ||
+        memcmp(a->buf, b->buf, a->buf_len * sizeof(u32)) != 0)
+    {
+        return false;
+    }
+
+    /* The bounds mean nothing in an empty bitmap */
+    return a->numbers == 0 || (a->first_value == b->first_value && a->last_value == b->last_value);
+}
+
+static void test_round_trip(void)
+{
+    struct bitmap *from = NULL;
+    struct bitmap *to = NULL;
+    struct bitmap *copy = NULL;
+    u8 *patch = NULL;
+    size_t size = 0;
+    u32 i = 0;
+
+    for (i = 0; i < DIFF_CASES; i++)
+    {
+        from = random_bitmap(random_capacity());
+        to = (from != NULL) ? changed_bitmap(from, random_capacity()) : NULL;
+        copy = (from != NULL) ? bitmap_clone(from) : NULL;
+        TEST_CHECK(from != NULL && to != NULL && copy != NULL);
+
+        if (from == NULL || to == NULL || copy == NULL)
+        {
+            goto next;
+        }
+
+        /* Too small a buffer gets the size and nothing written */
+        size = bitmap_diff(from, to, NULL, 0);
+        patch = (u8 *)malloc(size);
+        TEST_CHECK(size >= 16 && patch != NULL);
+
+        if (patch == NULL)
+        {
+            goto next;
+        }
+
+        TEST_CHECK(bitmap_diff(from, to, patch, size) == size);
+        encodings[patch[DIFF_ENCODING] % 3]++;
+
+        /* A cut patch and a patch for another capacity change nothing */
+        TEST_CHECK(!bitmap_patch(copy, patch, size - 1));
+        TEST_CHECK(same_bitmap(copy, from));
+
+        if (from->max_value != UINT16_MAX && bitmap_resize(copy, from->max_value + 1))
+        {
+            TEST_CHECK(!bitmap_patch(copy, patch, size));
+            TEST_CHECK(bitmap_resize(copy, from->max_value) && same_bitmap(copy, from));
+        }
+
+        TEST_CHECK(bitmap_patch(copy, patch, size));
+
+        if (!same_bitmap(copy, to))
+        {
+            fprintf(stderr, "case %u: %u to %u bits, patch of %zu bytes gives another bitmap\n",
+                    i, from->max_value, to->max_value, size);
+            TEST_CHECK(false);
+        }
+
+    next:
+        free(patch);
+        patch = NULL;
+        bitmap_destroy(from);
+        bitmap_destroy(to);
+        bitmap_destroy(copy);
+    }
+
+    /* Both encodings were picked, and nothing else */
+    TEST_CHECK(encodings[DIFF_RUNS] > DIFF_CASES / 10 && encodings[DIFF_BITS] > DIFF_CASES / 10);
+    TEST_CHECK(encodings[0] == 0);
+
+    return;
+}
+
+static void test_identical(void)
+{
+    struct bitmap *bm = random_bitmap(1000);
+    struct bitmap *copy = (bm != NULL) ? bitmap_clone(bm) : NULL;
+    u8 patch[64];
+
+    /* No changes is the header alone */
+    TEST_CHECK(bm != NULL && copy != NULL);
+
+    if (bm != NULL && copy != NULL)
+    {
+        TEST_CHECK(bitmap_diff(bm, copy, patch, sizeof(patch)) == 16);
+        TEST_CHECK(bitmap_patch(copy, patch, 16) && same_bitmap(copy, bm));
+    }
+
+    bitmap_destroy(bm);
+    bitmap_destroy(copy);
+
+    return;
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_identical();
+
+    return TEST_EXIT();
+}
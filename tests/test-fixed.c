@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bitmap-fixed.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * BITMAP_DEFINE at a whole number of words, with a partial last word, and at the largest
+ * capacity, checked against the dynamic bitmaps.
+ */
+
+BITMAP_DEFINE(fixed64, 64);
+BITMAP_DEFINE(fixed100, 100);
+BITMAP_DEFINE(fixed65535, 65535);
+
+/* Every third value in a, every fifth in b, not a, a | b and a & b against struct bitmap */
+#define TEST_FIXED(name, NBITS)                                                                    \
+    do                                                                                             \
+    {                                                                                              \
+        struct name a;                                                                             \
+        struct name b;                                                                             \
+        struct bitmap view;                                                                        \
+        struct bitmap *dyn = bitmap_create(NBITS);                                                 \
+        u32 v = 0;                                                                                 \
+                                                                                                   \
+        name##_clear(&a);                                                                          \
+        name##_clear(&b);                                                                          \
+                                                                                                   \
+        for (v = 0; v < (NBITS); v++)                                                              \
+        {                                                                                          \
+            if (v % 3 == 0)                                                                        \
+            {                                                                                      \
+                name##_add(&a, v);                                                                 \
+            }                                                                                      \
+                                                                                                   \
+            if (v % 5 == 0)                                                                        \
+            {                                                                                      \
+                name##_add(&b, v);                                                                 \
+            }                                                                                      \
+        }                                                                                          \
+                                                                                                   \
+        name##_del(&b, 0);                                                                         \
+        TEST_CHECK(!name##_test(&b, 0) && name##_test(&b, 5) && !name##_test(&b, 6));              \
+        TEST_CHECK(name##_count(&a) == ((NBITS) + 2) / 3);                                         \
+                                                                                                   \
+        /* Bits past NBITS stay 0, the count and bitmap_init_external rely on it */                \
+        name##_not(&a);                                                                            \
+        TEST_CHECK(name##_count(&a) == (NBITS) - ((NBITS) + 2) / 3);                               \
+        TEST_CHECK((a.buf[BITMAP_FIXED_WORDS(NBITS) - 1] & ~BITMAP_FIXED_TAIL_MASK(NBITS)) == 0);  \
+                                                                                                   \
+        TEST_CHECK(name##_to_bitmap(&a, &view));                                                   \
+        TEST_CHECK(view.max_value == (NBITS) && view.numbers == name##_count(&a));                 \
+        TEST_CHECK(dyn != NULL);                                                                   \
+                                                                                                   \
+        for (v = 0; dyn != NULL && v < (NBITS); v++)                                               \
+        {                                                                                          \
+            if (v % 3 == 0)                                                                        \
+            {                                                                                      \
+                bitmap_add_value(dyn, (u16)v);                                                     \
+            }                                                                                      \
+        }                                                                                          \
+                                                                                                   \
+        if (dyn != NULL)                                                                           \
+        {                                                                                          \
+            bitmap_not(dyn);                                                                       \
+            TEST_CHECK(dyn->numbers == view.numbers && dyn->first_value == view.first_value &&     \
+                       dyn->last_value == view.last_value);                                        \
+                                                                                                   \
+            for (v = 0; v < (NBITS); v++)                                                          \
+            {                                                                                      \
+                TEST_CHECK(bitmap_test_value(&view, (u16)v) == bitmap_test_value(dyn, (u16)v));    \
+            }                                                                                      \
+        }                                                                                          \
+                                                                                                   \
+        bitmap_destroy(&view);                                                                     \
+        bitmap_destroy(dyn);                                                                       \
+                                                                                                   \
+        name##_not(&a);                                                                            \
+        name##_or(&a, &b);                                                                         \
+        TEST_CHECK(name##_test(&a, 3) && name##_test(&a, 5) && !name##_test(&a, 7));               \
+        name##_and(&a, &b);                                                                        \
+        TEST_CHECK(name##_count(&a) == name##_count(&b));                                          \
+    } while (0)
+
+int main(void)
+{
+    TEST_FIXED(fixed64, 64);
+    TEST_FIXED(fixed100, 100);
+    TEST_FIXED(fixed65535, 65535);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,94 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bitmap-io.h"
+#include "bitmap-mmap.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * A writer and a reader mapping the same file, and files the mapping must reject.
+ */
+
+static char path[64];
+
+static void test_live_writer(void)
+{
+    struct bitmap_mapped writer;
+    struct bitmap_mapped reader;
+    struct bitmap *bm = bitmap_create(1000);
+    struct bitmap *view = NULL;
+
+    TEST_CHECK(bm != NULL && bitmap_add_value(bm, 5) && bitmap_save_file(bm, path));
+    bitmap_destroy(bm);
+
+    TEST_CHECK(bitmap_map_file(&writer, path, BITMAP_MAP_WRITE));
+    TEST_CHECK(bitmap_map_file(&reader, path, BITMAP_MAP_READONLY));
+    TEST_CHECK(!bitmap_add_value(&reader.bm, 7));
+
+    /* The words change under the reader, the summary only on a refresh */
+    TEST_CHECK(bitmap_add_value(&writer.bm, 900));
+    TEST_CHECK(bitmap_test_value(&reader.bm, 900) && reader.bm.numbers == 1);
+    view = bitmap_map_refresh(&reader);
+    TEST_CHECK(view == &reader.bm && view->numbers == 2 && view->first_value == 5 &&
+               view->last_value == 900);
+
+    TEST_CHECK(bitmap_del_value(&writer.bm, 5));
+    view = bitmap_map_refresh(&reader);
+    TEST_CHECK(view != NULL && view->numbers == 1 && view->first_value == 900 &&
+               view->last_value == 900);
+
+    TEST_CHECK(bitmap_unmap(&reader));
+    TEST_CHECK(bitmap_unmap(&writer));
+    TEST_CHECK(bitmap_map_refresh(&reader) == NULL);
+
+    /* The checkpoint of the writer is what a later load sees */
+    bm = bitmap_load_file(path);
+    TEST_CHECK(bm != NULL && bm->numbers == 1 && bitmap_test_value(bm, 900));
+    bitmap_destroy(bm);
+
+    return;
+}
+
+static void test_tail_bits(void)
+{
+    struct bitmap_file_header header;
+    struct bitmap_mapped mapped;
+    struct bitmap *bm = bitmap_create(100);
+    u32 word = 0;
+    int fd = -1;
+
+    TEST_CHECK(bm != NULL && bitmap_add_value(bm, 99) && bitmap_save_file(bm, path));
+    bitmap_destroy(bm);
+
+    TEST_CHECK(bitmap_map_file(&mapped, path, BITMAP_MAP_READONLY));
+    TEST_CHECK(mapped.bm.numbers == 1 && bitmap_unmap(&mapped));
+
+    /* A bit past the capacity of 100, in the last word */
+    fd = open(path, O_RDWR);
+    TEST_CHECK(fd >= 0 && pread(fd, &header, sizeof(header), 0) == sizeof(header));
+    TEST_CHECK(pread(fd, &word, sizeof(word), header.header_size + 3 * sizeof(u32)) ==
+               sizeof(word));
+    word |= 1U << 10;
+    TEST_CHECK(pwrite(fd, &word, sizeof(word), header.header_size + 3 * sizeof(u32)) ==
+               sizeof(word));
+    close(fd);
+
+    TEST_CHECK(!bitmap_map_file(&mapped, path, BITMAP_MAP_READONLY));
+
+    return;
+}
+
+int main(void)
+{
+    snprintf(path, sizeof(path), "/tmp/test-mmap-%d.bm", (int)getpid());
+
+    test_live_writer();
+    test_tail_bits();
+    unlink(path);
+
+    return TEST_EXIT();
+}
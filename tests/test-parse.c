@@ -0,0 +1,193 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-parse.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * bitmap_parse_parallel against bitmap_parse_str on inputs large enough to be split, with
+ * split points inside ranges, and error offsets of bad bytes in later pieces.
+ */
+
+#define PARSE_INPUT_SIZE (3 * 1024 * 1024) /* Several pieces of at least 256 KiB */
+
+static const u32 thread_counts[] = {0, 1, 2, 3, 4, 7, 8};
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return rng_state;
+}
+
+/* Mostly ranges, some single values and spaces, up to PARSE_INPUT_SIZE bytes */
+static size_t make_input(char *str)
+{
+    size_t len = 0;
+    u32 start = 0;
+
+    while (len < PARSE_INPUT_SIZE - 32)
+    {
+        start = (u32)(rng() % 60000);
+
+        if (len > 0)
+        {
+            len += (size_t)sprintf(str + len, (rng() % 8 == 0) ? " , " : ",");
+        }
+
+        if (rng() % 4 == 0)
+        {
+            len += (size_t)sprintf(str + len, "%u", start);
+        }
+        else
+        {
+            len += (size_t)sprintf(str + len, "%u-%u", start, start + (u32)(rng() % 5000));
+        }
+    }
+
+    return len;
+}
+
+static bool same_bitmap(const struct bitmap *a, const struct bitmap *b)
+{
+    return a != NULL && b != NULL && a->max_value == b->max_value && a->numbers == b->numbers &&
+           a->first_value == b->first_value && a->last_value == b->last_value &&
+           memcmp(a->buf, b->buf, a->buf_len * sizeof(u32)) == 0;
+}
+
+/* Whether the even split points of a thread count fall inside an entry, not on a separator */
+static u32 splits_inside_entries(const char *str, size_t len, u32 threads)
+{
+    u32 inside = 0;
+    u32 i = 0;
+
+    for (i = 1; i < threads; i++)
+    {
+        inside += (strchr(", ", str[len * i / threads]) == NULL);
+    }
+
+    return inside;
+}
+
+static void test_same_as_str(const char *str, size_t len)
+{
+    struct bitmap *expected = NULL;
+    struct bitmap *bm = NULL;
+    char *copy = NULL;
+    size_t error_offset = 0;
+    u32 inside = 0;
+    size_t i = 0;
+
+    /* bitmap_parse_str takes a writable string */
+    copy = strdup(str);
+    expected = (copy != NULL) ? bitmap_parse_str((u8 *)copy) : NULL;
+    TEST_CHECK(expected != NULL);
+    free(copy);
+
+    for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        inside += splits_inside_entries(str, len, thread_counts[i]);
+        bm = bitmap_parse_parallel((const u8 *)str, len, thread_counts[i], &error_offset);
+
+        if (!same_bitmap(bm, expected))
+        {
+            fprintf(stderr, "%u threads: not the bitmap of bitmap_parse_str\n", thread_counts[i]);
+            TEST_CHECK(false);
+        }
+
+        bitmap_destroy(bm);
+    }
+
+    /* The cuts had to move to the next separator */
+    TEST_CHECK(inside > 0);
+    bitmap_destroy(expected);
+
+    return;
+}
+
+static void test_error_offset(char *str, size_t len)
+{
+    size_t first = len * 3 / 4 + 11;
+    size_t second = len * 7 / 8 + 5;
+    size_t error_offset = 0;
+    size_t i = 0;
+    char saved[2] = {str[first], str[second]};
+
+    /* A bad byte in a later piece is reported against the whole input */
+    str[first] = 'x';
+
+    for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        error_offset = 0;
+        TEST_CHECK(bitmap_parse_parallel((const u8 *)str, len, thread_counts[i], &error_offset) ==
+                   NULL);
+
+        if (error_offset != first)
+        {
+            fprintf(stderr, "%u threads: error at %zu, not %zu\n", thread_counts[i], error_offset,
+                    first);
+            TEST_CHECK(false);
+        }
+    }
+
+    /* With a bad byte in two pieces the first one is reported */
+    str[second] = '#';
+    TEST_CHECK(bitmap_parse_parallel((const u8 *)str, len, 8, &error_offset) == NULL);
+    TEST_CHECK(error_offset == first);
+
+    str[first] = saved[0];
+    TEST_CHECK(bitmap_parse_parallel((const u8 *)str, len, 8, &error_offset) == NULL);
+    TEST_CHECK(error_offset == second);
+
+    str[second] = saved[1];
+
+    return;
+}
+
+static void test_small(void)
+{
+    const char *inputs[] = {"1-3,5,7", " 0 ", "65534", "1-3,5,", "1--3", ",1", "", "   "};
+    struct bitmap *expected = NULL;
+    struct bitmap *bm = NULL;
+    char copy[32];
+    size_t i = 0;
+
+    /* One piece: the same results and failures as bitmap_parse_str */
+    for (i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        strcpy(copy, inputs[i]);
+        expected = bitmap_parse_str((u8 *)copy);
+        bm = bitmap_parse_parallel((const u8 *)inputs[i], strlen(inputs[i]), 4, NULL);
+        TEST_CHECK((bm == NULL) == (expected == NULL));
+        TEST_CHECK(bm == NULL || same_bitmap(bm, expected));
+        bitmap_destroy(expected);
+        bitmap_destroy(bm);
+    }
+
+    return;
+}
+
+int main(void)
+{
+    char *str = (char *)malloc(PARSE_INPUT_SIZE + 1);
+    size_t len = 0;
+
+    if (str == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    len = make_input(str);
+    test_same_as_str(str, len);
+    test_error_offset(str, len);
+    test_small();
+    free(str);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,74 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-registry.h"
+#include "command.h"
+#include "protocol.h"
+#include "test.h"
+
+/*
+ * Binary requests through protocol_execute, checked by the status of the response.
+ */
+
+static u8 execute(struct command_context *ctx, u8 op, const char *name, const u16 *values,
+                  u32 count)
+{
+    struct command_output request = {NULL, 0, 0};
+    struct command_output response = {NULL, 0, 0};
+    struct protocol_header header;
+    u8 status = PROTOCOL_ERR_FAILED;
+
+    if (protocol_append_frame(&request, op, 0, name, count, values, count * sizeof(u16)) &&
+        protocol_frame_len((const u8 *)request.buf, request.len) == (ssize_t)request.len)
+    {
+        protocol_execute(ctx, (const u8 *)request.buf, &response);
+
+        if (response.len >= sizeof(header))
+        {
+            memcpy(&header, response.buf, sizeof(header));
+            status = header.status;
+        }
+    }
+
+    command_output_free(&request);
+    command_output_free(&response);
+
+    return status;
+}
+
+int main(void)
+{
+    struct command_context ctx = {NULL};
+    const u16 values[] = {1, 2, 300};
+    const u16 too_large[] = {1, UINT16_MAX};
+    struct bitmap *bm = NULL;
+
+    ctx.registry = bitmap_registry_create();
+    TEST_CHECK(ctx.registry != NULL);
+
+    if (ctx.registry == NULL)
+    {
+        return TEST_EXIT();
+    }
+
+    /* ADD creates a missing bitmap, growing to fit, and leaves none behind when it fails */
+    TEST_CHECK(execute(&ctx, PROTOCOL_OP_ADD, "new", too_large, 2) == PROTOCOL_ERR_RANGE);
+    TEST_CHECK(bitmap_registry_find(ctx.registry, "new") == NULL);
+
+    TEST_CHECK(execute(&ctx, PROTOCOL_OP_ADD, "new", values, 3) == PROTOCOL_OK);
+    bm = bitmap_registry_find(ctx.registry, "new");
+    TEST_CHECK(bm != NULL && bm->numbers == 3 && bitmap_test_value(bm, 300));
+
+    /* An existing bitmap stays as it was */
+    TEST_CHECK(execute(&ctx, PROTOCOL_OP_ADD, "new", too_large, 2) == PROTOCOL_ERR_RANGE);
+    bm = bitmap_registry_find(ctx.registry, "new");
+    TEST_CHECK(bm != NULL && bm->numbers == 3);
+
+    TEST_CHECK(execute(&ctx, PROTOCOL_OP_DEL, "none", values, 3) == PROTOCOL_ERR_NAME);
+    TEST_CHECK(bitmap_registry_find(ctx.registry, "none") == NULL);
+
+    bitmap_registry_destroy(ctx.registry);
+
+    return TEST_EXIT();
+}
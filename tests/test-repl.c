@@ -0,0 +1,283 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bitmap-registry.h"
+#include "bitmap-repl.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * A primary and a follower over a socketpair, in one process: random adds, deletes, NOT and
+ * resizes must reach the follower, acknowledged. Records relayed by hand arrive split across
+ * reads, or corrupted.
+ */
+
+#define REPL_ROUNDS 300
+#define REPL_BITMAPS 3
+#define REPL_RELAY_SIZE (64 * 1024)
+
+static const char *const names[REPL_BITMAPS] = {"a", "b", "c"};
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return rng_state;
+}
+
+static bool same_bitmap(const struct bitmap *a, const struct bitmap *b)
+{
+    return a != NULL && b != NULL && a->max_value == b->max_value && a->numbers == b->numbers &&
+           memcmp(a->buf, b->buf, a->buf_len * sizeof(u32)) == 0;
+}
+
+static bool same_registry(const struct bitmap_registry *primary,
+                          const struct bitmap_registry *follower)
+{
+    u32 i = 0;
+
+    for (i = 0; i < REPL_BITMAPS; i++)
+    {
+        if (!same_bitmap(bitmap_registry_find(primary, names[i]),
+                         bitmap_registry_find(follower, names[i])))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void change(struct bitmap *bm)
+{
+    u32 op = (u32)(rng() % 16);
+    u32 i = 0;
+
+    if (op == 0)
+    {
+        bitmap_not(bm);
+    }
+    else if (op == 1)
+    {
+        /* Shrink or grow, anywhere up to the largest capacity */
+        bitmap_resize(bm, (u16)(1 + rng() % UINT16_MAX));
+    }
+    else
+    {
+        for (i = (u32)(rng() % 64); i > 0; i--)
+        {
+            if (op & 1)
+            {
+                bitmap_del_value(bm, (u16)(rng() % bm->max_value));
+            }
+            else
+            {
+                bitmap_add_value(bm, (u16)(rng() % bm->max_value));
+            }
+        }
+    }
+
+    return;
+}
+
+/* Poll the follower until it applied everything sent, then take its acknowledgment */
+static bool catch_up(struct bitmap_repl *primary, struct bitmap_repl *follower)
+{
+    struct bitmap_repl_stats sent;
+    struct bitmap_repl_stats applied;
+    u32 i = 0;
+
+    bitmap_repl_get_stats(primary, &sent);
+
+    for (i = 0; i < 1000; i++)
+    {
+        bitmap_repl_get_stats(follower, &applied);
+
+        if (applied.seq == sent.seq)
+        {
+            break;
+        }
+
+        if (!bitmap_repl_poll(follower, 1000))
+        {
+            return false;
+        }
+    }
+
+    for (i = 0; i < 1000; i++)
+    {
+        bitmap_repl_get_stats(primary, &sent);
+
+        if (sent.seq_ack == sent.seq)
+        {
+            return true;
+        }
+
+        if (!bitmap_repl_poll(primary, 1000))
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static void test_round_trip(void)
+{
+    struct bitmap_registry *source = bitmap_registry_create();
+    struct bitmap_registry *copy = bitmap_registry_create();
+    struct bitmap_repl *primary = NULL;
+    struct bitmap_repl *follower = NULL;
+    struct bitmap_repl_stats sent;
+    struct bitmap_repl_stats applied;
+    int fds[2] = {-1, -1};
+    u32 round = 0;
+    u32 i = 0;
+
+    TEST_CHECK(source != NULL && copy != NULL && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    primary = bitmap_repl_primary(fds[0]);
+    follower = bitmap_repl_follower(fds[1], copy);
+    TEST_CHECK(primary != NULL && follower != NULL);
+
+    for (i = 0; i < REPL_BITMAPS; i++)
+    {
+        TEST_CHECK(bitmap_registry_get(source, names[i], (u16)(100 + i * 20000)) != NULL);
+    }
+
+    /* A new follower starts with everything, then gets the dirty blocks of each round */
+    TEST_CHECK(bitmap_repl_send_registry(primary, source, BITMAP_REPL_FULL));
+    TEST_CHECK(catch_up(primary, follower) && same_registry(source, copy));
+
+    for (round = 0; round < REPL_ROUNDS; round++)
+    {
+        for (i = 0; i < REPL_BITMAPS; i++)
+        {
+            change(bitmap_registry_find(source, names[i]));
+        }
+
+        TEST_CHECK(bitmap_repl_send_registry(primary, source, 0));
+
+        if (!catch_up(primary, follower) || !same_registry(source, copy))
+        {
+            fprintf(stderr, "round %u: the follower differs\n", round);
+            TEST_CHECK(false);
+            break;
+        }
+    }
+
+    /* Nothing changed, nothing to send */
+    bitmap_repl_get_stats(primary, &sent);
+    TEST_CHECK(bitmap_repl_send_registry(primary, source, 0));
+    bitmap_repl_get_stats(primary, &applied);
+    TEST_CHECK(applied.records == sent.records);
+
+    bitmap_repl_get_stats(follower, &applied);
+    TEST_CHECK(sent.seq_ack == sent.seq && applied.seq == sent.seq);
+    TEST_CHECK(applied.records == sent.records && applied.blocks == sent.blocks &&
+               applied.bytes == sent.bytes);
+
+    bitmap_repl_close(primary);
+    bitmap_repl_close(follower);
+    close(fds[0]);
+    close(fds[1]);
+    bitmap_registry_destroy(source);
+    bitmap_registry_destroy(copy);
+
+    return;
+}
+
+/* Everything the primary sent so far */
+static ssize_t take_sent(int fd, u8 *buf)
+{
+    ssize_t len = 0;
+    ssize_t ret = 0;
+
+    while ((ret = recv(fd, buf + len, REPL_RELAY_SIZE - (size_t)len, MSG_DONTWAIT)) > 0)
+    {
+        len += ret;
+    }
+
+    return len;
+}
+
+static void test_relayed(void)
+{
+    struct bitmap_registry *copy = bitmap_registry_create();
+    struct bitmap_repl *primary = NULL;
+    struct bitmap_repl *follower = NULL;
+    struct bitmap_repl_stats applied;
+    struct bitmap *bm = bitmap_create(1000);
+    struct bitmap *target = NULL;
+    u8 *buf = (u8 *)malloc(REPL_RELAY_SIZE);
+    int to_relay[2] = {-1, -1};
+    int to_follower[2] = {-1, -1};
+    ssize_t len = 0;
+
+    TEST_CHECK(copy != NULL && bm != NULL && buf != NULL &&
+               socketpair(AF_UNIX, SOCK_STREAM, 0, to_relay) == 0 &&
+               socketpair(AF_UNIX, SOCK_STREAM, 0, to_follower) == 0);
+    primary = bitmap_repl_primary(to_relay[0]);
+    follower = bitmap_repl_follower(to_follower[1], copy);
+    TEST_CHECK(primary != NULL && follower != NULL);
+
+    if (primary == NULL || follower == NULL || buf == NULL || bm == NULL)
+    {
+        goto out;
+    }
+
+    /* One record in two writes, split inside its header */
+    bitmap_add_value(bm, 3);
+    bitmap_add_value(bm, 999);
+    TEST_CHECK(bitmap_repl_send(primary, "split", bm, 0));
+    len = take_sent(to_relay[1], buf);
+    TEST_CHECK(len > 20);
+    TEST_CHECK(write(to_follower[0], buf, 20) == 20);
+    TEST_CHECK(bitmap_repl_poll(follower, 1000));
+    TEST_CHECK(bitmap_registry_find(copy, "split") == NULL);
+    TEST_CHECK(write(to_follower[0], buf + 20, (size_t)(len - 20)) == len - 20);
+    TEST_CHECK(bitmap_repl_poll(follower, 1000));
+    target = bitmap_registry_find(copy, "split");
+    TEST_CHECK(same_bitmap(bm, target));
+
+    /* A flipped bit in the words fails the CRC and changes nothing */
+    bitmap_add_value(bm, 500);
+    TEST_CHECK(bitmap_repl_send(primary, "split", bm, 0));
+    len = take_sent(to_relay[1], buf);
+    TEST_CHECK(len > 40);
+    buf[len - 1] ^= 0x10;
+    TEST_CHECK(write(to_follower[0], buf, (size_t)len) == len);
+    TEST_CHECK(!bitmap_repl_poll(follower, 1000));
+    target = bitmap_registry_find(copy, "split");
+    TEST_CHECK(target != NULL && target->numbers == 2 && !bitmap_test_value(target, 500));
+
+    bitmap_repl_get_stats(follower, &applied);
+    TEST_CHECK(applied.records == 1 && applied.seq == 1);
+
+out:
+    bitmap_repl_close(primary);
+    bitmap_repl_close(follower);
+    close(to_relay[0]);
+    close(to_relay[1]);
+    close(to_follower[0]);
+    close(to_follower[1]);
+    bitmap_registry_destroy(copy);
+    bitmap_destroy(bm);
+    free(buf);
+
+    return;
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_relayed();
+
+    return TEST_EXIT();
+}
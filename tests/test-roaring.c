@@ -0,0 +1,214 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap-format.h"
+#include "bitmap-roaring.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * Round trips of the Roaring fixtures, see fixtures/roaring/README.md:
+ *
+ *     test-roaring [fixture directory]
+ *
+ * Every fixture must read to the values of its .txt file, and the canonical ones must be
+ * written back byte for byte.
+ */
+
+#define FIXTURE_CAPACITY 100 /* Capacity to read empty.bin with, it has no largest value */
+
+struct fixture
+{
+    const char *bin;
+    const char *txt;
+    bool canonical; /* bitmap_write_roaring gives the same bytes */
+};
+
+static const struct fixture fixtures[] = {
+    {"empty", "empty", true},
+    {"array", "array", true},
+    {"bitmap", "bitmap", true},
+    {"runs", "runs", true},
+    {"full", "full", true},
+    {"array-as-runs", "array", false},
+    {"runs-as-array", "runs", false},
+};
+
+static const char *fixture_dir = "fixtures/roaring";
+
+static u8 *read_file(const char *name, const char *ext, size_t *len)
+{
+    char path[256];
+    FILE *fp = NULL;
+    u8 *buf = NULL;
+    long size = 0;
+
+    snprintf(path, sizeof(path), "%s/%s.%s", fixture_dir, name, ext);
+    fp = fopen(path, "rb");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: can not open\n", path);
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+
+    /* One more byte, the .txt files are read as a string */
+    buf = (u8 *)calloc(1, (size_t)size + 1);
+
+    if (buf != NULL && fread(buf, 1, (size_t)size, fp) != (size_t)size)
+    {
+        free(buf);
+        buf = NULL;
+    }
+
+    fclose(fp);
+    *len = (size_t)size;
+
+    return buf;
+}
+
+static bool same_values(const struct bitmap *bm, const char *txt)
+{
+    char *str = NULL;
+    size_t txt_len = strcspn(txt, "\r\n");
+    size_t len = bitmap_format(bm, NULL, 0);
+    bool same = false;
+
+    str = (char *)malloc(len + 1);
+
+    if (str == NULL)
+    {
+        return false;
+    }
+
+    same = bitmap_format(bm, str, len + 1) == txt_len && memcmp(str, txt, txt_len) == 0;
+    free(str);
+
+    return same;
+}
+
+static void test_fixture(const struct fixture *f)
+{
+    struct bitmap *bm = NULL;
+    u8 *bin = NULL;
+    u8 *txt = NULL;
+    u8 *out = NULL;
+    size_t bin_len = 0;
+    size_t txt_len = 0;
+    size_t out_len = 0;
+    size_t consumed = 0;
+    u16 capacity = (strcmp(f->bin, "empty") == 0) ? FIXTURE_CAPACITY : 0;
+
+    bin = read_file(f->bin, "bin", &bin_len);
+    txt = read_file(f->txt, "txt", &txt_len);
+    TEST_CHECK(bin != NULL && txt != NULL);
+
+    if (bin == NULL || txt == NULL)
+    {
+        goto out;
+    }
+
+    bm = bitmap_read_roaring(bin, bin_len, capacity, &consumed);
+    TEST_CHECK(bm != NULL);
+
+    if (bm == NULL)
+    {
+        fprintf(stderr, "%s.bin: not read\n", f->bin);
+        goto out;
+    }
+
+    TEST_CHECK(consumed == bin_len);
+
+    if (!same_values(bm, (const char *)txt))
+    {
+        fprintf(stderr, "%s.bin: values differ from %s.txt\n", f->bin, f->txt);
+        TEST_CHECK(false);
+    }
+
+    if (!f->canonical)
+    {
+        goto out;
+    }
+
+    out_len = bitmap_write_roaring(bm, NULL, 0);
+    TEST_CHECK(out_len == bin_len);
+    out = (u8 *)malloc(out_len);
+
+    if (out == NULL || bitmap_write_roaring(bm, out, out_len) != out_len ||
+        out_len != bin_len || memcmp(out, bin, bin_len) != 0)
+    {
+        fprintf(stderr, "%s.bin: not written back byte for byte\n", f->bin);
+        TEST_CHECK(false);
+    }
+
+out:
+    bitmap_destroy(bm);
+    free(out);
+    free(txt);
+    free(bin);
+
+    return;
+}
+
+static void test_capacity(void)
+{
+    struct bitmap *bm = NULL;
+    u8 *bin = NULL;
+    size_t len = 0;
+
+    /* An empty Roaring bitmap has no largest value to take the capacity from */
+    bin = read_file("empty", "bin", &len);
+    TEST_CHECK(bin != NULL);
+
+    if (bin != NULL)
+    {
+        TEST_CHECK(bitmap_read_roaring(bin, len, 0, NULL) == NULL);
+        bm = bitmap_read_roaring(bin, len, FIXTURE_CAPACITY, NULL);
+        TEST_CHECK(bm != NULL && bm->max_value == FIXTURE_CAPACITY && bm->numbers == 0);
+        bitmap_destroy(bm);
+        free(bin);
+    }
+
+    /* 65534 is the largest value of array.bin: it needs a capacity of 65535 */
+    bin = read_file("array", "bin", &len);
+    TEST_CHECK(bin != NULL);
+
+    if (bin != NULL)
+    {
+        TEST_CHECK(bitmap_read_roaring(bin, len, UINT16_MAX - 1, NULL) == NULL);
+        bm = bitmap_read_roaring(bin, len, 0, NULL);
+        TEST_CHECK(bm != NULL && bm->max_value == UINT16_MAX);
+        bitmap_destroy(bm);
+        bm = bitmap_read_roaring(bin, len - 1, 0, NULL);
+        TEST_CHECK(bm == NULL);
+        bitmap_destroy(bm);
+        free(bin);
+    }
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    size_t i = 0;
+
+    if (argc > 1)
+    {
+        fixture_dir = argv[1];
+    }
+
+    for (i = 0; i < sizeof(fixtures) / sizeof(fixtures[0]); i++)
+    {
+        test_fixture(&fixtures[i]);
+    }
+
+    test_capacity();
+
+    return TEST_EXIT();
+}
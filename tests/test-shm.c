@@ -0,0 +1,141 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bitmap-shm.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * Processes that add and delete in one shared bitmap at the same time. Each process adds the
+ * values of its own share and deletes the multiples of 3 in it again, and every process also
+ * adds the same shared values, so neighbouring bits and the same words race. The count kept
+ * in the header must match the words at the end.
+ */
+
+#define SHM_CAPACITY 65535
+#define SHM_PROCS 4
+#define SHM_SHARED 4096 /* Values below this are added by every process */
+#define SHM_ROUNDS 16
+
+static bool expected(u32 value)
+{
+    return value % 3 != 0;
+}
+
+static void worker(const char *name, u32 id, int start)
+{
+    struct bitmap_shm shm;
+    bool ok = true;
+    char c = 0;
+    u32 round = 0;
+    u32 v = 0;
+
+    if (!bitmap_shm_open(&shm, name))
+    {
+        _exit(EXIT_FAILURE);
+    }
+
+    /* Start together, when the parent closes the pipe */
+    ok = read(start, &c, 1) == 0;
+
+    for (round = 0; round < SHM_ROUNDS; round++)
+    {
+        for (v = 0; v < SHM_CAPACITY; v++)
+        {
+            if (v % SHM_PROCS == id)
+            {
+                ok = bitmap_shm_add(&shm, (u16)v) && ok;
+            }
+
+            if (v < SHM_SHARED && expected(v))
+            {
+                ok = bitmap_shm_add(&shm, (u16)v) && ok;
+            }
+        }
+
+        for (v = id; v < SHM_CAPACITY; v += SHM_PROCS)
+        {
+            if (!expected(v))
+            {
+                ok = bitmap_shm_del(&shm, (u16)v) && ok;
+            }
+        }
+    }
+
+    ok = !bitmap_shm_add(&shm, SHM_CAPACITY) && ok;
+    bitmap_shm_close(&shm);
+
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int main(void)
+{
+    struct bitmap_shm shm;
+    struct bitmap *bm = NULL;
+    char name[64];
+    pid_t pids[SHM_PROCS];
+    int start[2];
+    int status = 0;
+    u32 count = 0;
+    u32 v = 0;
+    u32 i = 0;
+
+    snprintf(name, sizeof(name), "/test-shm-%d", (int)getpid());
+
+    if (!bitmap_shm_create(&shm, name, SHM_CAPACITY))
+    {
+        fprintf(stderr, "can not create %s\n", name);
+        return EXIT_FAILURE;
+    }
+
+    TEST_CHECK(bitmap_shm_count(&shm) == 0);
+    TEST_CHECK(pipe(start) == 0);
+
+    for (i = 0; i < SHM_PROCS; i++)
+    {
+        pids[i] = fork();
+
+        if (pids[i] == 0)
+        {
+            close(start[1]);
+            worker(name, i, start[0]);
+        }
+
+        TEST_CHECK(pids[i] > 0);
+    }
+
+    close(start[0]);
+    close(start[1]);
+
+    for (i = 0; i < SHM_PROCS; i++)
+    {
+        TEST_CHECK(pids[i] > 0 && waitpid(pids[i], &status, 0) == pids[i] && WIFEXITED(status) &&
+                   WEXITSTATUS(status) == EXIT_SUCCESS);
+    }
+
+    for (v = 0; v < SHM_CAPACITY; v++)
+    {
+        count += expected(v);
+
+        if (bitmap_shm_test(&shm, (u16)v) != expected(v))
+        {
+            fprintf(stderr, "value %u is %s\n", v, expected(v) ? "missing" : "set");
+            TEST_CHECK(false);
+            break;
+        }
+    }
+
+    /* The header count, kept by the atomic updates, against a scan of the words */
+    bm = bitmap_shm_bitmap(&shm);
+    TEST_CHECK(bitmap_shm_count(&shm) == count);
+    TEST_CHECK(bm != NULL && bm->numbers == count && bm->first_value == 1 &&
+               bm->last_value == SHM_CAPACITY - 1);
+
+    bitmap_shm_close(&shm);
+    TEST_CHECK(bitmap_shm_unlink(name));
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,224 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bitmap-wal.h"
+#include "bitmap.h"
+#include "test.h"
+
+/*
+ * Reopen and replay of a logged bitmap across compactions. The writers run in a child that
+ * exits without bitmap_wal_close, like a crash after its last commit returned.
+ */
+
+#define WAL_CAPACITY 4096
+#define WAL_ROUNDS 64
+#define WAL_BATCH 32
+
+static char snapshot[64];
+static char log_path[80];
+
+static long file_size(const char *path)
+{
+    struct stat st;
+
+    return (stat(path, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static void remove_files(void)
+{
+    unlink(snapshot);
+    unlink(log_path);
+
+    return;
+}
+
+/* The values of round r, added in even rounds and deleted again in every fourth */
+static void round_values(u32 r, u16 *values)
+{
+    u32 i = 0;
+
+    for (i = 0; i < WAL_BATCH; i++)
+    {
+        values[i] = (u16)((r * 97 + i * 31) % WAL_CAPACITY);
+    }
+
+    return;
+}
+
+static void expect_rounds(struct bitmap *expected, u32 rounds)
+{
+    u16 values[WAL_BATCH];
+    u32 r = 0;
+
+    for (r = 0; r < rounds; r++)
+    {
+        round_values(r, values);
+
+        if (r % 4 == 3)
+        {
+            bitmap_del_values(expected, values, WAL_BATCH);
+        }
+        else
+        {
+            bitmap_add_values(expected, values, WAL_BATCH);
+        }
+    }
+
+    return;
+}
+
+static bool same_bitmap(const struct bitmap *a, const struct bitmap *b)
+{
+    return a->max_value == b->max_value && a->numbers == b->numbers &&
+           memcmp(a->buf, b->buf, a->buf_len * sizeof(u32)) == 0;
+}
+
+/* Logs rounds [from, to), compacting every compact_every rounds, then exits without closing */
+static void writer(const struct bitmap_wal_options *options, u32 from, u32 to, u32 compact_every)
+{
+    struct bitmap_wal *wal = NULL;
+    u16 values[WAL_BATCH];
+    bool ok = true;
+    u32 r = 0;
+
+    wal = bitmap_wal_open(snapshot, options);
+
+    if (wal == NULL)
+    {
+        _exit(EXIT_FAILURE);
+    }
+
+    for (r = from; r < to && ok; r++)
+    {
+        round_values(r, values);
+        ok = (r % 4 == 3) ? bitmap_wal_del(wal, values, WAL_BATCH)
+                          : bitmap_wal_add(wal, values, WAL_BATCH);
+        ok = ok && bitmap_wal_commit(wal);
+
+        if (ok && compact_every != 0 && r % compact_every == compact_every - 1)
+        {
+            ok = bitmap_wal_compact(wal);
+        }
+    }
+
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static bool run_writer(const struct bitmap_wal_options *options, u32 from, u32 to,
+                       u32 compact_every)
+{
+    pid_t pid = 0;
+    int status = 0;
+
+    pid = fork();
+
+    if (pid == 0)
+    {
+        writer(options, from, to, compact_every);
+    }
+
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+           WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static void check_reopen(const struct bitmap_wal_options *options, u32 rounds)
+{
+    struct bitmap_wal *wal = NULL;
+    struct bitmap *expected = NULL;
+
+    expected = bitmap_create(WAL_CAPACITY);
+    wal = bitmap_wal_open(snapshot, options);
+    TEST_CHECK(expected != NULL && wal != NULL);
+
+    if (expected != NULL && wal != NULL)
+    {
+        expect_rounds(expected, rounds);
+        TEST_CHECK(same_bitmap(bitmap_wal_bitmap(wal), expected));
+    }
+
+    TEST_CHECK(wal == NULL || bitmap_wal_close(wal));
+    bitmap_destroy(expected);
+
+    return;
+}
+
+static void test_compaction(void)
+{
+    struct bitmap_wal_options options = {WAL_CAPACITY, false, BITMAP_WAL_SYNC_COMMIT, 0, 0, 0};
+
+    /* Only the log */
+    remove_files();
+    TEST_CHECK(run_writer(&options, 0, WAL_ROUNDS, 0));
+    TEST_CHECK(file_size(snapshot) < 0);
+    check_reopen(&options, WAL_ROUNDS);
+
+    /* Compactions in between, and records after the last one */
+    remove_files();
+    TEST_CHECK(run_writer(&options, 0, WAL_ROUNDS + 5, 8));
+    TEST_CHECK(file_size(snapshot) > 0);
+    check_reopen(&options, WAL_ROUNDS + 5);
+
+    /* A compaction last leaves an empty log */
+    remove_files();
+    TEST_CHECK(run_writer(&options, 0, WAL_ROUNDS, 8));
+    TEST_CHECK(file_size(log_path) == 8);
+    check_reopen(&options, WAL_ROUNDS);
+
+    /* More writers over the recovered state, compacting by log size */
+    options.compact_size = 512;
+    TEST_CHECK(run_writer(&options, WAL_ROUNDS, 2 * WAL_ROUNDS, 0));
+    TEST_CHECK(file_size(log_path) < 512);
+    check_reopen(&options, 2 * WAL_ROUNDS);
+
+    remove_files();
+
+    return;
+}
+
+static void test_replay_twice(void)
+{
+    struct bitmap_wal_options options = {WAL_CAPACITY, false, BITMAP_WAL_SYNC_COMMIT, 0, 0, 0};
+    struct bitmap_wal *wal = NULL;
+    char saved[96];
+    char cmd[256];
+
+    /* A crash after the new snapshot, before the log was emptied: the log replays on it */
+    remove_files();
+    TEST_CHECK(run_writer(&options, 0, WAL_ROUNDS, 0));
+    snprintf(saved, sizeof(saved), "%s.saved", log_path);
+    snprintf(cmd, sizeof(cmd), "cp %s %s", log_path, saved);
+    TEST_CHECK(system(cmd) == 0);
+
+    wal = bitmap_wal_open(snapshot, &options);
+    TEST_CHECK(wal != NULL && bitmap_wal_compact(wal) && bitmap_wal_close(wal));
+    TEST_CHECK(rename(saved, log_path) == 0);
+    check_reopen(&options, WAL_ROUNDS);
+
+    remove_files();
+
+    return;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/test-wal-XXXXXX";
+
+    if (mkdtemp(dir) == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    snprintf(snapshot, sizeof(snapshot), "%s/bm", dir);
+    snprintf(log_path, sizeof(log_path), "%s/bm.wal", dir);
+
+    test_compaction();
+    test_replay_twice();
+    rmdir(dir);
+
+    return TEST_EXIT();
+}
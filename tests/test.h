@@ -0,0 +1,29 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Checks for the test programs. A failed check prints where it failed and the test goes on,
+ * so one run shows every failure:
+ *
+ *     TEST_CHECK(bm->numbers == 3);
+ *     return TEST_EXIT();
+ */
+
+static unsigned test_failures;
+
+#define TEST_CHECK(cond)                                                                           \
+    do                                                                                             \
+    {                                                                                              \
+        if (!(cond))                                                                               \
+        {                                                                                          \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);              \
+            test_failures++;                                                                       \
+        }                                                                                          \
+    } while (0)
+
+#define TEST_EXIT() ((test_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif /* __TEST_H__ */